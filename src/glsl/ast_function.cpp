@@ -484,6 +484,23 @@ generate_call(exec_list *instructions, ir_function_signature *sig,
    return deref ? deref->clone(ctx, NULL) : NULL;
 }
 
+/**
+ * Built-in variables are only created when the shader names them.  Make sure
+ * the ones a built-in function body uses (gl_Vertex in ftransform()) exist
+ * too, so that the linker binds the body to them.
+ */
+static void
+create_builtin_globals(ir_instruction *ir, void *data)
+{
+   ir_dereference_variable *deref = ir->as_dereference_variable();
+
+   /* The built-in shader doesn't declare these with their real modes
+    * (ftransform()'s gl_Vertex is a function "in"), go by the name.
+    */
+   if (deref != NULL && strncmp(deref->var->name, "gl_", 3) == 0)
+      ((_mesa_glsl_parse_state *) data)->symbols->get_variable(deref->var->name);
+}
+
 /**
  * Given a function name and parameter list, find the matching signature.
  */
@@ -538,6 +555,8 @@ done:
 	    emit_function(state, f);
 	 }
 	 f->add_signature(sig->clone_prototype(f, NULL));
+	 foreach_in_list(ir_instruction, ir, &sig->body)
+	    visit_tree(ir, create_builtin_globals, state);
       }
    }
    return sig;
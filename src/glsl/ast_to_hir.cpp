@@ -99,6 +99,12 @@ _mesa_ast_to_hir(exec_list *instructions, struct _mesa_glsl_parse_state *state)
    foreach_list_typed (ast_node, ast, link, & state->translation_unit)
       ast->hir(instructions, state);
 
+   /* Built-in variables that were not looked up by now are not used by the
+    * shader; stop creating them on demand.
+    */
+   state->symbols->lazy_variables->finish();
+   state->symbols->lazy_variables = NULL;
+
    detect_recursion_unlinked(state, instructions);
    detect_conflicting_assignments(state, instructions);
 
@@ -350,101 +350,125 @@ per_vertex_accumulator::construct_interface_instance() const
 }
 
 
-class builtin_variable_generator
+/**
+ * Everything needed to create a built-in variable once it is used.
+ */
+struct builtin_variable_desc
 {
-public:
-   builtin_variable_generator(exec_list *instructions,
-                              struct _mesa_glsl_parse_state *state);
-   void generate_constants();
-   void generate_uniforms();
-   void generate_vs_special_vars();
-   void generate_gs_special_vars();
-   void generate_fs_special_vars();
-   void generate_cs_special_vars();
-   void generate_varyings();
-
-private:
-   const glsl_type *array(const glsl_type *base, unsigned elements)
-   {
-      return glsl_type::get_array_instance(base, elements);
-   }
+   const char *name;
+   const glsl_type *type;
+   const glsl_type *interface_type;
+   const char *extension_warning;
+   enum ir_variable_mode mode;
+   glsl_precision prec;
+   int slot;
+   unsigned interpolation:2;
+   unsigned centroid:1;
+   unsigned sample:1;
+   unsigned has_constant:1;
+   int constant_value[3];
+
+   /** The variable, once it has been materialized. */
+   ir_variable *var;
+};
 
-   const glsl_type *type(const char *name)
-   {
-      return symtab->get_type(name);
-   }
 
-   ir_variable *add_input(int slot, const glsl_type *type, const char *name, glsl_precision prec)
-   {
-      return add_variable(name, type, ir_var_shader_in, slot, prec);
-   }
+/**
+ * Built-in variables of a shader, which are only turned into ir_variables
+ * (and added to the IR and the symbol table) when first looked up.
+ */
+class builtin_variable_table : public glsl_lazy_variable_source
+{
+public:
+   DECLARE_RALLOC_CXX_OPERATORS(builtin_variable_table)
 
-   ir_variable *add_output(int slot, const glsl_type *type, const char *name, glsl_precision prec)
-   {
-      return add_variable(name, type, ir_var_shader_out, slot, prec);
-   }
+   builtin_variable_table(exec_list *instructions,
+                          struct _mesa_glsl_parse_state *state);
 
-   ir_variable *add_system_value(int slot, const glsl_type *type,
-                                 const char *name, glsl_precision prec)
-   {
-      return add_variable(name, type, ir_var_system_value, slot, prec);
-   }
+   builtin_variable_desc *add(const char *name, const glsl_type *type,
+                              enum ir_variable_mode mode, int slot,
+                              glsl_precision prec);
+   ir_variable *materialize(builtin_variable_desc *desc);
+   virtual ir_variable *materialize(const char *name);
+   virtual void finish();
 
-   ir_variable *add_variable(const char *name, const glsl_type *type,
-                             enum ir_variable_mode mode, int slot, glsl_precision prec);
-   ir_variable *add_uniform(const glsl_type *type, const char *name, glsl_precision prec = glsl_precision_undefined);
-   ir_variable *add_const(const char *name, int value);
-   ir_variable *add_const_ivec3(const char *name, int x, int y, int z);
-   void add_varying(int slot, const glsl_type *type, const char *name,
-                    const char *name_as_gs_input, glsl_precision prec);
+private:
+   void add_state_slots(ir_variable *uni);
 
-   exec_list * const instructions;
    struct _mesa_glsl_parse_state * const state;
    glsl_symbol_table * const symtab;
 
    /**
-    * True if compatibility-profile-only variables should be included.  (In
-    * desktop GL, these are always included when the GLSL version is 1.30 and
-    * or below).
+    * Placeholder following the built-in variable declarations in the IR;
+    * declarations the shader adds later go either before or after it.
     */
-   const bool compatibility;
+   ir_instruction *end_marker;
 
-   const glsl_type * const bool_t;
-   const glsl_type * const int_t;
-   const glsl_type * const uint_t;
-   const glsl_type * const float_t;
-   const glsl_type * const vec2_t;
-   const glsl_type * const vec3_t;
-   const glsl_type * const vec4_t;
-   const glsl_type * const mat3_t;
-   const glsl_type * const mat4_t;
-
-   per_vertex_accumulator per_vertex_in;
-   per_vertex_accumulator per_vertex_out;
+   /** Descriptions in the order the variables were generated. */
+   builtin_variable_desc *descs;
+   unsigned num_descs;
+   unsigned descs_capacity;
 };
 
 
-builtin_variable_generator::builtin_variable_generator(
+builtin_variable_table::builtin_variable_table(
    exec_list *instructions, struct _mesa_glsl_parse_state *state)
-   : instructions(instructions), state(state), symtab(state->symbols),
-     compatibility(!state->is_version(140, 100)),
-     bool_t(glsl_type::bool_type), int_t(glsl_type::int_type), uint_t(glsl_type::uint_type),
-     float_t(glsl_type::float_type), vec2_t(glsl_type::vec2_type),
-     vec3_t(glsl_type::vec3_type), vec4_t(glsl_type::vec4_type),
-     mat3_t(glsl_type::mat3_type), mat4_t(glsl_type::mat4_type)
+   : state(state), symtab(state->symbols),
+     descs(NULL), num_descs(0), descs_capacity(0)
 {
+   this->end_marker = new(this) ir_discard();
+   instructions->push_tail(this->end_marker);
+}
+
+
+builtin_variable_desc *
+builtin_variable_table::add(const char *name, const glsl_type *type,
+                            enum ir_variable_mode mode, int slot,
+                            glsl_precision prec)
+{
+   if (this->num_descs == this->descs_capacity) {
+      this->descs_capacity = MAX2(this->descs_capacity * 2, 64);
+      this->descs = reralloc(this, this->descs, builtin_variable_desc,
+                             this->descs_capacity);
+   }
+
+   builtin_variable_desc *desc = &this->descs[this->num_descs++];
+   memset(desc, 0, sizeof(*desc));
+   desc->name = name;
+   desc->type = type;
+   desc->mode = mode;
+   desc->slot = slot;
+   desc->prec = this->state->es_shader ? prec : glsl_precision_undefined;
+   desc->interpolation = INTERP_QUALIFIER_NONE;
+   return desc;
 }
 
 
 ir_variable *
-builtin_variable_generator::add_variable(const char *name,
-                                         const glsl_type *type,
-                                         enum ir_variable_mode mode, int slot, glsl_precision prec)
+builtin_variable_table::materialize(const char *name)
+{
+   /* Only names in the reserved gl_ namespace can be built-ins; this keeps
+    * lookups of undeclared user names cheap.
+    */
+   if (strncmp(name, "gl_", 3) != 0)
+      return NULL;
 
+   /* If a name was generated more than once, the first one wins, just like
+    * it would when adding it to the symbol table twice.
+    */
+   for (unsigned i = 0; i < this->num_descs; i++) {
+      if (strcmp(this->descs[i].name, name) == 0)
+         return this->descs[i].var ? NULL : materialize(&this->descs[i]);
+   }
+   return NULL;
+}
+
+
+ir_variable *
+builtin_variable_table::materialize(builtin_variable_desc *desc)
 {
-   if (!this->state->es_shader)
-      prec = glsl_precision_undefined;
-   ir_variable *var = new(symtab) ir_variable(type, name, mode, prec);
+   ir_variable *var = new(symtab) ir_variable(desc->type, desc->name,
+                                              desc->mode, desc->prec);
    var->data.how_declared = ir_var_declared_implicitly;
 
    switch (var->data.mode) {
@@ -465,25 +489,61 @@ builtin_variable_generator::add_variable(const char *name,
       break;
    }
 
-   var->data.location = slot;
-   var->data.explicit_location = (slot >= 0);
+   var->data.location = desc->slot;
+   var->data.explicit_location = (desc->slot >= 0);
    var->data.explicit_index = 0;
+   var->data.interpolation = desc->interpolation;
+   var->data.centroid = desc->centroid;
+   var->data.sample = desc->sample;
+   if (desc->interface_type)
+      var->init_interface_type(desc->interface_type);
+   if (desc->extension_warning)
+      var->enable_extension_warning(desc->extension_warning);
+
+   if (desc->has_constant) {
+      ir_constant_data data;
+      memset(&data, 0, sizeof(data));
+      memcpy(data.i, desc->constant_value, sizeof(desc->constant_value));
+      var->constant_value = new(var) ir_constant(desc->type, &data);
+      var->constant_initializer = new(var) ir_constant(desc->type, &data);
+      var->data.has_initializer = true;
+   }
 
-   /* Once the variable is created an initialized, add it to the symbol table
-    * and add the declaration to the IR stream.
+   if (var->data.mode == ir_var_uniform)
+      add_state_slots(var);
+
+   /* Keep declarations in the order the variables were generated in, at the
+    * spot they would have been in had all of them been added up front.
     */
-   instructions->push_tail(var);
+   desc->var = var;
+   ir_instruction *next = this->end_marker;
+   for (const builtin_variable_desc *d = desc + 1;
+        d != this->descs + this->num_descs; d++) {
+      if (d->var != NULL && d->var->next != NULL) {
+         next = d->var;
+         break;
+      }
+   }
+   next->insert_before(var);
 
-   symtab->add_variable(var);
+   symtab->add_global_variable(var);
    return var;
 }
 
 
-ir_variable *
-builtin_variable_generator::add_uniform(const glsl_type *type,
-                                        const char *name, glsl_precision prec)
+void
+builtin_variable_table::finish()
+{
+   this->end_marker->remove();
+   this->end_marker = NULL;
+}
+
+
+void
+builtin_variable_table::add_state_slots(ir_variable *uni)
 {
-   ir_variable *const uni = add_variable(name, type, ir_var_uniform, -1, prec);
+   const glsl_type *const type = uni->type;
+   const char *const name = uni->name;
 
    unsigned i;
    for (i = 0; _mesa_builtin_uniform_desc[i].name != NULL; i++) {
@@ -520,38 +580,129 @@ builtin_variable_generator::add_uniform(const glsl_type *type,
 	 slots++;
       }
    }
+}
+
+
+class builtin_variable_generator
+{
+public:
+   builtin_variable_generator(builtin_variable_table *table,
+                              struct _mesa_glsl_parse_state *state);
+   void generate_constants();
+   void generate_uniforms();
+   void generate_vs_special_vars();
+   void generate_gs_special_vars();
+   void generate_fs_special_vars();
+   void generate_cs_special_vars();
+   void generate_varyings();
+
+private:
+   const glsl_type *array(const glsl_type *base, unsigned elements)
+   {
+      return glsl_type::get_array_instance(base, elements);
+   }
 
-   return uni;
+   const glsl_type *type(const char *name)
+   {
+      return symtab->get_type(name);
+   }
+
+   builtin_variable_desc *add_input(int slot, const glsl_type *type, const char *name, glsl_precision prec)
+   {
+      return add_variable(name, type, ir_var_shader_in, slot, prec);
+   }
+
+   builtin_variable_desc *add_output(int slot, const glsl_type *type, const char *name, glsl_precision prec)
+   {
+      return add_variable(name, type, ir_var_shader_out, slot, prec);
+   }
+
+   builtin_variable_desc *add_system_value(int slot, const glsl_type *type,
+                                           const char *name, glsl_precision prec)
+   {
+      return add_variable(name, type, ir_var_system_value, slot, prec);
+   }
+
+   builtin_variable_desc *add_variable(const char *name, const glsl_type *type,
+                                       enum ir_variable_mode mode, int slot, glsl_precision prec)
+   {
+      return table->add(name, type, mode, slot, prec);
+   }
+
+   builtin_variable_desc *add_uniform(const glsl_type *type, const char *name, glsl_precision prec = glsl_precision_undefined);
+   builtin_variable_desc *add_const(const char *name, int value);
+   builtin_variable_desc *add_const_ivec3(const char *name, int x, int y, int z);
+   void add_varying(int slot, const glsl_type *type, const char *name,
+                    const char *name_as_gs_input, glsl_precision prec);
+
+   builtin_variable_table * const table;
+   struct _mesa_glsl_parse_state * const state;
+   glsl_symbol_table * const symtab;
+
+   /**
+    * True if compatibility-profile-only variables should be included.  (In
+    * desktop GL, these are always included when the GLSL version is 1.30 and
+    * or below).
+    */
+   const bool compatibility;
+
+   const glsl_type * const bool_t;
+   const glsl_type * const int_t;
+   const glsl_type * const uint_t;
+   const glsl_type * const float_t;
+   const glsl_type * const vec2_t;
+   const glsl_type * const vec3_t;
+   const glsl_type * const vec4_t;
+   const glsl_type * const mat3_t;
+   const glsl_type * const mat4_t;
+
+   per_vertex_accumulator per_vertex_in;
+   per_vertex_accumulator per_vertex_out;
+};
+
+
+builtin_variable_generator::builtin_variable_generator(
+   builtin_variable_table *table, struct _mesa_glsl_parse_state *state)
+   : table(table), state(state), symtab(state->symbols),
+     compatibility(!state->is_version(140, 100)),
+     bool_t(glsl_type::bool_type), int_t(glsl_type::int_type), uint_t(glsl_type::uint_type),
+     float_t(glsl_type::float_type), vec2_t(glsl_type::vec2_type),
+     vec3_t(glsl_type::vec3_type), vec4_t(glsl_type::vec4_type),
+     mat3_t(glsl_type::mat3_type), mat4_t(glsl_type::mat4_type)
+{
 }
 
 
-ir_variable *
+builtin_variable_desc *
+builtin_variable_generator::add_uniform(const glsl_type *type,
+                                        const char *name, glsl_precision prec)
+{
+   /* State slots are set up when the variable gets materialized. */
+   return add_variable(name, type, ir_var_uniform, -1, prec);
+}
+
+
+builtin_variable_desc *
 builtin_variable_generator::add_const(const char *name, int value)
 {
-   ir_variable *const var = add_variable(name, glsl_type::int_type,
-					 ir_var_auto, -1, glsl_precision_undefined);
-   var->constant_value = new(var) ir_constant(value);
-   var->constant_initializer = new(var) ir_constant(value);
-   var->data.has_initializer = true;
+   builtin_variable_desc *const var = add_variable(name, glsl_type::int_type,
+                                                   ir_var_auto, -1, glsl_precision_undefined);
+   var->has_constant = true;
+   var->constant_value[0] = value;
    return var;
 }
 
 
-ir_variable *
+builtin_variable_desc *
 builtin_variable_generator::add_const_ivec3(const char *name, int x, int y,
                                             int z)
 {
-   ir_variable *const var = add_variable(name, glsl_type::ivec3_type,
-                                         ir_var_auto, -1, glsl_precision_undefined);
-   ir_constant_data data;
-   memset(&data, 0, sizeof(data));
-   data.i[0] = x;
-   data.i[1] = y;
-   data.i[2] = z;
-   var->constant_value = new(var) ir_constant(glsl_type::ivec3_type, &data);
-   var->constant_initializer =
-      new(var) ir_constant(glsl_type::ivec3_type, &data);
-   var->data.has_initializer = true;
+   builtin_variable_desc *const var = add_variable(name, glsl_type::ivec3_type,
+                                                   ir_var_auto, -1, glsl_precision_undefined);
+   var->has_constant = true;
+   var->constant_value[0] = x;
+   var->constant_value[1] = y;
+   var->constant_value[2] = z;
    return var;
 }
 
@@ -831,11 +982,11 @@ builtin_variable_generator::generate_vs_special_vars()
 {
 
    if (state->is_version(130, 300))
-      add_system_value(SYSTEM_VALUE_VERTEX_ID, state->metal_target ? uint_t : int_t, "gl_VertexID", glsl_precision_high);
+      add_system_value(SYSTEM_VALUE_VERTEX_ID, int_t, "gl_VertexID", glsl_precision_high);
    if (state->ARB_draw_instanced_enable)
       add_system_value(SYSTEM_VALUE_INSTANCE_ID, int_t, "gl_InstanceIDARB", glsl_precision_high);
    if (state->ARB_draw_instanced_enable || state->is_version(140, 300))
-	   add_system_value(SYSTEM_VALUE_INSTANCE_ID, state->metal_target ? uint_t : int_t, "gl_InstanceID", glsl_precision_high);
+	   add_system_value(SYSTEM_VALUE_INSTANCE_ID, int_t, "gl_InstanceID", glsl_precision_high);
    if (state->AMD_vertex_shader_layer_enable)
       add_output(VARYING_SLOT_LAYER, int_t, "gl_Layer", glsl_precision_high);
    if (state->AMD_vertex_shader_viewport_index_enable)
@@ -880,11 +1031,11 @@ builtin_variable_generator::generate_gs_special_vars()
     * the specific case of gl_PrimitiveIDIn.  So we don't need to treat
     * gl_PrimitiveIDIn as an {ARB,EXT}_geometry_shader4-only variable.
     */
-   ir_variable *var;
+   builtin_variable_desc *var;
    var = add_input(VARYING_SLOT_PRIMITIVE_ID, int_t, "gl_PrimitiveIDIn", glsl_precision_high);
-   var->data.interpolation = INTERP_QUALIFIER_FLAT;
+   var->interpolation = INTERP_QUALIFIER_FLAT;
    var = add_output(VARYING_SLOT_PRIMITIVE_ID, int_t, "gl_PrimitiveID", glsl_precision_high);
-   var->data.interpolation = INTERP_QUALIFIER_FLAT;
+   var->interpolation = INTERP_QUALIFIER_FLAT;
 }
 
 
@@ -897,12 +1048,12 @@ builtin_variable_generator::generate_fs_special_vars()
    add_input(VARYING_SLOT_POS, vec4_t, "gl_FragCoord", glsl_precision_high);
    add_input(VARYING_SLOT_FACE, bool_t, "gl_FrontFacing", glsl_precision_low);
    if (state->is_version(120, 100))
-	   add_input(VARYING_SLOT_PNTC, vec2_t, "gl_PointCoord", state->metal_target ? glsl_precision_high : glsl_precision_medium);
+	   add_input(VARYING_SLOT_PNTC, vec2_t, "gl_PointCoord", glsl_precision_medium);
 
    if (state->is_version(150, 0)) {
-      ir_variable *var =
+      builtin_variable_desc *var =
          add_input(VARYING_SLOT_PRIMITIVE_ID, int_t, "gl_PrimitiveID", glsl_precision_high);
-      var->data.interpolation = INTERP_QUALIFIER_FLAT;
+      var->interpolation = INTERP_QUALIFIER_FLAT;
    }
 
    /* gl_FragColor and gl_FragData were deprecated starting in desktop GLSL
@@ -922,31 +1073,31 @@ builtin_variable_generator::generate_fs_special_vars()
       add_output(FRAG_RESULT_DEPTH, float_t, "gl_FragDepth", glsl_precision_high);
 
    if (state->ARB_shader_stencil_export_enable) {
-      ir_variable *const var =
+      builtin_variable_desc *const var =
          add_output(FRAG_RESULT_STENCIL, int_t, "gl_FragStencilRefARB", glsl_precision_high);
       if (state->ARB_shader_stencil_export_warn)
-         var->enable_extension_warning("GL_ARB_shader_stencil_export");
+         var->extension_warning = "GL_ARB_shader_stencil_export";
    }
 
    if (state->AMD_shader_stencil_export_enable) {
-      ir_variable *const var =
+      builtin_variable_desc *const var =
          add_output(FRAG_RESULT_STENCIL, int_t, "gl_FragStencilRefAMD", glsl_precision_high);
       if (state->AMD_shader_stencil_export_warn)
-         var->enable_extension_warning("GL_AMD_shader_stencil_export");
+         var->extension_warning = "GL_AMD_shader_stencil_export";
    }
 	
 	if (state->EXT_frag_depth_enable) {
-		ir_variable *const var =
+		builtin_variable_desc *const var =
 		add_output(FRAG_RESULT_DEPTH, float_t, "gl_FragDepthEXT", glsl_precision_high);
 		if (state->EXT_frag_depth_warn)
-			var->enable_extension_warning("GL_EXT_frag_depth");
+			var->extension_warning = "GL_EXT_frag_depth";
 	}
 	
 	if (state->EXT_shader_framebuffer_fetch_enable) {
-		ir_variable *const var =
+		builtin_variable_desc *const var =
 			add_input(VARYING_SLOT_VAR0, array(vec4_t, state->Const.MaxDrawBuffers), "gl_LastFragData", glsl_precision_medium);
 		if (state->EXT_shader_framebuffer_fetch_warn)
-			var->enable_extension_warning("GL_EXT_shader_framebuffer_fetch");
+			var->extension_warning = "GL_EXT_shader_framebuffer_fetch";
 	}
 
    if (state->ARB_sample_shading_enable) {
@@ -1059,13 +1210,17 @@ builtin_variable_generator::generate_varyings()
          this->per_vertex_out.construct_interface_instance();
       const glsl_struct_field *fields = per_vertex_out_type->fields.structure;
       for (unsigned i = 0; i < per_vertex_out_type->length; i++) {
-         ir_variable *var =
+         builtin_variable_desc *var =
             add_variable(fields[i].name, fields[i].type, ir_var_shader_out,
                          fields[i].location, fields[i].precision);
-         var->data.interpolation = fields[i].interpolation;
-         var->data.centroid = fields[i].centroid;
-         var->data.sample = fields[i].sample;
-         var->init_interface_type(per_vertex_out_type);
+         var->interpolation = fields[i].interpolation;
+         var->centroid = fields[i].centroid;
+         var->sample = fields[i].sample;
+         var->interface_type = per_vertex_out_type;
+         /* Redeclaring gl_PerVertex finds these in the IR, so they can't
+          * be lazy.
+          */
+         table->materialize(var);
       }
    }
 }
@@ -1078,7 +1233,9 @@ void
 _mesa_glsl_initialize_variables(exec_list *instructions,
 				struct _mesa_glsl_parse_state *state)
 {
-   builtin_variable_generator gen(instructions, state);
+   builtin_variable_table *table =
+      new(state) builtin_variable_table(instructions, state);
+   builtin_variable_generator gen(table, state);
 
    gen.generate_constants();
    gen.generate_uniforms();
@@ -1099,4 +1256,7 @@ _mesa_glsl_initialize_variables(exec_list *instructions,
       gen.generate_cs_special_vars();
       break;
    }
+
+   /* Variables only get created when they are looked up. */
+   state->symbols->lazy_variables = table;
 }
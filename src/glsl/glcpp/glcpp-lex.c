@@ -636,6 +636,11 @@ void glcpp_set_column (int  column_no , yyscan_t yyscanner);
 
 #define YY_NO_INPUT
 
+/* The input is read from the parser's glsl_source (see glsl_source_read),
+ * not from a FILE. */
+#define YY_INPUT(buf, result, max_size) \
+	result = glsl_source_read (yyextra->source, buf, max_size)
+
 #define YY_USER_ACTION							\
 	do {								\
 		if (parser->has_new_line_number)			\
@@ -748,6 +753,68 @@ glcpp_lex_update_state_per_token (glcpp_parser_t *parser, int token)
 	}
 }
 
+/* Returns the end of the run of whole lines at the start of text that contain
+ * no '#' and start no comment, and counts them in *lines. Inside a skipped
+ * #if block such lines can't affect anything, so they need not be lexed.
+ */
+static char *
+glcpp_lex_skip_lines (char *text, int *lines)
+{
+	char *line = text;
+
+	*lines = 0;
+	for (;;) {
+		char *p = line + strcspn (line, "#/\r\n");
+		while (*p == '/' && p[1] != '*')
+			p += 1 + strcspn (p + 1, "#/\r\n");
+		if (*p != '\r' && *p != '\n')
+			return line;
+		/* The rest of the input may not have been read yet. */
+		if (p[1] == '\0')
+			return line;
+		/* Same as {NEWLINE} below: \r\n and \n\r are a single newline. */
+		if ((p[0] == '\r' && p[1] == '\n') || (p[0] == '\n' && p[1] == '\r'))
+			p++;
+		line = p + 1;
+		(*lines)++;
+	}
+}
+
+/* Matches the remainder of an #include directive following the '#': the
+ * word include and a "name" or <name>, optionally preceded by horizontal
+ * space. Returns the end of the name, storing where it starts and its
+ * length, or NULL if text is anything else.
+ */
+static char *
+glcpp_lex_match_include (char *text, char **name, int *length)
+{
+	char *p = text + strspn (text, " \t");
+	const char *stop;
+	char close;
+
+	if (strncmp (p, "include", 7) != 0)
+		return NULL;
+	p += 7;
+	p += strspn (p, " \t");
+
+	if (*p == '"') {
+		close = '"';
+		stop = "\"\r\n";
+	} else if (*p == '<') {
+		close = '>';
+		stop = ">\r\n";
+	} else {
+		return NULL;
+	}
+
+	*name = p + 1;
+	*length = strcspn (*name, stop);
+	if ((*name)[*length] != close)
+		return NULL;
+
+	return *name + *length + 1;
+}
+
 
 /* Note: When adding any start conditions to this list, you must also
 * update the "Internal compiler error" catch-all rule near the end of
@@ -1062,6 +1129,55 @@ YY_DECL
 		parser->skipping = 0;
 	}
 
+	/* Within a skipped #if block, fast-forward over whole lines of raw
+	 * text instead of lexing them token by token, emitting just their
+	 * NEWLINE tokens (see NEWLINE_CATCHUP above). Lines containing a '#'
+	 * or starting a comment are lexed as usual, which is all that is
+	 * needed to find the directives that end the block.
+	 */
+	if (parser->skipping && YY_START == INITIAL &&
+	    parser->last_token_was_newline && ! parser->has_new_line_number)
+	{
+		char *text = yyg->yy_c_buf_p;
+		char *end;
+		int lines;
+
+		*text = yyg->yy_hold_char;
+		end = glcpp_lex_skip_lines (text, &lines);
+		if (lines) {
+			yyg->yy_c_buf_p = end;
+			yyg->yy_hold_char = *end;
+			yylineno += lines;
+			yycolumn = 0;
+			parser->commented_newlines = lines - 1;
+			if (parser->commented_newlines)
+				BEGIN NEWLINE_CATCHUP;
+			RETURN_TOKEN_NEVER_SKIP (NEWLINE);
+		}
+	}
+
+	/* An #include directive takes the rest of the line up to the file
+	 * name as a single INCLUDE token, since "quoted" and <bracketed>
+	 * names aren't made of preprocessing tokens.
+	 */
+	if (YY_START == HASH && ! parser->skipping) {
+		char *text = yyg->yy_c_buf_p;
+		char *name, *end;
+		int length;
+
+		*text = yyg->yy_hold_char;
+		end = glcpp_lex_match_include (text, &name, &length);
+		if (end) {
+			yylval->str = ralloc_strndup (yyextra, name, length);
+			yyg->yy_c_buf_p = end;
+			yyg->yy_hold_char = *end;
+			yycolumn += end - text;
+			BEGIN INITIAL;
+			yyextra->space_tokens = 0;
+			RETURN_TOKEN (INCLUDE);
+		}
+	}
+
 	/* Single-line comments */
 #line 1067 "src/glsl/glcpp/glcpp-lex.c"
 
@@ -2874,6 +2990,17 @@ void glcpp_free (void * ptr , yyscan_t yyscanner)
 void
 glcpp_lex_set_source_string(glcpp_parser_t *parser, const char *shader)
 {
-	glcpp__scan_string(shader,parser->scanner);
+	struct glsl_source *source = ralloc (parser, struct glsl_source);
+
+	glsl_source_init_string (source, shader);
+	glcpp_lex_set_source (parser, source);
+}
+
+void
+glcpp_lex_set_source(glcpp_parser_t *parser, struct glsl_source *source)
+{
+	parser->source = source;
+	glcpp__switch_to_buffer(glcpp__create_buffer(NULL,YY_BUF_SIZE,parser->scanner),
+			    parser->scanner);
 }
 
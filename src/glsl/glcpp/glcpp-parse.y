@@ -156,6 +156,16 @@ glcpp_parser_lex_from (glcpp_parser_t *parser, token_list_t *list);
 static void
 add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
 
+static macro_t *
+_glcpp_parser_find_macro (glcpp_parser_t *parser, const char *identifier);
+
+static void
+_glcpp_parser_note_macro_write (glcpp_parser_t *parser, const char *identifier);
+
+static void
+_glcpp_parser_handle_include (glcpp_parser_t *parser, YYLTYPE *loc,
+			      const char *name);
+
 %}
 
 %pure-parser
@@ -178,11 +188,11 @@ add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
 	/* We use HASH_TOKEN, DEFINE_TOKEN and VERSION_TOKEN (as opposed to
          * HASH, DEFINE, and VERSION) to avoid conflicts with other symbols,
          * (such as the <HASH> and <DEFINE> start conditions in the lexer). */
-%token DEFINED ELIF_EXPANDED HASH_TOKEN DEFINE_TOKEN FUNC_IDENTIFIER OBJ_IDENTIFIER ELIF ELSE ENDIF ERROR_TOKEN IF IFDEF IFNDEF LINE PRAGMA UNDEF VERSION_TOKEN GARBAGE IDENTIFIER IF_EXPANDED INTEGER INTEGER_STRING LINE_EXPANDED NEWLINE OTHER PLACEHOLDER SPACE PLUS_PLUS MINUS_MINUS
+%token DEFINED ELIF_EXPANDED HASH_TOKEN DEFINE_TOKEN FUNC_IDENTIFIER OBJ_IDENTIFIER ELIF ELSE ENDIF ERROR_TOKEN IF IFDEF IFNDEF INCLUDE LINE PRAGMA UNDEF VERSION_TOKEN GARBAGE IDENTIFIER IF_EXPANDED INTEGER INTEGER_STRING LINE_EXPANDED NEWLINE OTHER PLACEHOLDER SPACE PLUS_PLUS MINUS_MINUS
 %token PASTE
 %type <ival> INTEGER operator SPACE integer_constant
 %type <expression_value> expression
-%type <str> IDENTIFIER FUNC_IDENTIFIER OBJ_IDENTIFIER INTEGER_STRING OTHER ERROR_TOKEN PRAGMA
+%type <str> IDENTIFIER FUNC_IDENTIFIER OBJ_IDENTIFIER INTEGER_STRING OTHER ERROR_TOKEN PRAGMA INCLUDE
 %type <string_list> identifier_list
 %type <token> preprocessing_token
 %type <token_list> pp_tokens replacement_list text_line
@@ -294,10 +304,14 @@ control_line_success:
 			glcpp_error(& @1, parser, "Built-in (pre-defined)"
 				    " macro names can not be undefined.");
 
-		macro = hash_table_find (parser->defines, $4);
+		macro = _glcpp_parser_find_macro (parser, $4);
 		if (macro) {
+			/* Not freed, since the macro may belong to
+			 * the include cache (see
+			 * _glcpp_parser_apply_include); it goes away
+			 * with its parser otherwise. */
 			hash_table_remove (parser->defines, $4);
-			ralloc_free (macro);
+			_glcpp_parser_note_macro_write (parser, $4);
 		}
 		ralloc_free ($4);
 	}
@@ -337,14 +351,14 @@ control_line_success:
 |	HASH_TOKEN IFDEF {
 		glcpp_parser_resolve_implicit_version(parser);
 	} IDENTIFIER junk NEWLINE {
-		macro_t *macro = hash_table_find (parser->defines, $4);
+		macro_t *macro = _glcpp_parser_find_macro (parser, $4);
 		ralloc_free ($4);
 		_glcpp_parser_skip_stack_push_if (parser, & @1, macro != NULL);
 	}
 |	HASH_TOKEN IFNDEF {
 		glcpp_parser_resolve_implicit_version(parser);
 	} IDENTIFIER junk NEWLINE {
-		macro_t *macro = hash_table_find (parser->defines, $4);
+		macro_t *macro = _glcpp_parser_find_macro (parser, $4);
 		ralloc_free ($4);
 		_glcpp_parser_skip_stack_push_if (parser, & @3, macro == NULL);
 	}
@@ -425,6 +439,11 @@ control_line_success:
 |	HASH_TOKEN NEWLINE {
 		glcpp_parser_resolve_implicit_version(parser);
 	}
+|	HASH_TOKEN INCLUDE junk NEWLINE {
+		glcpp_parser_resolve_implicit_version(parser);
+		_glcpp_parser_handle_include (parser, & @1, $2);
+		ralloc_free ($2);
+	}
 |	HASH_TOKEN PRAGMA NEWLINE {
 		ralloc_asprintf_rewrite_tail (&parser->output, &parser->output_length, "#%s", $2);
 	}
@@ -1377,6 +1396,11 @@ glcpp_parser_create (const struct gl_extensions *extensions, gl_api api)
 	parser->has_new_source_number = 0;
 	parser->new_source_number = 0;
 
+	parser->line_continuations = false;
+	parser->includes = NULL;
+	parser->include_record = NULL;
+	parser->include_depth = 0;
+
 	return parser;
 }
 
@@ -1573,8 +1597,8 @@ _glcpp_parser_evaluate_defined (glcpp_parser_t *parser,
 
 	*last = node;
 
-	return hash_table_find (parser->defines,
-				argument->token->value.str) ? 1 : 0;
+	return _glcpp_parser_find_macro (parser,
+					 argument->token->value.str) ? 1 : 0;
 
 FAIL:
 	glcpp_error (&defined->token->location, parser,
@@ -1729,7 +1753,7 @@ _glcpp_parser_expand_function (glcpp_parser_t *parser,
 
 	identifier = node->token->value.str;
 
-	macro = hash_table_find (parser->defines, identifier);
+	macro = _glcpp_parser_find_macro (parser, identifier);
 
 	assert (macro->is_function);
 
@@ -1859,7 +1883,7 @@ _glcpp_parser_expand_node (glcpp_parser_t *parser,
 		return _token_list_create_with_one_integer (parser, node->token->location.source);
 
 	/* Look up this identifier in the hash table. */
-	macro = hash_table_find (parser->defines, identifier);
+	macro = _glcpp_parser_find_macro (parser, identifier);
 
 	/* Not a macro, so no expansion needed. */
 	if (macro == NULL)
@@ -2135,7 +2159,7 @@ _define_object_macro (glcpp_parser_t *parser,
 	macro->replacements = replacements;
 	ralloc_steal (macro, replacements);
 
-	previous = hash_table_find (parser->defines, identifier);
+	previous = _glcpp_parser_find_macro (parser, identifier);
 	if (previous) {
 		if (_macro_equal (macro, previous)) {
 			ralloc_free (macro);
@@ -2146,6 +2170,7 @@ _define_object_macro (glcpp_parser_t *parser,
 	}
 
 	hash_table_insert (parser->defines, macro, identifier);
+	_glcpp_parser_note_macro_write (parser, identifier);
 }
 
 void
@@ -2174,7 +2199,7 @@ _define_function_macro (glcpp_parser_t *parser,
 	macro->parameters = parameters;
 	macro->identifier = ralloc_strdup (macro, identifier);
 	macro->replacements = replacements;
-	previous = hash_table_find (parser->defines, identifier);
+	previous = _glcpp_parser_find_macro (parser, identifier);
 	if (previous) {
 		if (_macro_equal (macro, previous)) {
 			ralloc_free (macro);
@@ -2185,6 +2210,7 @@ _define_function_macro (glcpp_parser_t *parser,
 	}
 
 	hash_table_insert (parser->defines, macro, identifier);
+	_glcpp_parser_note_macro_write (parser, identifier);
 }
 
 static int
@@ -2239,8 +2265,8 @@ glcpp_parser_lex (YYSTYPE *yylval, YYLTYPE *yylloc, glcpp_parser_t *parser)
 		else if (ret == IDENTIFIER)
 		{
 			macro_t *macro;
-			macro = hash_table_find (parser->defines,
-						 yylval->str);
+			macro = _glcpp_parser_find_macro (parser,
+							  yylval->str);
 			if (macro && macro->is_function) {
 				parser->newline_as_space = 1;
 				parser->paren_count = 0;
@@ -2516,3 +2542,415 @@ glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser)
 	_glcpp_parser_handle_version_declaration(parser, language_version,
 						 NULL, false);
 }
+
+/* #include
+ *
+ * An included file is preprocessed by a parser of its own which shares the
+ * includer's macro table. Its output is spliced into the includer's between
+ * #line directives that give it a source string number of its own.
+ *
+ * Meanwhile we record the value of every macro the file looks up before it
+ * defines or undefines it, and afterwards the value of every macro it did
+ * define or undefine. When the same text gets included again with the same
+ * values for the macros it read, whether in this or in a later
+ * glcpp_preprocess call, the recorded output and macro definitions are used
+ * instead of preprocessing it again.
+ */
+
+/* Limits on how deeply includes can nest (which also catches a file that
+ * includes itself), and on how many differently preprocessed versions of
+ * any one file are kept. */
+#define MAX_INCLUDE_DEPTH 32
+#define MAX_INCLUDE_ENTRIES 16
+
+glcpp_include_cache_t *
+glcpp_include_cache_create (void *ralloc_ctx, glcpp_include_resolver resolver,
+			    void *data)
+{
+	glcpp_include_cache_t *cache;
+
+	cache = ralloc (ralloc_ctx, glcpp_include_cache_t);
+	cache->resolver = resolver;
+	cache->data = data;
+	cache->files = NULL;
+	cache->next_source = 1;
+
+	return cache;
+}
+
+/* FNV-1a */
+static uint32_t
+_include_text_hash (const char *text, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Copy a macro, including its strings, so that it can outlive the parser
+ * that defined it. */
+static macro_t *
+_macro_copy (void *ctx, macro_t *macro)
+{
+	macro_t *copy;
+
+	copy = ralloc (ctx, macro_t);
+	copy->is_function = macro->is_function;
+	copy->identifier = ralloc_strdup (copy, macro->identifier);
+	copy->parameters = NULL;
+	copy->replacements = NULL;
+
+	if (macro->parameters) {
+		string_node_t *node;
+
+		copy->parameters = _string_list_create (copy);
+		for (node = macro->parameters->head; node; node = node->next)
+			_string_list_append_item (copy->parameters, node->str);
+	}
+
+	if (macro->replacements) {
+		token_node_t *node;
+
+		copy->replacements = _token_list_create (copy);
+		for (node = macro->replacements->head; node; node = node->next) {
+			token_t *token = ralloc (copy->replacements, token_t);
+			*token = *node->token;
+			if (token->type == IDENTIFIER ||
+			    token->type == INTEGER_STRING ||
+			    token->type == OTHER)
+			{
+				token->value.str = ralloc_strdup (token,
+								  token->value.str);
+			}
+			_token_list_append (copy->replacements, token);
+		}
+	}
+
+	return copy;
+}
+
+static void
+_include_record_read (glcpp_include_record_t *record, const char *identifier,
+		      macro_t *macro)
+{
+	glcpp_include_macro_t *read;
+
+	if (hash_table_find (record->written, identifier) ||
+	    hash_table_find (record->read, identifier))
+		return;
+
+	read = ralloc (record->entry, glcpp_include_macro_t);
+	read->identifier = ralloc_strdup (read, identifier);
+	read->macro = macro ? _macro_copy (read, macro) : NULL;
+	read->next = record->entry->macros_read;
+	record->entry->macros_read = read;
+
+	hash_table_insert (record->read, read, read->identifier);
+}
+
+static void
+_include_record_write (glcpp_include_record_t *record, const char *identifier)
+{
+	glcpp_include_macro_t *written;
+
+	if (hash_table_find (record->written, identifier))
+		return;
+
+	/* The value is filled in once the whole file is done. */
+	written = ralloc (record->entry, glcpp_include_macro_t);
+	written->identifier = ralloc_strdup (written, identifier);
+	written->macro = NULL;
+	written->next = record->entry->macros_written;
+	record->entry->macros_written = written;
+
+	hash_table_insert (record->written, written, written->identifier);
+}
+
+/* Account for a file included by the one being recorded. */
+static void
+_include_record_nested (glcpp_include_record_t *record,
+			glcpp_include_entry_t *entry)
+{
+	glcpp_include_macro_t *macro;
+	glcpp_include_nested_t *nested;
+
+	for (macro = entry->macros_read; macro; macro = macro->next)
+		_include_record_read (record, macro->identifier, macro->macro);
+
+	for (macro = entry->macros_written; macro; macro = macro->next)
+		_include_record_write (record, macro->identifier);
+
+	nested = ralloc (record->entry, glcpp_include_nested_t);
+	nested->entry = entry;
+	nested->next = record->entry->nested;
+	record->entry->nested = nested;
+}
+
+static macro_t *
+_glcpp_parser_find_macro (glcpp_parser_t *parser, const char *identifier)
+{
+	macro_t *macro = hash_table_find (parser->defines, identifier);
+
+	if (parser->include_record)
+		_include_record_read (parser->include_record, identifier, macro);
+
+	return macro;
+}
+
+static void
+_glcpp_parser_note_macro_write (glcpp_parser_t *parser, const char *identifier)
+{
+	if (parser->include_record)
+		_include_record_write (parser->include_record, identifier);
+}
+
+static glcpp_include_file_t *
+_include_cache_file (glcpp_include_cache_t *cache, const char *name)
+{
+	glcpp_include_file_t *file;
+
+	for (file = cache->files; file; file = file->next) {
+		if (strcmp (file->name, name) == 0)
+			return file;
+	}
+
+	file = ralloc (cache, glcpp_include_file_t);
+	file->name = ralloc_strdup (file, name);
+	file->source = cache->next_source++;
+	file->entry_count = 0;
+	file->entries = NULL;
+	file->next = cache->files;
+	cache->files = file;
+
+	return file;
+}
+
+static bool
+_include_entry_has_text (glcpp_include_entry_t *entry, const char *text,
+			 size_t length, uint32_t hash)
+{
+	return entry->hash == hash && entry->length == length &&
+	       memcmp (entry->text, text, length) == 0;
+}
+
+/* Whether the recorded result of an include still holds: the macros it read
+ * have the same values as then, and the files it included are unchanged. */
+static bool
+_include_entry_is_valid (glcpp_parser_t *parser, glcpp_include_entry_t *entry)
+{
+	glcpp_include_cache_t *cache = parser->includes;
+	glcpp_include_macro_t *read;
+	glcpp_include_nested_t *nested;
+
+	for (read = entry->macros_read; read; read = read->next) {
+		macro_t *macro = hash_table_find (parser->defines,
+						  read->identifier);
+
+		if (macro == NULL || read->macro == NULL) {
+			if (macro != read->macro)
+				return false;
+		} else if (! _macro_equal (macro, read->macro)) {
+			return false;
+		}
+	}
+
+	for (nested = entry->nested; nested; nested = nested->next) {
+		const char *text;
+		size_t length;
+
+		text = cache->resolver (nested->entry->file->name, cache->data);
+		if (text == NULL)
+			return false;
+
+		length = strlen (text);
+		if (! _include_entry_has_text (nested->entry, text, length,
+					       _include_text_hash (text, length)))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+_glcpp_parser_print_include (glcpp_parser_t *parser, YYLTYPE *loc,
+			     glcpp_include_file_t *file, const char *output)
+{
+	ralloc_asprintf_rewrite_tail (&parser->output, &parser->output_length,
+				      "#line 0 %d\n%s#line %d %u",
+				      file->source, output,
+				      loc->first_line, loc->source);
+}
+
+/* Redo what a recorded include did to the macro table. Macros are never
+ * modified once defined, so the cached ones are used as they are. */
+static void
+_glcpp_parser_apply_include (glcpp_parser_t *parser,
+			     glcpp_include_entry_t *entry)
+{
+	glcpp_include_macro_t *written;
+
+	for (written = entry->macros_written; written; written = written->next) {
+		if (hash_table_find (parser->defines, written->identifier))
+			hash_table_remove (parser->defines, written->identifier);
+
+		if (written->macro) {
+			hash_table_insert (parser->defines, written->macro,
+					   written->macro->identifier);
+		}
+	}
+}
+
+/* Preprocess an included file, and print its output. Returns the recorded
+ * result, or NULL if it can't be reused. */
+static glcpp_include_entry_t *
+_glcpp_parser_preprocess_include (glcpp_parser_t *parser, YYLTYPE *loc,
+				  glcpp_include_file_t *file,
+				  const char *text, size_t length,
+				  uint32_t hash)
+{
+	glcpp_parser_t *child;
+	glcpp_include_record_t record;
+	glcpp_include_entry_t *entry = NULL;
+
+	/* Macros defined by the included file get allocated off the child
+	 * parser, so keep it around as long as the includer. */
+	child = glcpp_parser_create (parser->extensions, parser->api);
+	ralloc_steal (parser, child);
+	hash_table_dtor (child->defines);
+	child->defines = parser->defines;
+	child->version_resolved = true;
+	child->is_gles = parser->is_gles;
+	child->line_continuations = parser->line_continuations;
+	child->includes = parser->includes;
+	child->include_depth = parser->include_depth + 1;
+	child->has_new_source_number = 1;
+	child->new_source_number = file->source;
+
+	if (file->entry_count < MAX_INCLUDE_ENTRIES) {
+		entry = rzalloc (file, glcpp_include_entry_t);
+		entry->file = file;
+		entry->text = ralloc_strdup (entry, text);
+		entry->length = length;
+		entry->hash = hash;
+
+		record.entry = entry;
+		record.read = hash_table_ctor (256, hash_table_string_hash,
+					       hash_table_string_compare);
+		record.written = hash_table_ctor (256, hash_table_string_hash,
+						  hash_table_string_compare);
+		record.cacheable = true;
+		child->include_record = &record;
+	}
+
+	if (child->line_continuations)
+		text = remove_line_continuations (child, text);
+
+	glcpp_lex_set_source_string (child, text);
+	glcpp_parser_parse (child);
+
+	if (child->skip_stack)
+		glcpp_error (&child->skip_stack->loc, child, "Unterminated #if\n");
+
+	_glcpp_parser_print_include (parser, loc, file, child->output);
+
+	ralloc_asprintf_rewrite_tail (&parser->info_log,
+				      &parser->info_log_length,
+				      "%s", child->info_log);
+	if (child->error)
+		parser->error = 1;
+
+	if (entry) {
+		/* Diagnostics would be lost when reusing the result, so only
+		 * keep clean ones. */
+		if (record.cacheable && child->info_log_length == 0) {
+			glcpp_include_macro_t *written;
+
+			for (written = entry->macros_written; written;
+			     written = written->next)
+			{
+				macro_t *macro = hash_table_find (parser->defines,
+								  written->identifier);
+				if (macro)
+					written->macro = _macro_copy (written, macro);
+			}
+
+			entry->output = ralloc_strdup (entry, child->output);
+			entry->next = file->entries;
+			file->entries = entry;
+			file->entry_count++;
+		} else {
+			ralloc_free (entry);
+			entry = NULL;
+		}
+
+		hash_table_dtor (record.read);
+		hash_table_dtor (record.written);
+	}
+
+	glcpp_lex_destroy (child->scanner);
+	ralloc_free (child->output);
+	ralloc_free (child->info_log);
+	child->include_record = NULL;
+
+	return entry;
+}
+
+static void
+_glcpp_parser_handle_include (glcpp_parser_t *parser, YYLTYPE *loc,
+			      const char *name)
+{
+	glcpp_include_cache_t *cache = parser->includes;
+	glcpp_include_file_t *file;
+	glcpp_include_entry_t *entry;
+	const char *text;
+	size_t length;
+	uint32_t hash;
+
+	if (cache == NULL || cache->resolver == NULL) {
+		glcpp_error (loc, parser, "#include is not supported");
+		return;
+	}
+
+	if (parser->include_depth >= MAX_INCLUDE_DEPTH) {
+		glcpp_error (loc, parser, "#include nested too deeply");
+		return;
+	}
+
+	text = cache->resolver (name, cache->data);
+	if (text == NULL) {
+		glcpp_error (loc, parser, "#include file \"%s\" not found",
+			     name);
+		return;
+	}
+
+	length = strlen (text);
+	hash = _include_text_hash (text, length);
+	file = _include_cache_file (cache, name);
+
+	for (entry = file->entries; entry; entry = entry->next) {
+		if (_include_entry_has_text (entry, text, length, hash) &&
+		    _include_entry_is_valid (parser, entry))
+			break;
+	}
+
+	if (entry) {
+		_glcpp_parser_apply_include (parser, entry);
+		_glcpp_parser_print_include (parser, loc, file, entry->output);
+	} else {
+		entry = _glcpp_parser_preprocess_include (parser, loc, file,
+							  text, length, hash);
+	}
+
+	if (parser->include_record) {
+		if (entry)
+			_include_record_nested (parser->include_record, entry);
+		else
+			parser->include_record->cacheable = false;
+	}
+}
@@ -33,6 +33,8 @@
 
 #include "program/hash_table.h"
 
+#include "../glsl_source.h"
+
 #define yyscan_t void*
 
 /* Some data types used for parser values. */
@@ -173,8 +175,71 @@ typedef struct active_list {
 	struct active_list *next;
 } active_list_t;
 
+/* Returns the text of the file named by an #include directive, or NULL if
+ * there is no such file. The text only needs to stay valid until
+ * glcpp_preprocess returns. */
+typedef const char *(*glcpp_include_resolver) (const char *name, void *data);
+
+/* The value a macro had when it was looked up by, or was left with after,
+ * an included file. */
+typedef struct glcpp_include_macro {
+	const char *identifier;
+	macro_t *macro; /* NULL if undefined */
+	struct glcpp_include_macro *next;
+} glcpp_include_macro_t;
+
+typedef struct glcpp_include_file glcpp_include_file_t;
+
+/* The result of preprocessing an included file: its output, and the
+ * macros it defined or undefined. It can stand in for preprocessing the
+ * same text again as long as every macro it read from its includer still
+ * has the same value, and the files it included are unchanged. */
+typedef struct glcpp_include_entry {
+	glcpp_include_file_t *file;
+	char *text;
+	size_t length;
+	uint32_t hash;
+	glcpp_include_macro_t *macros_read;
+	glcpp_include_macro_t *macros_written;
+	struct glcpp_include_nested *nested;
+	char *output;
+	struct glcpp_include_entry *next;
+} glcpp_include_entry_t;
+
+typedef struct glcpp_include_nested {
+	glcpp_include_entry_t *entry;
+	struct glcpp_include_nested *next;
+} glcpp_include_nested_t;
+
+struct glcpp_include_file {
+	char *name;
+	int source; /* source string number of the file in the output */
+	int entry_count;
+	glcpp_include_entry_t *entries;
+	glcpp_include_file_t *next;
+};
+
+/* Resolver for #include, and what was preprocessed so far; it lives as
+ * long as the ralloc context it was created off, across glcpp_preprocess
+ * calls. */
+typedef struct glcpp_include_cache {
+	glcpp_include_resolver resolver;
+	void *data;
+	glcpp_include_file_t *files;
+	int next_source;
+} glcpp_include_cache_t;
+
+/* Bookkeeping while preprocessing an included file that might get cached. */
+typedef struct glcpp_include_record {
+	glcpp_include_entry_t *entry;
+	struct hash_table *read;
+	struct hash_table *written;
+	bool cacheable;
+} glcpp_include_record_t;
+
 struct glcpp_parser {
 	yyscan_t scanner;
+	struct glsl_source *source;
 	struct hash_table *defines;
 	active_list_t *active;
 	int lexing_directive;
@@ -203,6 +268,10 @@ struct glcpp_parser {
 	bool has_new_source_number;
 	int new_source_number;
 	bool is_gles;
+	bool line_continuations;
+	glcpp_include_cache_t *includes;
+	glcpp_include_record_t *include_record;
+	int include_depth;
 };
 
 struct gl_extensions;
@@ -219,9 +288,24 @@ glcpp_parser_destroy (glcpp_parser_t *parser);
 void
 glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser);
 
+glcpp_include_cache_t *
+glcpp_include_cache_create (void *ralloc_ctx, glcpp_include_resolver resolver,
+			    void *data);
+
+int
+glcpp_preprocess_source(void *ralloc_ctx, struct glsl_source *source,
+			const char **output, char **info_log,
+			const struct gl_extensions *extensions,
+			struct gl_context *gl_ctx,
+			glcpp_include_cache_t *includes);
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
-	   const struct gl_extensions *extensions, struct gl_context *g_ctx);
+	   const struct gl_extensions *extensions, struct gl_context *g_ctx,
+	   glcpp_include_cache_t *includes);
+
+char *
+remove_line_continuations(glcpp_parser_t *ctx, const char *shader);
 
 /* Functions for writing to the info log */
 
@@ -239,6 +323,9 @@ glcpp_lex_init_extra (glcpp_parser_t *parser, yyscan_t* scanner);
 void
 glcpp_lex_set_source_string(glcpp_parser_t *parser, const char *shader);
 
+void
+glcpp_lex_set_source(glcpp_parser_t *parser, struct glsl_source *source);
+
 int
 glcpp_lex (YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 
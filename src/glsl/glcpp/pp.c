@@ -109,7 +109,7 @@ skip_newline (const char *str)
 /* Remove any line continuation characters in the shader, (whether in
  * preprocessing directives or in GLSL code).
  */
-static char *
+char *
 remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 {
 	char *clean = ralloc_strdup(ctx, "");
@@ -212,17 +212,55 @@ remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 	return clean;
 }
 
+/* Returns false if preprocessing would leave the shader alone: there are no
+ * directives, line continuations or comments, and no predefined macros
+ * (__LINE__, __FILE__, __VERSION__, GL_ES and the GL_ extension macros) are
+ * used. Each check is a single memchr pass over each string of the source,
+ * which the C library does a word or vector at a time.
+ */
+static bool
+needs_preprocessing(const struct glsl_source *source)
+{
+	return glsl_source_contains(source, "#") ||
+	       glsl_source_contains(source, "\\") ||
+	       glsl_source_contains(source, "//") ||
+	       glsl_source_contains(source, "/*") ||
+	       glsl_source_contains(source, "__") ||
+	       glsl_source_contains(source, "GL_");
+}
+
+/* Preprocesses source, setting *output to the result, or to NULL if source
+ * needs no preprocessing and can be compiled as it is.
+ */
 int
-glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
-	   const struct gl_extensions *extensions, struct gl_context *gl_ctx)
+glcpp_preprocess_source(void *ralloc_ctx, struct glsl_source *source,
+			const char **output, char **info_log,
+			const struct gl_extensions *extensions,
+			struct gl_context *gl_ctx,
+			glcpp_include_cache_t *includes)
 {
 	int errors;
-	glcpp_parser_t *parser = glcpp_parser_create (extensions, gl_ctx->API);
+	glcpp_parser_t *parser;
+
+	*output = NULL;
+
+	if (!needs_preprocessing(source))
+		return 0;
 
-	if (! gl_ctx->Const.DisableGLSLLineContinuations)
-		*shader = remove_line_continuations(parser, *shader);
+	parser = glcpp_parser_create (extensions, gl_ctx->API);
+	parser->line_continuations = ! gl_ctx->Const.DisableGLSLLineContinuations;
+	parser->includes = includes;
 
-	glcpp_lex_set_source_string (parser, *shader);
+	/* The lexer reads the source in place, unless line continuations have
+	 * to be removed first (which is rare).
+	 */
+	if (parser->line_continuations && glsl_source_contains(source, "\\")) {
+		char *shader = glsl_source_concat(source, parser);
+		glcpp_lex_set_source_string (parser,
+					     remove_line_continuations(parser, shader));
+	} else {
+		glcpp_lex_set_source (parser, source);
+	}
 
 	glcpp_parser_parse (parser);
 
@@ -234,9 +272,27 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 	ralloc_strcat(info_log, parser->info_log);
 
 	ralloc_steal(ralloc_ctx, parser->output);
-	*shader = parser->output;
+	*output = parser->output;
 
 	errors = parser->error;
 	glcpp_parser_destroy (parser);
 	return errors;
 }
+
+int
+glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
+	   const struct gl_extensions *extensions, struct gl_context *gl_ctx,
+	   glcpp_include_cache_t *includes)
+{
+	struct glsl_source source;
+	const char *output;
+	int errors;
+
+	glsl_source_init_string(&source, *shader);
+	errors = glcpp_preprocess_source(ralloc_ctx, &source, &output, info_log,
+					 extensions, gl_ctx, includes);
+	if (output)
+		*shader = output;
+
+	return errors;
+}
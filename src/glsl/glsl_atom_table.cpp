@@ -0,0 +1,53 @@
+#include <string.h>
+#include "glsl_atom_table.h"
+#include "util/hash_table.h"
+
+
+glsl_atom_table::glsl_atom_table()
+{
+   this->atoms = _mesa_hash_table_create(NULL, _mesa_key_string_equal);
+   this->pointers = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+}
+
+
+glsl_atom_table::~glsl_atom_table()
+{
+   _mesa_hash_table_destroy(this->atoms, NULL);
+   _mesa_hash_table_destroy(this->pointers, NULL);
+}
+
+
+const char *
+glsl_atom_table::intern(const char *str)
+{
+   const char *atom = find(str);
+   if (atom != NULL)
+      return atom;
+
+   char *copy = ralloc_strdup(this, str);
+   _mesa_hash_table_insert(this->atoms, _mesa_hash_string(copy), copy, copy);
+   _mesa_hash_table_insert(this->pointers, _mesa_hash_pointer(copy), copy,
+                           copy);
+   return copy;
+}
+
+
+const char *
+glsl_atom_table::find(const char *str) const
+{
+   /* Identifiers from the lexer are atoms already; only hash the pointer. */
+   if (_mesa_hash_table_search(this->pointers, _mesa_hash_pointer(str),
+                               str) != NULL)
+      return str;
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(this->atoms, _mesa_hash_string(str), str);
+   return entry != NULL ? (const char *) entry->data : NULL;
+}
+
+
+unsigned
+glsl_atom_table::count() const
+{
+   return this->atoms->entries;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef GLSL_ATOM_TABLE_H
+#define GLSL_ATOM_TABLE_H
+
+#include <assert.h>
+#include "util/ralloc.h"
+
+struct hash_table;
+
+/**
+ * Table of interned identifier strings ("atoms")
+ *
+ * Interning a string returns the single copy of it owned by the table, so
+ * atoms can be hashed and compared by pointer. Atoms stay valid for as long
+ * as the table does; glslopt_ctx shares one table between its compiles and
+ * starts it over when it gets large.
+ */
+class glsl_atom_table {
+public:
+   DECLARE_RALLOC_CXX_OPERATORS(glsl_atom_table)
+
+   glsl_atom_table();
+   ~glsl_atom_table();
+
+   /** Get the atom for \c str, adding it to the table if needed. */
+   const char *intern(const char *str);
+
+   /**
+    * Get the atom for \c str, or NULL if it was never interned.
+    *
+    * If \c str is an atom itself (e.g. an identifier from the lexer), this
+    * only hashes the pointer.
+    */
+   const char *find(const char *str) const;
+
+   /** Number of atoms in the table. */
+   unsigned count() const;
+
+private:
+   /** Atoms keyed by their string */
+   struct hash_table *atoms;
+
+   /** Atoms keyed by their address */
+   struct hash_table *pointers;
+};
+
+#endif /* GLSL_ATOM_TABLE_H */
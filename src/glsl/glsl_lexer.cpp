@@ -1113,6 +1113,7 @@ static yyconst flex_int16_t yy_chk[1453] =
 #include "strtod.h"
 #include "ast.h"
 #include "glsl_parser_extras.h"
+#include "glsl_source.h"
 #include "glsl_parser.h"
 
 #if defined(_MSC_VER)
@@ -1138,6 +1139,12 @@ static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 
 #define YY_USER_INIT yylineno = 0; yycolumn = 0;
 
+/* The input is read from the parse state's glsl_source (see
+ * glsl_source_read), not from a FILE.
+ */
+#define YY_INPUT(buf, result, max_size) \
+   result = glsl_source_read(yyextra->source, buf, max_size)
+
 /* A macro for handling reserved words and keywords across language versions.
  *
  * Certain words start out as identifiers, become reserved words in
@@ -1174,9 +1181,8 @@ static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 			  "illegal use of reserved word `%s'", yytext);	\
 	 return ERROR_TOK;						\
       } else {								\
-	 void *mem_ctx = yyextra;					\
-	 yylval->identifier = ralloc_strdup(mem_ctx, yytext);		\
-	 return classify_identifier(yyextra, yytext);			\
+	 yylval->identifier = yyextra->atoms->intern(yytext);		\
+	 return classify_identifier(yyextra, yylval->identifier);	\
       }									\
    } while (0)
 
@@ -1706,8 +1712,7 @@ case 18:
 YY_RULE_SETUP
 #line 241 "src/glsl/glsl_lexer.ll"
 {
-				   void *mem_ctx = yyextra;
-				   yylval->identifier = ralloc_strdup(mem_ctx, yytext);
+				   yylval->identifier = yyextra->atoms->intern(yytext);
 				   return IDENTIFIER;
 				}
 	YY_BREAK
@@ -2407,9 +2412,8 @@ YY_RULE_SETUP
                       || yyextra->ARB_compute_shader_enable) {
 		      return LAYOUT_TOK;
 		   } else {
-		      void *mem_ctx = yyextra;
-		      yylval->identifier = ralloc_strdup(mem_ctx, yytext);
-		      return classify_identifier(yyextra, yytext);
+		      yylval->identifier = yyextra->atoms->intern(yytext);
+		      return classify_identifier(yyextra, yylval->identifier);
 		   }
 		}
 	YY_BREAK
@@ -2915,9 +2919,8 @@ YY_RULE_SETUP
 #line 563 "src/glsl/glsl_lexer.ll"
 {
 			    struct _mesa_glsl_parse_state *state = yyextra;
-			    void *ctx = state;	
-			    yylval->identifier = ralloc_strdup(ctx, yytext);
-			    return classify_identifier(state, yytext);
+			    yylval->identifier = state->atoms->intern(yytext);
+			    return classify_identifier(state, yylval->identifier);
 			}
 	YY_BREAK
 case 247:
@@ -4090,8 +4093,20 @@ classify_identifier(struct _mesa_glsl_parse_state *state, const char *name)
 void
 _mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state, const char *string)
 {
+   struct glsl_source *source = ralloc(state, struct glsl_source);
+
+   glsl_source_init_string(source, string);
+   _mesa_glsl_lexer_ctor(state, source);
+}
+
+void
+_mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state,
+                      struct glsl_source *source)
+{
+   state->source = source;
    _mesa_glsl_lexer_lex_init_extra(state,& state->scanner);
-   _mesa_glsl_lexer__scan_string(string,state->scanner);
+   _mesa_glsl_lexer__switch_to_buffer(_mesa_glsl_lexer__create_buffer(NULL,YY_BUF_SIZE,state->scanner),
+                       state->scanner);
 }
 
 void
@@ -26,6 +26,7 @@
 #include "strtod.h"
 #include "ast.h"
 #include "glsl_parser_extras.h"
+#include "glsl_source.h"
 #include "glsl_parser.h"
 
 #if defined(_MSC_VER)
@@ -51,6 +52,12 @@ static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 
 #define YY_USER_INIT yylineno = 0; yycolumn = 0;
 
+/* The input is read from the parse state's glsl_source (see
+ * glsl_source_read), not from a FILE.
+ */
+#define YY_INPUT(buf, result, max_size) \
+   result = glsl_source_read(yyextra->source, buf, max_size)
+
 /* A macro for handling reserved words and keywords across language versions.
  *
  * Certain words start out as identifiers, become reserved words in
@@ -87,9 +94,8 @@ static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 			  "illegal use of reserved word `%s'", yytext);	\
 	 return ERROR_TOK;						\
       } else {								\
-	 void *mem_ctx = yyextra;					\
-	 yylval->identifier = ralloc_strdup(mem_ctx, yytext);		\
-	 return classify_identifier(yyextra, yytext);			\
+	 yylval->identifier = yyextra->atoms->intern(yytext);		\
+	 return classify_identifier(yyextra, yylval->identifier);	\
       }									\
    } while (0)
 
@@ -239,8 +245,7 @@ HASH		^{SPC}#{SPC}
 <PP>[ \t\r]*			{ }
 <PP>:				return COLON;
 <PP>[_a-zA-Z][_a-zA-Z0-9]*	{
-				   void *mem_ctx = yyextra;
-				   yylval->identifier = ralloc_strdup(mem_ctx, yytext);
+				   yylval->identifier = yyextra->atoms->intern(yytext);
 				   return IDENTIFIER;
 				}
 <PP>[1-9][0-9]*			{
@@ -417,9 +422,8 @@ layout		{
                       || yyextra->ARB_compute_shader_enable) {
 		      return LAYOUT_TOK;
 		   } else {
-		      void *mem_ctx = yyextra;
-		      yylval->identifier = ralloc_strdup(mem_ctx, yytext);
-		      return classify_identifier(yyextra, yytext);
+		      yylval->identifier = yyextra->atoms->intern(yytext);
+		      return classify_identifier(yyextra, yylval->identifier);
 		   }
 		}
 
@@ -562,9 +566,8 @@ subroutine	KEYWORD(0, 300, 0, 0, SUBROUTINE);
 
 [_a-zA-Z][_a-zA-Z0-9]*	{
 			    struct _mesa_glsl_parse_state *state = yyextra;
-			    void *ctx = state;	
-			    yylval->identifier = ralloc_strdup(ctx, yytext);
-			    return classify_identifier(state, yytext);
+			    yylval->identifier = state->atoms->intern(yytext);
+			    return classify_identifier(state, yylval->identifier);
 			}
 
 .			{ return yytext[0]; }
@@ -585,8 +588,20 @@ classify_identifier(struct _mesa_glsl_parse_state *state, const char *name)
 void
 _mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state, const char *string)
 {
+   struct glsl_source *source = ralloc(state, struct glsl_source);
+
+   glsl_source_init_string(source, string);
+   _mesa_glsl_lexer_ctor(state, source);
+}
+
+void
+_mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state,
+                      struct glsl_source *source)
+{
+   state->source = source;
    yylex_init_extra(state, & state->scanner);
-   yy_scan_string(string, state->scanner);
+   yy_switch_to_buffer(yy_create_buffer(NULL, YY_BUF_SIZE, state->scanner),
+                       state->scanner);
 }
 
 void
@@ -2,15 +2,23 @@
 #include "ast.h"
 #include "glsl_parser_extras.h"
 #include "glsl_parser.h"
+#include "glsl_source.h"
+#include "ir_flatten_branches.h"
+#include "ir_hoist_varyings.h"
 #include "ir_optimization.h"
+#include "ir_preshaders.h"
 #include "ir_print_metal_visitor.h"
 #include "ir_print_glsl_visitor.h"
 #include "ir_print_visitor.h"
+#include "ir_rvalue_visitor.h"
+#include "ir_serialize.h"
 #include "ir_stats.h"
+#include "ir_uniform_values.h"
 #include "loop_analysis.h"
 #include "program.h"
 #include "linker.h"
 #include "standalone_scaffolding.h"
+#include "util/hash_table.h"
 
 
 extern "C" struct gl_shader *
@@ -86,6 +94,14 @@ struct glslopt_ctx {
 	glslopt_ctx (glslopt_target target) {
 		this->target = target;
 		mem_ctx = ralloc_context (NULL);
+		atoms = new (mem_ctx) glsl_atom_table();
+		includes = NULL;
+		outputWriter = NULL;
+		outputWriterData = NULL;
+		uniformValues = NULL;
+		uniformValueCount = 0;
+		maxFlattenCost = 0.0f;
+		get_default_cost_model (kGlslCostFamilyVec4, &costModel);
 		initialize_mesa_context (&mesa_ctx, target);
 	}
 	~glslopt_ctx() {
@@ -93,6 +109,19 @@ struct glslopt_ctx {
 	}
 	struct gl_context mesa_ctx;
 	void* mem_ctx;
+	// Identifiers of the shaders compiled with this context, see trim_atoms
+	glsl_atom_table* atoms;
+	// #include resolver and the included files preprocessed so far
+	struct glcpp_include_cache* includes;
+	// Where optimized output goes, if not kept in the shaders
+	glslopt_output_writer outputWriter;
+	void* outputWriterData;
+	glslopt_cost_model costModel;
+	// Branches costing up to this are flattened into selects
+	float maxFlattenCost;
+	// Uniforms baked into shaders; names are allocated off the array
+	glslopt_uniform_value* uniformValues;
+	int uniformValueCount;
 	glslopt_target target;
 };
 
@@ -101,6 +130,19 @@ glslopt_ctx* glslopt_initialize (glslopt_target target)
 	return new glslopt_ctx(target);
 }
 
+// Nothing uses the atoms once a compile is done, so the table can start over
+// between compiles; do that once it is large, so that a long lived context
+// doesn't keep every identifier it ever saw.
+static const unsigned kMaxAtoms = 16 * 1024;
+
+static void trim_atoms (glslopt_ctx* ctx)
+{
+	if (ctx->atoms->count() <= kMaxAtoms)
+		return;
+	ralloc_free (ctx->atoms);
+	ctx->atoms = new (ctx->mem_ctx) glsl_atom_table();
+}
+
 void glslopt_cleanup (glslopt_ctx* ctx)
 {
 	delete ctx;
@@ -113,6 +155,69 @@ void glslopt_set_max_unroll_iterations (glslopt_ctx* ctx, unsigned iterations)
 		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].MaxUnrollIterations = iterations;
 }
 
+void glslopt_set_max_unroll_factor (glslopt_ctx* ctx, unsigned factor)
+{
+	for (int i = 0; i < MESA_SHADER_STAGES; ++i)
+		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].MaxUnrollFactor = factor;
+}
+
+void glslopt_set_inline_thresholds (glslopt_ctx* ctx, unsigned maxSize, unsigned maxCalls)
+{
+	for (int i = 0; i < MESA_SHADER_STAGES; ++i)
+	{
+		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].MaxInlineInstructions = maxSize;
+		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].MaxInlineCalls = maxCalls;
+	}
+}
+
+void glslopt_set_strength_reduction (glslopt_ctx* ctx, bool enable)
+{
+	for (int i = 0; i < MESA_SHADER_STAGES; ++i)
+	{
+		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].OptimizeStrength = enable;
+		ctx->mesa_ctx.Const.ShaderCompilerOptions[i].EmitFma = enable;
+	}
+}
+
+void glslopt_set_max_flatten_cost (glslopt_ctx* ctx, float maxCost)
+{
+	ctx->maxFlattenCost = maxCost;
+}
+
+void glslopt_get_default_cost_model (glslopt_cost_family family, glslopt_cost_model* outModel)
+{
+	get_default_cost_model (family, outModel);
+}
+
+void glslopt_set_cost_model (glslopt_ctx* ctx, const glslopt_cost_model* model)
+{
+	ctx->costModel = *model;
+}
+
+void glslopt_set_uniform_values (glslopt_ctx* ctx, const glslopt_uniform_value* values, int count)
+{
+	ralloc_free (ctx->uniformValues);
+	ctx->uniformValues = count > 0 ? ralloc_array (ctx->mem_ctx, glslopt_uniform_value, count) : NULL;
+	ctx->uniformValueCount = MAX2 (count, 0);
+	for (int i = 0; i < ctx->uniformValueCount; ++i)
+	{
+		ctx->uniformValues[i] = values[i];
+		ctx->uniformValues[i].name = ralloc_strdup (ctx->uniformValues, values[i].name);
+	}
+}
+
+void glslopt_set_include_resolver (glslopt_ctx* ctx, glslopt_include_resolver resolver, void* userData)
+{
+	ralloc_free (ctx->includes);
+	ctx->includes = resolver ? glcpp_include_cache_create (ctx->mem_ctx, resolver, userData) : NULL;
+}
+
+void glslopt_set_output_writer (glslopt_ctx* ctx, glslopt_output_writer writer, void* userData)
+{
+	ctx->outputWriter = writer;
+	ctx->outputWriterData = userData;
+}
+
 struct glslopt_shader_var
 {
 	const char* name;
@@ -122,6 +227,13 @@ struct glslopt_shader_var
 	int matrixSize;
 	int arraySize;
 	int location;
+	bool controlsBranches;
+};
+
+struct glslopt_shader_preshader
+{
+	const char* name;
+	const char* expression;
 };
 
 struct glslopt_shader
@@ -139,18 +251,27 @@ struct glslopt_shader
 	}
 
 	glslopt_shader ()
-		: rawOutput(0)
-		, optimizedOutput(0)
-		, status(false)
+		: uniforms(0)
+		, inputs(0)
+		, textures(0)
 		, uniformCount(0)
 		, uniformsSize(0)
 		, inputCount(0)
 		, textureCount(0)
+		, preshaders(0)
+		, preshaderCount(0)
 		, statsMath(0)
 		, statsTex(0)
 		, statsFlow(0)
+		, rawOutput(0)
+		, optimizedOutput(0)
+		, serializedIR(0)
+		, serializedIRSize(0)
+		, peakMemory(0)
+		, status(false)
 	{
 		infoLog = "Shader not compiled yet";
+		memset (&cost, 0, sizeof(cost));
 		
 		whole_program = rzalloc (NULL, struct gl_shader_program);
 		assert(whole_program != NULL);
@@ -178,19 +299,24 @@ struct glslopt_shader
 	struct gl_shader_program* whole_program;
 	struct gl_shader* shader;
 
-	static const int kMaxShaderUniforms = 1024;
-	static const int kMaxShaderInputs = 128;
-	static const int kMaxShaderTextures = 128;
-	glslopt_shader_var uniforms[kMaxShaderUniforms];
-	glslopt_shader_var inputs[kMaxShaderInputs];
-	glslopt_shader_var textures[kMaxShaderInputs];
+	// Reflection data; arrays are exactly sized and all names live in one
+	// string pool, everything allocated off the shader.
+	glslopt_shader_var* uniforms;
+	glslopt_shader_var* inputs;
+	glslopt_shader_var* textures;
 	int uniformCount, uniformsSize;
 	int inputCount;
 	int textureCount;
+	glslopt_shader_preshader* preshaders;
+	int preshaderCount;
 	int statsMath, statsTex, statsFlow;
+	glslopt_shader_cost cost;
 
 	char*	rawOutput;
 	char*	optimizedOutput;
+	char*	serializedIR;
+	size_t	serializedIRSize;
+	size_t	peakMemory;
 	const char*	infoLog;
 	bool	status;
 };
@@ -308,26 +434,169 @@ static void propagate_precision_call(ir_instruction *ir, void *data)
 }
 
 
-static bool propagate_precision(exec_list* list, bool assign_high_to_undefined)
+// Precision inference is a dataflow problem over def-use edges: an rvalue's
+// precision depends on its operands, a variable's precision depends on the
+// assignments to it, and dereferences depend on the variable. Instead of
+// re-walking the whole tree until nothing changes, collect the nodes and their
+// users once, then only revisit the users of nodes whose precision changed.
+struct precision_user
+{
+	ir_instruction* ir;
+	precision_user* next;
+};
+
+class precision_propagation_visitor : public ir_hierarchical_visitor
+{
+public:
+	precision_propagation_visitor()
+	{
+		mem_ctx = ralloc_context(NULL);
+		users = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+		worklist = NULL;
+		worklist_head = 0;
+		worklist_size = 0;
+		worklist_capacity = 0;
+	}
+	~precision_propagation_visitor()
+	{
+		_mesa_hash_table_destroy(users, NULL);
+		ralloc_free(mem_ctx);
+	}
+
+	virtual ir_visitor_status visit(ir_dereference_variable* ir)
+	{
+		add_user(ir->var, ir);
+		push(ir);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_dereference_array* ir)
+	{
+		add_user(ir->array, ir);
+		push(ir);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_swizzle* ir)
+	{
+		add_user(ir->val, ir);
+		push(ir);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_expression* ir)
+	{
+		for (int i = 0; i < (int)ir->get_num_operands(); ++i)
+			add_user(ir->operands[i], ir);
+		push(ir);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_assignment* ir)
+	{
+		add_user(ir->rhs, ir);
+		add_user(ir->lhs, ir);
+		push(ir);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_call* ir)
+	{
+		if (!ir->return_deref)
+			return visit_continue;
+		foreach_two_lists(formal_node, &ir->callee->parameters,
+						  actual_node, &ir->actual_parameters) {
+			add_user((ir_variable*)formal_node, ir);
+			add_user((ir_rvalue*)actual_node, ir);
+		}
+		push(ir);
+		return visit_continue;
+	}
+
+	bool propagate();
+
+private:
+	void add_user(const void* source, ir_instruction* ir)
+	{
+		if (!source)
+			return;
+		precision_user* u = ralloc(mem_ctx, precision_user);
+		u->ir = ir;
+		const uint32_t hash = _mesa_hash_pointer(source);
+		hash_entry* e = _mesa_hash_table_search(users, hash, source);
+		u->next = e ? (precision_user*)e->data : NULL;
+		_mesa_hash_table_insert(users, hash, source, u);
+	}
+	void push_users(const void* source)
+	{
+		if (!source)
+			return;
+		hash_entry* e = _mesa_hash_table_search(users, _mesa_hash_pointer(source), source);
+		if (!e)
+			return;
+		for (precision_user* u = (precision_user*)e->data; u; u = u->next)
+			push(u->ir);
+	}
+	void push(ir_instruction* ir)
+	{
+		if (worklist_size == worklist_capacity)
+		{
+			worklist_capacity = worklist_capacity ? worklist_capacity * 2 : 256;
+			worklist = reralloc(mem_ctx, worklist, ir_instruction*, worklist_capacity);
+		}
+		worklist[worklist_size++] = ir;
+	}
+
+	void* mem_ctx;
+	hash_table* users;
+	ir_instruction** worklist;
+	unsigned worklist_head, worklist_size, worklist_capacity;
+};
+
+
+bool precision_propagation_visitor::propagate()
 {
 	bool anyProgress = false;
-	bool res;
-	do {
-		res = false;
-		foreach_in_list(ir_instruction, ir, list)
+	while (worklist_head < worklist_size)
+	{
+		ir_instruction* ir = worklist[worklist_head++];
+		bool res = false;
+		propagate_precision_deref (ir, &res);
+		propagate_precision_assign (ir, &res);
+		propagate_precision_call (ir, &res);
+		propagate_precision_expr (ir, &res);
+		if (!res)
+			continue;
+		anyProgress = true;
+
+		// whatever got its precision set might feed other nodes
+		if (ir_assignment* ass = ir->as_assignment())
+		{
+			push_users(ass->lhs);
+			push_users(ass->lhs->variable_referenced());
+		}
+		else if (ir_call* call = ir->as_call())
+			push_users(call->return_deref);
+		else
+			push_users(ir);
+
+		// compact the worklist once the processed prefix dominates it
+		if (worklist_head > 1024 && worklist_head * 2 > worklist_size)
 		{
-			visit_tree (ir, propagate_precision_deref, &res);
-			visit_tree (ir, propagate_precision_assign, &res);
-			visit_tree (ir, propagate_precision_call, &res);
-			visit_tree (ir, propagate_precision_expr, &res);
+			memmove(worklist, worklist + worklist_head, (worklist_size - worklist_head) * sizeof(worklist[0]));
+			worklist_size -= worklist_head;
+			worklist_head = 0;
 		}
-		anyProgress |= res;
-	} while (res);
-	anyProgress |= res;
+	}
+	return anyProgress;
+}
+
+
+static bool propagate_precision(exec_list* list, bool assign_high_to_undefined)
+{
+	precision_propagation_visitor v;
+	v.run (list);
+	bool anyProgress = v.propagate();
 	
 	// for globals that have undefined precision, set it to highp
 	if (assign_high_to_undefined)
 	{
+		bool globalsChanged = false;
 		foreach_in_list(ir_instruction, ir, list)
 		{
 			ir_variable* var = ir->as_variable();
@@ -336,16 +605,113 @@ static bool propagate_precision(exec_list* list, bool assign_high_to_undefined)
 				if (var->data.precision == glsl_precision_undefined)
 				{
 					var->data.precision = glsl_precision_high;
-					anyProgress = true;
+					globalsChanged = true;
 				}
 			}
 		}
+		// and let their uses know; this runs once on the final IR, not
+		// in a loop that would get to them on the next round
+		if (globalsChanged)
+		{
+			propagate_precision (list, false);
+			anyProgress = true;
+		}
 	}
 	
 	return anyProgress;
 }
 
 
+// Shared IR is optimized with globals of undefined precision, so copy
+// propagation can leave a swizzle or array element of a highp global with the
+// precision of the mediump temporary it replaced. Once Metal has given those
+// globals highp, bring the swizzles and array elements in line, or the printer
+// misses the conversions.
+class metal_precision_visitor : public ir_hierarchical_visitor
+{
+public:
+	virtual ir_visitor_status visit_leave(ir_dereference_array* ir)
+	{
+		sync(ir, ir->array->get_precision());
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_swizzle* ir)
+	{
+		sync(ir, ir->val->get_precision());
+		return visit_continue;
+	}
+
+private:
+	static void sync(ir_rvalue* ir, glsl_precision prec)
+	{
+		if (prec != glsl_precision_undefined)
+			ir->set_precision(prec);
+	}
+};
+
+
+// Optimized IR is the same for all targets, with built-in variables as
+// GLSL declares them; patch them up for Metal: gl_VertexID & gl_InstanceID
+// are uint, and gl_PointCoord is highp.
+class metal_builtins_visitor : public ir_rvalue_visitor
+{
+public:
+	virtual ir_visitor_status visit(ir_variable* var)
+	{
+		if (is_int_system_value(var))
+			var->type = glsl_type::uint_type;
+		else if (is_point_coord(var))
+			var->data.precision = glsl_precision_high;
+		return visit_continue;
+	}
+
+	virtual void handle_rvalue(ir_rvalue** rvalue)
+	{
+		if (!*rvalue)
+			return;
+		ir_swizzle* swz = (*rvalue)->as_swizzle();
+		if (swz && swz->val->as_dereference_variable() && is_point_coord(swz->val->variable_referenced()))
+		{
+			swz->set_precision(glsl_precision_high);
+			return;
+		}
+		ir_expression* expr = (*rvalue)->as_expression();
+		if (expr && expr->operation == ir_unop_i2f)
+		{
+			// float(gl_VertexID) needs no detour through int
+			ir_expression* conv = expr->operands[0]->as_expression();
+			if (conv && conv->operation == ir_unop_u2i)
+			{
+				expr->operation = ir_unop_u2f;
+				expr->operands[0] = conv->operands[0];
+			}
+			return;
+		}
+		ir_dereference_variable* deref = (*rvalue)->as_dereference_variable();
+		if (!deref)
+			return;
+		if (is_point_coord(deref->var))
+			deref->set_precision(glsl_precision_high);
+		else if (deref->var->type == glsl_type::uint_type && deref->type == glsl_type::int_type)
+		{
+			deref->type = glsl_type::uint_type;
+			*rvalue = new(ralloc_parent(deref)) ir_expression(ir_unop_u2i, deref);
+		}
+	}
+
+private:
+	static bool is_int_system_value(const ir_variable* var)
+	{
+		return var->data.mode == ir_var_system_value && var->type == glsl_type::int_type &&
+			(!strcmp(var->name, "gl_VertexID") || !strcmp(var->name, "gl_InstanceID"));
+	}
+	static bool is_point_coord(const ir_variable* var)
+	{
+		return var && var->data.mode == ir_var_shader_in && !strcmp(var->name, "gl_PointCoord");
+	}
+};
+
+
 static void do_optimization_passes(exec_list* ir, bool linked, _mesa_glsl_parse_state* state, void* mem_ctx)
 {
 	bool progress;
@@ -354,13 +720,13 @@ static void do_optimization_passes(exec_list* ir, bool linked, _mesa_glsl_parse_
 		bool progress2;
 		debug_print_ir ("Initial", ir, state, mem_ctx);
 		if (linked) {
-			progress2 = do_function_inlining(ir); progress |= progress2; if (progress2) debug_print_ir ("After inlining", ir, state, mem_ctx);
+			progress2 = do_function_inlining(ir, &state->ctx->Const.ShaderCompilerOptions[state->stage]); progress |= progress2; if (progress2) debug_print_ir ("After inlining", ir, state, mem_ctx);
 			progress2 = do_dead_functions(ir); progress |= progress2; if (progress2) debug_print_ir ("After dead functions", ir, state, mem_ctx);
 			progress2 = do_structure_splitting(ir); progress |= progress2; if (progress2) debug_print_ir ("After struct splitting", ir, state, mem_ctx);
 		}
 		progress2 = do_if_simplification(ir); progress |= progress2; if (progress2) debug_print_ir ("After if simpl", ir, state, mem_ctx);
 		progress2 = opt_flatten_nested_if_blocks(ir); progress |= progress2; if (progress2) debug_print_ir ("After if flatten", ir, state, mem_ctx);
-		progress2 = propagate_precision (ir, state->metal_target); progress |= progress2; if (progress2) debug_print_ir ("After prec propagation", ir, state, mem_ctx);
+		progress2 = propagate_precision (ir, false); progress |= progress2; if (progress2) debug_print_ir ("After prec propagation", ir, state, mem_ctx);
 		progress2 = do_copy_propagation(ir); progress |= progress2; if (progress2) debug_print_ir ("After copy propagation", ir, state, mem_ctx);
 		progress2 = do_copy_propagation_elements(ir); progress |= progress2; if (progress2) debug_print_ir ("After copy propagation elems", ir, state, mem_ctx);
 		if (state->es_shader && linked)
@@ -378,7 +744,7 @@ static void do_optimization_passes(exec_list* ir, bool linked, _mesa_glsl_parse_
 			progress2 = do_dead_code_unlinked(ir); progress |= progress2; if (progress2) debug_print_ir ("After dead code unlinked", ir, state, mem_ctx);
 		}
 		progress2 = do_dead_code_local(ir); progress |= progress2; if (progress2) debug_print_ir ("After dead code local", ir, state, mem_ctx);
-		progress2 = propagate_precision (ir, state->metal_target); progress |= progress2; if (progress2) debug_print_ir ("After prec propagation", ir, state, mem_ctx);
+		progress2 = propagate_precision (ir, false); progress |= progress2; if (progress2) debug_print_ir ("After prec propagation", ir, state, mem_ctx);
 		progress2 = do_tree_grafting(ir); progress |= progress2; if (progress2) debug_print_ir ("After tree grafting", ir, state, mem_ctx);
 		progress2 = do_constant_propagation(ir); progress |= progress2; if (progress2) debug_print_ir ("After const propagation", ir, state, mem_ctx);
 		if (linked) {
@@ -391,12 +757,16 @@ static void do_optimization_passes(exec_list* ir, bool linked, _mesa_glsl_parse_
 		progress2 = do_cse(ir); progress |= progress2; if (progress2) debug_print_ir ("After CSE", ir, state, mem_ctx);
 		progress2 = do_rebalance_tree(ir); progress |= progress2; if (progress2) debug_print_ir ("After rebalance tree", ir, state, mem_ctx);
 		progress2 = do_algebraic(ir, state->ctx->Const.NativeIntegers, &state->ctx->Const.ShaderCompilerOptions[state->stage]); progress |= progress2; if (progress2) debug_print_ir ("After algebraic", ir, state, mem_ctx);
+		if (state->ctx->Const.ShaderCompilerOptions[state->stage].OptimizeStrength)
+		{
+			progress2 = do_strength_reduction(ir); progress |= progress2; if (progress2) debug_print_ir ("After strength reduction", ir, state, mem_ctx);
+		}
 		progress2 = do_lower_jumps(ir); progress |= progress2; if (progress2) debug_print_ir ("After lower jumps", ir, state, mem_ctx);
 		progress2 = do_vec_index_to_swizzle(ir); progress |= progress2; if (progress2) debug_print_ir ("After vec index to swizzle", ir, state, mem_ctx);
 		progress2 = lower_vector_insert(ir, false); progress |= progress2; if (progress2) debug_print_ir ("After lower vector insert", ir, state, mem_ctx);
 		progress2 = do_swizzle_swizzle(ir); progress |= progress2; if (progress2) debug_print_ir ("After swizzle swizzle", ir, state, mem_ctx);
 		progress2 = do_noop_swizzle(ir); progress |= progress2; if (progress2) debug_print_ir ("After noop swizzle", ir, state, mem_ctx);
-		progress2 = optimize_split_arrays(ir, linked, state->metal_target && state->stage == MESA_SHADER_FRAGMENT); progress |= progress2; if (progress2) debug_print_ir ("After split arrays", ir, state, mem_ctx);
+		progress2 = optimize_split_arrays(ir, linked, false); progress |= progress2; if (progress2) debug_print_ir ("After split arrays", ir, state, mem_ctx);
 		progress2 = optimize_split_vectors(ir, linked, OPT_SPLIT_ONLY_UNUSED); progress |= progress2; if (progress2) debug_print_ir("After split unused vectors", ir, state, mem_ctx);
 		progress2 = optimize_redundant_jumps(ir); progress |= progress2; if (progress2) debug_print_ir ("After redundant jumps", ir, state, mem_ctx);
 
@@ -404,22 +774,97 @@ static void do_optimization_passes(exec_list* ir, bool linked, _mesa_glsl_parse_
 		// problems (ast-in.txt test)
 		if (linked)
 		{
+			progress2 = do_constant_loop_evaluation(ir); progress |= progress2; if (progress2) debug_print_ir ("After constant loops", ir, state, mem_ctx);
 			loop_state *ls = analyze_loop_variables(ir);
 			if (ls->loop_found) {
 				progress2 = set_loop_controls(ir, ls); progress |= progress2; if (progress2) debug_print_ir ("After set loop", ir, state, mem_ctx);
 				progress2 = unroll_loops(ir, ls, &state->ctx->Const.ShaderCompilerOptions[state->stage]); progress |= progress2; if (progress2) debug_print_ir ("After unroll", ir, state, mem_ctx);
+				// loop analysis is only up to date if nothing was unrolled
+				if (!progress2) {
+					progress2 = hoist_loop_invariants(ir, ls); progress |= progress2; if (progress2) debug_print_ir ("After loop invariants", ir, state, mem_ctx);
+				}
 			}
 			delete ls;
 		}
+
+		// pack scalar math into vectors only once everything else is done, so
+		// that values nobody reads any more don't get packed
+		if (linked && !progress)
+		{
+			progress = do_slp_vectorize(ir); if (progress) debug_print_ir ("After SLP vectorize", ir, state, mem_ctx);
+		}
 	} while (progress);
+}
 
-	if (!state->metal_target)
+static void do_target_lowering(exec_list* ir, bool metal, bool linked, gl_shader_stage stage, const gl_shader_compiler_options& options)
+{
+	if (!metal)
 	{
 		// GLSL/ES does not have saturate, so lower it
 		lower_instructions(ir, SAT_TO_CLAMP);
 	}
+	else
+	{
+		metal_builtins_visitor builtins;
+		builtins.run (ir);
+		// Metal needs all globals to have a precision
+		propagate_precision (ir, true);
+		metal_precision_visitor precision;
+		precision.run (ir);
+		// fragment outputs are separate struct members; drop the ones
+		// nothing writes
+		if (stage == MESA_SHADER_FRAGMENT && optimize_split_arrays (ir, linked, true))
+			do_dead_code (ir, false);
+		// GLSL ES has no fma(); IR shared with other targets keeps separate
+		// multiplies and adds
+		if (options.EmitFma)
+			do_fma_formation (ir);
+	}
 }
 
+static char* print_shader_ir(exec_list* ir, _mesa_glsl_parse_state* state, glslopt_shader* shader, bool metal, PrintGlslMode printMode)
+{
+	if (metal)
+		return _mesa_print_ir_metal(ir, state, ralloc_strdup(shader, ""), printMode, &shader->uniformsSize);
+	return _mesa_print_ir_glsl(ir, state, ralloc_strdup(shader, ""), printMode);
+}
+
+struct output_writer_data
+{
+	glslopt_ctx* ctx;
+	glslopt_shader* shader;
+};
+
+static void write_output(const char* data, size_t size, void* userData)
+{
+	output_writer_data* d = (output_writer_data*)userData;
+	d->ctx->outputWriter (d->shader, data, size, d->ctx->outputWriterData);
+}
+
+// Optimized output either goes into the shader, or in pieces to the output
+// writer of the context; then only a buffer of kOutputChunkSize is used.
+static const size_t kOutputChunkSize = 16 * 1024;
+
+static void print_shader_output(glslopt_ctx* ctx, exec_list* ir, _mesa_glsl_parse_state* state, glslopt_shader* shader, bool metal, PrintGlslMode printMode)
+{
+	if (!ctx->outputWriter)
+	{
+		shader->optimizedOutput = print_shader_ir(ir, state, shader, metal, printMode);
+		return;
+	}
+
+	output_writer_data data = { ctx, shader };
+	string_buffer out (shader, kOutputChunkSize);
+	out.set_writer (write_output, &data);
+	if (metal)
+		_mesa_print_ir_metal(ir, state, out, printMode, &shader->uniformsSize);
+	else
+		_mesa_print_ir_glsl(ir, state, out, printMode);
+	out.flush ();
+	shader->optimizedOutput = ralloc_strdup(shader, "");
+}
+
+
 static void glsl_type_to_optimizer_desc(const glsl_type* type, glsl_precision prec, glslopt_shader_var* out)
 {
 	out->arraySize = type->array_size();
@@ -462,53 +907,218 @@ static void glsl_type_to_optimizer_desc(const glsl_type* type, glsl_precision pr
 	}
 }
 
+static bool is_shader_input(const ir_variable* var)
+{
+	return var->data.mode == ir_var_shader_in;
+}
+
+static bool is_shader_uniform(const ir_variable* var)
+{
+	return var->data.mode == ir_var_uniform && !var->type->is_sampler();
+}
+
+static bool is_shader_texture(const ir_variable* var)
+{
+	return var->data.mode == ir_var_uniform && var->type->is_sampler();
+}
+
 static void find_shader_variables(glslopt_shader* sh, exec_list* ir)
 {
+	// count first, so that reflection data can be stored in exactly sized arrays
+	int inputCount = 0, uniformCount = 0, textureCount = 0;
+	size_t namesSize = 0;
 	foreach_in_list(ir_instruction, node, ir)
 	{
 		ir_variable* const var = node->as_variable();
 		if (var == NULL)
 			continue;
-		if (var->data.mode == ir_var_shader_in)
-		{
-			if (sh->inputCount >= glslopt_shader::kMaxShaderInputs)
-				continue;
-
-			glslopt_shader_var& v = sh->inputs[sh->inputCount];
-			v.name = ralloc_strdup(sh, var->name);
-			glsl_type_to_optimizer_desc(var->type, (glsl_precision)var->data.precision, &v);
-			v.location = var->data.explicit_location ? var->data.location : -1;
-			++sh->inputCount;
-		}
-		if (var->data.mode == ir_var_uniform && !var->type->is_sampler())
-		{
-			if (sh->uniformCount >= glslopt_shader::kMaxShaderUniforms)
-				continue;
-			
-			glslopt_shader_var& v = sh->uniforms[sh->uniformCount];
-			v.name = ralloc_strdup(sh, var->name);
-			glsl_type_to_optimizer_desc(var->type, (glsl_precision)var->data.precision, &v);
-			v.location = var->data.explicit_location ? var->data.location : -1;
-			++sh->uniformCount;
-		}
-		if (var->data.mode == ir_var_uniform && var->type->is_sampler())
-		{
-			if (sh->textureCount >= glslopt_shader::kMaxShaderTextures)
-				continue;
-			
-			glslopt_shader_var& v = sh->textures[sh->textureCount];
-			v.name = ralloc_strdup(sh, var->name);
-			glsl_type_to_optimizer_desc(var->type, (glsl_precision)var->data.precision, &v);
-			v.location = var->data.explicit_location ? var->data.location : -1;
-			++sh->textureCount;
-		}
+		if (is_shader_input(var))
+			++inputCount;
+		else if (is_shader_uniform(var))
+			++uniformCount;
+		else if (is_shader_texture(var))
+			++textureCount;
+		else
+			continue;
+		namesSize += strlen(var->name) + 1;
+	}
+	if (namesSize == 0)
+		return;
+
+	sh->inputs = inputCount ? ralloc_array(sh, glslopt_shader_var, inputCount) : NULL;
+	sh->uniforms = uniformCount ? ralloc_array(sh, glslopt_shader_var, uniformCount) : NULL;
+	sh->textures = textureCount ? ralloc_array(sh, glslopt_shader_var, textureCount) : NULL;
+	char* names = ralloc_array(sh, char, namesSize);
+
+	hash_table* branchInputs = NULL;
+	if (uniformCount)
+	{
+		branchInputs = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+		find_branch_inputs(ir, branchInputs);
+	}
+
+	foreach_in_list(ir_instruction, node, ir)
+	{
+		ir_variable* const var = node->as_variable();
+		if (var == NULL)
+			continue;
+
+		glslopt_shader_var* v;
+		if (is_shader_input(var))
+			v = &sh->inputs[sh->inputCount++];
+		else if (is_shader_uniform(var))
+			v = &sh->uniforms[sh->uniformCount++];
+		else if (is_shader_texture(var))
+			v = &sh->textures[sh->textureCount++];
+		else
+			continue;
+
+		const size_t nameSize = strlen(var->name) + 1;
+		memcpy(names, var->name, nameSize);
+		v->name = names;
+		names += nameSize;
+		glsl_type_to_optimizer_desc(var->type, (glsl_precision)var->data.precision, v);
+		v->location = var->data.explicit_location ? var->data.location : -1;
+		v->controlsBranches = branchInputs && _mesa_hash_table_search(branchInputs, _mesa_hash_pointer(var), var);
 	}
+	if (branchInputs)
+		_mesa_hash_table_destroy(branchInputs, NULL);
 }
 
 
+static void extract_shader_preshaders(glslopt_shader* sh, exec_list* ir, bool linked, _mesa_glsl_parse_state* state)
+{
+	exec_list preshaders;
+	const char* prefix = state->stage == MESA_SHADER_VERTEX ? "_vpre" : "_fpre";
+	if (!extract_preshaders(ir, &preshaders, prefix))
+		return;
+
+	// clean up after the replaced expressions; this might drop some of the
+	// new uniforms too (e.g. when they end up only feeding dead code)
+	do_optimization_passes(ir, linked, state, sh);
+
+	int count = 0;
+	foreach_in_list(ir_assignment, pre, &preshaders)
+		++count;
+	sh->preshaders = ralloc_array(sh, glslopt_shader_preshader, count);
+	foreach_in_list(ir_assignment, pre, &preshaders)
+	{
+		ir_variable* var = pre->lhs->variable_referenced();
+		bool used = false;
+		foreach_in_list(ir_instruction, node, ir)
+			used |= node == var;
+		if (!used)
+			continue;
+
+		glslopt_shader_preshader& p = sh->preshaders[sh->preshaderCount++];
+		p.name = ralloc_strdup(sh, var->name);
+		string_buffer expression (sh, 64);
+		_mesa_print_rvalue_glsl(pre->rhs, state, expression);
+		p.expression = expression.release();
+	}
+}
+
+static void copy_shader_preshaders(glslopt_shader* dst, const glslopt_shader* src)
+{
+	if (!src->preshaderCount)
+		return;
+	dst->preshaders = ralloc_array(dst, glslopt_shader_preshader, src->preshaderCount);
+	dst->preshaderCount = src->preshaderCount;
+	for (int i = 0; i < src->preshaderCount; ++i)
+	{
+		dst->preshaders[i].name = ralloc_strdup(dst, src->preshaders[i].name);
+		dst->preshaders[i].expression = ralloc_strdup(dst, src->preshaders[i].expression);
+	}
+}
+
+
+static void optimize_targets (glslopt_ctx* ctx, glslopt_shader_type type, glsl_source* source, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders);
+
 glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, const char* shaderSource, unsigned options)
 {
-	glslopt_shader* shader = new (ctx->mem_ctx) glslopt_shader ();
+	glslopt_shader* shader;
+	glslopt_optimize_targets (ctx, type, shaderSource, options, &ctx->target, 1, &shader);
+	return shader;
+}
+
+glslopt_shader* glslopt_optimize_sources (glslopt_ctx* ctx, glslopt_shader_type type, int count, const char* const* strings, const int* lengths, unsigned options)
+{
+	glslopt_shader* shader;
+	glsl_source source;
+	void* lengthsCtx = ralloc_context (NULL);
+	glsl_source_init (&source, lengthsCtx, count > 0 ? count : 0, strings, lengths);
+	optimize_targets (ctx, type, &source, options, &ctx->target, 1, &shader);
+	ralloc_free (lengthsCtx);
+	return shader;
+}
+
+static void set_shaders_failed (glslopt_shader** shaders, int count, const char* infoLog)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		shaders[i]->status = false;
+		shaders[i]->infoLog = i == 0 ? infoLog : ralloc_strdup (shaders[i], infoLog);
+	}
+}
+
+void glslopt_optimize_targets (glslopt_ctx* ctx, glslopt_shader_type type, const char* shaderSource, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders)
+{
+	glsl_source source;
+	glsl_source_init_string (&source, shaderSource);
+	optimize_targets (ctx, type, &source, options, targets, targetCount, outShaders);
+}
+
+static void compile_targets (glslopt_ctx* ctx, glslopt_shader_type type, glsl_source* source, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders);
+
+static void optimize_targets (glslopt_ctx* ctx, glslopt_shader_type type, glsl_source* source, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders)
+{
+	if (targetCount <= 0)
+		return;
+
+	trim_atoms (ctx);
+	ralloc_usage usage = { 0, 0 };
+	ralloc_usage* outerUsage = ralloc_track_usage (&usage);
+	compile_targets (ctx, type, source, options, targets, targetCount, outShaders);
+	ralloc_track_usage (outerUsage);
+
+	for (int i = 0; i < targetCount; ++i)
+		outShaders[i]->peakMemory = usage.peak_bytes;
+}
+
+// Everything the front end allocates hangs off the parse state, which has to
+// stay around for printing; each phase's garbage is moved off it and freed
+// as soon as the next phase is done with it.
+static void release_state_allocations (_mesa_glsl_parse_state* state)
+{
+	void* garbage = ralloc_context (NULL);
+	ralloc_adopt (garbage, state);
+	ralloc_free (garbage);
+}
+
+// A shader between the target independent phases (parsing, linking and
+// optimization) and the target specific ones (lowering and printing)
+struct shader_compile
+{
+	glslopt_shader** shaders;
+	const glslopt_target* targets;
+	int targetCount;
+	unsigned options;
+	PrintGlslMode printMode;
+	_mesa_glsl_parse_state* state;
+	void* stateData;
+	exec_list* ir;
+	gl_shader* linkedShader;
+	bool linked;
+	bool optimize;
+};
+
+static bool compile_shader_ir (glslopt_ctx* ctx, glslopt_shader_type type, glsl_source* source, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders, shader_compile* c)
+{
+	// The first shader owns all the parsing, linking and optimization
+	// state; the others only get their own target lowering & output.
+	for (int i = 0; i < targetCount; ++i)
+		outShaders[i] = new (ctx->mem_ctx) glslopt_shader ();
+	glslopt_shader* shader = outShaders[0];
 
 	PrintGlslMode printMode = kPrintGlslVertex;
 	switch (type) {
@@ -525,30 +1135,46 @@ glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, co
 	}
 	if (!shader->shader->Type)
 	{
-		shader->infoLog = ralloc_asprintf (shader, "Unknown shader type %d", (int)type);
-		shader->status = false;
-		return shader;
+		set_shaders_failed (outShaders, targetCount, ralloc_asprintf (shader, "Unknown shader type %d", (int)type));
+		return false;
 	}
 
-	_mesa_glsl_parse_state* state = new (shader) _mesa_glsl_parse_state (&ctx->mesa_ctx, shader->shader->Stage, shader);
-	if (ctx->target == kGlslTargetMetal)
-		state->metal_target = true;
+	// Parsing and optimization are target independent; Metal specifics
+	// are left to Metal lowering.
+	_mesa_glsl_parse_state* state = new (shader) _mesa_glsl_parse_state (&ctx->mesa_ctx, shader->shader->Stage, shader, ctx->atoms);
 	state->error = 0;
 
+	// Keep what the parse state allocated for itself apart from what the
+	// phases allocate off it
+	void* stateData = ralloc_context (shader);
+	ralloc_adopt (stateData, state);
+
+	// The lexer reads either the preprocessor output, or the source itself
+	glsl_source preprocessed;
+	const char* output = NULL;
 	if (!(options & kGlslOptionSkipPreprocessor))
 	{
-		state->error = !!glcpp_preprocess (state, &shaderSource, &state->info_log, state->extensions, &ctx->mesa_ctx);
+		state->error = !!glcpp_preprocess_source (state, source, &output, &state->info_log, state->extensions, &ctx->mesa_ctx, ctx->includes);
 		if (state->error)
 		{
-			shader->status = !state->error;
-			shader->infoLog = state->info_log;
-			return shader;
+			set_shaders_failed (outShaders, targetCount, state->info_log);
+			return false;
+		}
+		if (output)
+		{
+			glsl_source_init_string (&preprocessed, output);
+			source = &preprocessed;
 		}
 	}
 
-	_mesa_glsl_lexer_ctor (state, shaderSource);
+	_mesa_glsl_lexer_ctor (state, source);
 	_mesa_glsl_parse (state);
 	_mesa_glsl_lexer_dtor (state);
+	ralloc_free ((void*)output);
+
+	// The AST is only needed until it's converted to IR
+	void* astCtx = ralloc_context (NULL);
+	ralloc_adopt (astCtx, state);
 
 	exec_list* ir = new (shader) exec_list();
 	shader->shader->ir = ir;
@@ -556,13 +1182,29 @@ glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, co
 	if (!state->error && !state->translation_unit.is_empty())
 		_mesa_ast_to_hir (ir, state);
 
+	state->translation_unit.make_empty();
+	ralloc_free (astCtx);
+
 	// Un-optimized output
 	if (!state->error) {
 		validate_ir_tree(ir);
-		if (ctx->target == kGlslTargetMetal)
-			shader->rawOutput = _mesa_print_ir_metal(ir, state, ralloc_strdup(shader, ""), printMode, &shader->uniformsSize);
-		else
-			shader->rawOutput = _mesa_print_ir_glsl(ir, state, ralloc_strdup(shader, ""), printMode);
+		for (int i = 0; i < targetCount; ++i)
+		{
+			// Metal printer assigns locations to variables and needs Metal
+			// built-ins; keep that out of IR that is optimized further
+			const bool metal = targets[i] == kGlslTargetMetal;
+			exec_list* print_ir = ir;
+			if (metal)
+			{
+				print_ir = new (shader) exec_list();
+				clone_ir_list (print_ir, print_ir, ir);
+				metal_builtins_visitor builtins;
+				builtins.run (print_ir);
+			}
+			outShaders[i]->rawOutput = print_shader_ir(print_ir, state, outShaders[i], metal, printMode);
+			if (print_ir != ir)
+				ralloc_free (print_ir);
+		}
 	}
 	
 	// Link built-in functions
@@ -570,8 +1212,9 @@ glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, co
 	shader->shader->uses_builtin_functions = state->uses_builtin_functions;
 	
 	struct gl_shader* linked_shader = NULL;
+	const bool linked = !(options & kGlslOptionNotFullShader);
 
-	if (!state->error && !ir->is_empty() && !(options & kGlslOptionNotFullShader))
+	if (!state->error && !ir->is_empty() && linked)
 	{
 		linked_shader = link_intrastage_shaders(shader,
 												&ctx->mesa_ctx,
@@ -580,46 +1223,168 @@ glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, co
 												shader->whole_program->NumShaders);
 		if (!linked_shader)
 		{
-			shader->status = false;
-			shader->infoLog = shader->whole_program->InfoLog;
-			return shader;
+			set_shaders_failed (outShaders, targetCount, shader->whole_program->InfoLog);
+			return false;
 		}
+		// Linking made a copy of the IR
+		release_state_allocations (state);
+		ralloc_free (ir);
+		shader->shader->ir = NULL;
 		ir = linked_shader->ir;
 		
 		debug_print_ir ("==== After link ====", ir, state, shader);
 	}
 	
 	// Do optimization post-link
-	if (!state->error && !ir->is_empty())
+	const bool optimize = !state->error && !ir->is_empty();
+	if (optimize)
 	{		
-		const bool linked = !(options & kGlslOptionNotFullShader);
+		if (ctx->uniformValueCount)
+			bake_uniform_values(ir, ctx->uniformValues, ctx->uniformValueCount);
 		do_optimization_passes(ir, linked, state, shader);
-		validate_ir_tree(ir);
-	}	
-	
-	// Final optimized output
-	if (!state->error)
+		// branches are easier to judge once the code in them is optimized
+		if (ctx->maxFlattenCost > 0.0f && flatten_branches(ir, &ctx->costModel, ctx->maxFlattenCost))
+		{
+			debug_print_ir ("==== After flattening branches ====", ir, state, shader);
+			do_optimization_passes(ir, linked, state, shader);
+		}
+	}
+
+	c->shaders = outShaders;
+	c->targets = targets;
+	c->targetCount = targetCount;
+	c->options = options;
+	c->printMode = printMode;
+	c->state = state;
+	c->stateData = stateData;
+	c->ir = ir;
+	c->linkedShader = linked_shader;
+	c->linked = linked;
+	c->optimize = optimize;
+	return true;
+}
+
+static void output_targets (glslopt_ctx* ctx, shader_compile* c)
+{
+	glslopt_shader** outShaders = c->shaders;
+	glslopt_shader* shader = outShaders[0];
+	const glslopt_target* targets = c->targets;
+	const int targetCount = c->targetCount;
+	_mesa_glsl_parse_state* state = c->state;
+	exec_list* ir = c->ir;
+	const bool linked = c->linked;
+	const bool optimize = c->optimize;
+
+	if (optimize)
 	{
-		if (ctx->target == kGlslTargetMetal)
-			shader->optimizedOutput = _mesa_print_ir_metal(ir, state, ralloc_strdup(shader, ""), printMode, &shader->uniformsSize);
-		else
-			shader->optimizedOutput = _mesa_print_ir_glsl(ir, state, ralloc_strdup(shader, ""), printMode);
+		if (c->options & kGlslOptionExtractPreshaders)
+		{
+			extract_shader_preshaders(shader, ir, linked, state);
+			for (int i = 1; i < targetCount; ++i)
+				copy_shader_preshaders(outShaders[i], shader);
+		}
+		if (c->options & kGlslOptionSerializeIR)
+		{
+			shader->serializedIR = serialize_ir(ir, state, shader, &shader->serializedIRSize);
+			for (int i = 1; i < targetCount; ++i)
+			{
+				outShaders[i]->serializedIR = (char*)ralloc_size (outShaders[i], shader->serializedIRSize);
+				outShaders[i]->serializedIRSize = shader->serializedIRSize;
+				memcpy (outShaders[i]->serializedIR, shader->serializedIR, shader->serializedIRSize);
+			}
+		}
 	}
 
-	shader->status = !state->error;
-	shader->infoLog = state->info_log;
+	// Target specific lowering & final optimized output. The last target
+	// can work on the optimized IR itself, all others on a copy of it.
+	for (int i = 0; i < targetCount; ++i)
+	{
+		glslopt_shader* sh = outShaders[i];
+		const bool metal = targets[i] == kGlslTargetMetal;
+		exec_list* target_ir = ir;
+		if (i != targetCount - 1)
+		{
+			target_ir = new (shader) exec_list();
+			clone_ir_list (target_ir, target_ir, ir);
+		}
 
-	find_shader_variables (shader, ir);
-	if (!state->error)
-		calculate_shader_stats (ir, &shader->statsMath, &shader->statsTex, &shader->statsFlow);
+		if (optimize)
+		{
+			do_target_lowering(target_ir, metal, linked, state->stage, ctx->mesa_ctx.Const.ShaderCompilerOptions[state->stage]);
+			validate_ir_tree(target_ir);
+		}
+		if (!state->error)
+			print_shader_output(ctx, target_ir, state, sh, metal, c->printMode);
+
+		sh->status = !state->error;
+		sh->infoLog = i == 0 ? state->info_log : ralloc_strdup (sh, state->info_log);
+
+		find_shader_variables (sh, target_ir);
+		if (!state->error)
+		{
+			calculate_shader_stats (target_ir, &sh->statsMath, &sh->statsTex, &sh->statsFlow);
+			calculate_shader_cost (target_ir, &ctx->costModel, &sh->cost);
+		}
+
+		if (target_ir != ir)
+			ralloc_free (target_ir);
+	}
 
 	ralloc_free (ir);
 	ralloc_free (state);
+	ralloc_free (c->stateData);
 
-	if (linked_shader)
-		ralloc_free(linked_shader);
+	if (c->linkedShader)
+		ralloc_free(c->linkedShader);
+}
 
-	return shader;
+static void compile_targets (glslopt_ctx* ctx, glslopt_shader_type type, glsl_source* source, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders)
+{
+	shader_compile c;
+	if (compile_shader_ir (ctx, type, source, options, targets, targetCount, outShaders, &c))
+		output_targets (ctx, &c);
+}
+
+static void compile_pair (glslopt_ctx* ctx, glsl_source* vertexSource, glsl_source* fragmentSource, unsigned options, int maxVaryings, glslopt_shader** outVertex, glslopt_shader** outFragment)
+{
+	shader_compile vs, fs;
+	const bool vsCompiled = compile_shader_ir (ctx, kGlslOptShaderVertex, vertexSource, options, &ctx->target, 1, outVertex, &vs);
+	const bool fsCompiled = compile_shader_ir (ctx, kGlslOptShaderFragment, fragmentSource, options, &ctx->target, 1, outFragment, &fs);
+
+	if (vsCompiled && fsCompiled && vs.optimize && fs.optimize && vs.linked && fs.linked)
+	{
+		bool vsChanged = false;
+		if (hoist_varying_math (vs.ir, fs.ir, maxVaryings))
+		{
+			debug_print_ir ("==== After hoisting varying math ====", fs.ir, fs.state, fs.shaders[0]);
+			do_optimization_passes (fs.ir, fs.linked, fs.state, fs.shaders[0]);
+			vsChanged = true;
+		}
+		vsChanged |= remove_unread_varyings (vs.ir, fs.ir);
+		if (vsChanged)
+			do_optimization_passes (vs.ir, vs.linked, vs.state, vs.shaders[0]);
+	}
+
+	if (vsCompiled)
+		output_targets (ctx, &vs);
+	if (fsCompiled)
+		output_targets (ctx, &fs);
+}
+
+void glslopt_optimize_pair (glslopt_ctx* ctx, const char* vertexSource, const char* fragmentSource, unsigned options, int maxVaryings, glslopt_shader** outVertex, glslopt_shader** outFragment)
+{
+	glsl_source vsSource, fsSource;
+	glsl_source_init_string (&vsSource, vertexSource);
+	glsl_source_init_string (&fsSource, fragmentSource);
+
+	trim_atoms (ctx);
+	ralloc_usage usage = { 0, 0 };
+	ralloc_usage* outerUsage = ralloc_track_usage (&usage);
+	compile_pair (ctx, &vsSource, &fsSource, options, maxVaryings, outVertex, outFragment);
+	ralloc_track_usage (outerUsage);
+
+	(*outVertex)->peakMemory = usage.peak_bytes;
+	(*outFragment)->peakMemory = usage.peak_bytes;
 }
 
 void glslopt_shader_delete (glslopt_shader* shader)
@@ -627,6 +1392,79 @@ void glslopt_shader_delete (glslopt_shader* shader)
 	delete shader;
 }
 
+size_t glslopt_shader_get_peak_memory (glslopt_shader* shader)
+{
+	return shader->peakMemory;
+}
+
+const void* glslopt_shader_serialize (glslopt_shader* shader, size_t* outSize)
+{
+	*outSize = shader->serializedIRSize;
+	return shader->serializedIR;
+}
+
+static glslopt_shader* deserialize_shader (glslopt_ctx* ctx, const void* data, size_t size);
+
+glslopt_shader* glslopt_shader_deserialize (glslopt_ctx* ctx, const void* data, size_t size)
+{
+	ralloc_usage usage = { 0, 0 };
+	ralloc_usage* outerUsage = ralloc_track_usage (&usage);
+	glslopt_shader* shader = deserialize_shader (ctx, data, size);
+	ralloc_track_usage (outerUsage);
+
+	shader->peakMemory = usage.peak_bytes;
+	return shader;
+}
+
+static glslopt_shader* deserialize_shader (glslopt_ctx* ctx, const void* data, size_t size)
+{
+	glslopt_shader* shader = new (ctx->mem_ctx) glslopt_shader ();
+
+	gl_shader_stage stage;
+	if (!serialized_ir_stage(data, size, &stage) || (stage != MESA_SHADER_VERTEX && stage != MESA_SHADER_FRAGMENT))
+	{
+		shader->infoLog = "Invalid serialized shader data";
+		shader->status = false;
+		return shader;
+	}
+	shader->shader->Stage = stage;
+	shader->shader->Type = stage == MESA_SHADER_VERTEX ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER;
+	const PrintGlslMode printMode = stage == MESA_SHADER_VERTEX ? kPrintGlslVertex : kPrintGlslFragment;
+
+	_mesa_glsl_parse_state* state = new (shader) _mesa_glsl_parse_state (&ctx->mesa_ctx, stage, shader, ctx->atoms);
+	const bool metal = ctx->target == kGlslTargetMetal;
+
+	exec_list* ir = new (shader) exec_list();
+	if (!deserialize_ir(data, size, ir, state, ir))
+	{
+		shader->infoLog = "Invalid serialized shader data";
+		shader->status = false;
+		ralloc_free (ir);
+		ralloc_free (state);
+		return shader;
+	}
+
+	// serialized IR is optimized, but not lowered for any target yet
+	do_target_lowering(ir, metal, true, stage, ctx->mesa_ctx.Const.ShaderCompilerOptions[stage]);
+	validate_ir_tree(ir);
+
+	// Raw output is not kept in serialized data
+	shader->rawOutput = ralloc_strdup(shader, "");
+	print_shader_output(ctx, ir, state, shader, metal, printMode);
+
+	shader->status = true;
+	shader->infoLog = state->info_log;
+
+	find_shader_variables (shader, ir);
+	calculate_shader_stats (ir, &shader->statsMath, &shader->statsTex, &shader->statsFlow);
+	calculate_shader_cost (ir, &ctx->costModel, &shader->cost);
+
+	ralloc_free (ir);
+	ralloc_free (state);
+
+	return shader;
+}
+
 bool glslopt_get_status (glslopt_shader* shader)
 {
 	return shader->status;
@@ -691,6 +1529,11 @@ void glslopt_shader_get_uniform_desc (glslopt_shader* shader, int index, const c
 	*outLocation = v.location;
 }
 
+bool glslopt_shader_get_uniform_controls_branches (glslopt_shader* shader, int index)
+{
+	return shader->uniforms[index].controlsBranches;
+}
+
 void glslopt_shader_get_texture_desc (glslopt_shader* shader, int index, const char** outName, glslopt_basic_type* outType, glslopt_precision* outPrec, int* outVecSize, int* outMatSize, int* outArraySize, int* outLocation)
 {
 	const glslopt_shader_var& v = shader->textures[index];
@@ -709,3 +1552,20 @@ void glslopt_shader_get_stats (glslopt_shader* shader, int* approxMath, int* app
 	*approxTex = shader->statsTex;
 	*approxFlow = shader->statsFlow;
 }
+
+void glslopt_shader_get_cost (glslopt_shader* shader, glslopt_shader_cost* outCost)
+{
+	*outCost = shader->cost;
+}
+
+int glslopt_shader_get_preshader_count (glslopt_shader* shader)
+{
+	return shader->preshaderCount;
+}
+
+void glslopt_shader_get_preshader_desc (glslopt_shader* shader, int index, const char** outName, const char** outExpression)
+{
+	const glslopt_shader_preshader& p = shader->preshaders[index];
+	*outName = p.name;
+	*outExpression = p.expression;
+}
@@ -2,6 +2,8 @@
 #ifndef GLSL_OPTIMIZER_H
 #define GLSL_OPTIMIZER_H
 
+#include <stddef.h>
+
 /*
  Main GLSL optimizer interface.
  See ../../README.md for more instructions.
@@ -33,6 +35,8 @@ enum glslopt_shader_type {
 enum glslopt_options {
 	kGlslOptionSkipPreprocessor = (1<<0), // Skip preprocessing shader source. Saves some time if you know you don't need it.
 	kGlslOptionNotFullShader = (1<<1), // Passed shader is not the full shader source. This makes some optimizations weaker.
+	kGlslOptionSerializeIR = (1<<2), // Keep a binary copy of the optimized IR, see glslopt_shader_serialize.
+	kGlslOptionExtractPreshaders = (1<<3), // Move math that only reads uniforms out of the shader, see glslopt_shader_get_preshader_count.
 };
 
 // Optimizer target language
@@ -61,29 +65,199 @@ enum glslopt_precision {
 	kGlslPrecCount
 };
 
+// Kinds of operations weighed by the cost model
+enum glslopt_cost_op {
+	kGlslCostAdd = 0, // add, sub, min, max, abs, floor, fract, bit ops etc.
+	kGlslCostMul,
+	kGlslCostMad, // multiply-add; matrix multiplies are made of these
+	kGlslCostDiv, // division, reciprocal, mod
+	kGlslCostSqrt, // sqrt, inversesqrt
+	kGlslCostExp, // exp, log, exp2, log2
+	kGlslCostPow,
+	kGlslCostTrig, // sin, cos
+	kGlslCostDot,
+	kGlslCostCompare, // comparisons, logic ops, selects
+	kGlslCostConvert, // type conversions
+	kGlslCostDerivative,
+	kGlslCostMove, // assignments of values not computed in place
+	kGlslCostTexture,
+	kGlslCostBranch, // if, loop iteration, call, return, discard
+	kGlslCostOpCount
+};
+
+// GPU families with default cost models
+enum glslopt_cost_family {
+	kGlslCostFamilyVec4 = 0, // one vec4 ALU instruction per vector or matrix column
+	kGlslCostFamilyScalar, // one instruction per component
+};
+
+struct glslopt_cost_model {
+	// Cost of one instruction of each kind
+	float weights[kGlslCostOpCount];
+	// Scalar ALU: costs scale with the number of components. Otherwise with the
+	// number of vec4 instructions (except division and the transcendental
+	// functions, that are per component on vec4 GPUs too).
+	bool scalarALU;
+	// Iterations assumed for loops whose iteration count is not known
+	unsigned unknownLoopIterations;
+};
+
+// Value of a uniform, see glslopt_set_uniform_values
+struct glslopt_uniform_value {
+	const char* name;
+	// Components (matrices column by column) in the uniform's type: values for
+	// float uniforms, intValues for int and bool ones (nonzero is true), and
+	// uintValues for uint ones.
+	union {
+		float values[16];
+		int intValues[16];
+		unsigned uintValues[16];
+	};
+};
+
 glslopt_ctx* glslopt_initialize (glslopt_target target);
 void glslopt_cleanup (glslopt_ctx* ctx);
 
 void glslopt_set_max_unroll_iterations (glslopt_ctx* ctx, unsigned iterations);
+// Loops too long to unroll completely get their bodies repeated up to factor times
+// per iteration instead (simple counted loops only); 1 (the default) disables it.
+void glslopt_set_max_unroll_factor (glslopt_ctx* ctx, unsigned factor);
+// Functions larger than maxSize IR nodes and called more than maxCalls times are kept
+// out of line where they can be. By default everything is inlined.
+void glslopt_set_inline_thresholds (glslopt_ctx* ctx, unsigned maxSize, unsigned maxCalls);
+// Rewrite float math into cheaper but not bit-exact forms (pow into multiplies, fma()
+// on Metal etc.). Off by default.
+void glslopt_set_strength_reduction (glslopt_ctx* ctx, bool enable);
+
+// Get the default cost model of a GPU family, e.g. to tweak its weights.
+void glslopt_get_default_cost_model (glslopt_cost_family family, glslopt_cost_model* outModel);
+// Cost model used for shader costs (glslopt_shader_get_cost) of shaders compiled
+// with the context. The default is the kGlslCostFamilyVec4 model.
+void glslopt_set_cost_model (glslopt_ctx* ctx, const glslopt_cost_model* model);
+// Flatten if/else blocks that only assign values and cost up to maxCost into ?:
+// selects. 0 (the default) disables flattening.
+void glslopt_set_max_flatten_cost (glslopt_ctx* ctx, float maxCost);
+
+// Uniforms to turn into constants in shaders compiled with the context, before they
+// are optimized. Branches on baked bool or int uniforms (and whatever math only they
+// feed) are removed, which makes for cheap specialized variants of a shader without
+// #ifdef keywords; see glslopt_shader_get_uniform_controls_branches for which uniforms
+// are worth it. Baked uniforms are gone from the output and its reflection data.
+// Only non-array scalar, vector and matrix uniforms are baked; values for other
+// uniforms, or for uniforms a shader does not have, are ignored. Values are copied;
+// pass a count of 0 to stop baking.
+void glslopt_set_uniform_values (glslopt_ctx* ctx, const glslopt_uniform_value* values, int count);
+
+// Returns the text of the file named by an #include directive (without the quotes or
+// angle brackets), or NULL if there is no such file. The text must stay valid until
+// the glslopt_optimize call that asked for it returns.
+typedef const char* (*glslopt_include_resolver) (const char* name, void* userData);
+// Enables #include for shaders compiled with the context. Included files are
+// preprocessed once and the result is reused by later includes of the same file
+// contents, with the same values for the macros they use, across compiles.
+// Setting a resolver drops whatever was cached with the previous one.
+void glslopt_set_include_resolver (glslopt_ctx* ctx, glslopt_include_resolver resolver, void* userData);
+
+// Receives optimized output of a shader in consecutive pieces, as it is printed.
+typedef void (*glslopt_output_writer) (glslopt_shader* shader, const char* data, size_t size, void* userData);
+// Makes shaders compiled (or deserialized) with the context pass their optimized
+// output to the writer instead of keeping it; glslopt_get_output then returns an
+// empty string. GLSL output is never held in memory as a whole (Metal output is
+// held in a few sections, as the structs at the top are only known at the end), so
+// this is the cheap way to write lots of shaders into a file or an archive. With
+// glslopt_optimize_targets, outputs of the targets are written one after another,
+// and shader tells which one is being written. Pass NULL to keep output in shaders.
+void glslopt_set_output_writer (glslopt_ctx* ctx, glslopt_output_writer writer, void* userData);
 
 glslopt_shader* glslopt_optimize (glslopt_ctx* ctx, glslopt_shader_type type, const char* shaderSource, unsigned options);
+// Same as glslopt_optimize, with the source passed in pieces like glShaderSource does:
+// strings[i] is lengths[i] characters long, or NUL terminated if lengths is NULL or
+// lengths[i] is negative. The pieces are read where they are, without joining them
+// into one string first.
+glslopt_shader* glslopt_optimize_sources (glslopt_ctx* ctx, glslopt_shader_type type, int count, const char* const* strings, const int* lengths, unsigned options);
+// Optimize once for several targets: preprocessing, parsing, linking and the target
+// independent optimizations are done once (with language rules of the passed context),
+// then only target specific lowering and printing is done for each of the targets.
+// outShaders must have room for targetCount shaders; delete each with glslopt_shader_delete.
+// Note that the GLSL dialect of the output follows the input shader, so for non-Metal
+// targets the output is the same; the win is producing GLSL and Metal in one go. Each
+// output is the same as what glslopt_optimize with a context for that target produces.
+void glslopt_optimize_targets (glslopt_ctx* ctx, glslopt_shader_type type, const char* shaderSource, unsigned options, const glslopt_target* targets, int targetCount, glslopt_shader** outShaders);
+// Optimize a vertex and fragment shader pair together, for the context's target. On top
+// of what glslopt_optimize does, affine math on varyings in the fragment shader (like
+// uv * _Tiling + _Offset, or linear combinations of varyings) is moved to the vertex
+// shader, into new varyings: it's done per vertex instead of per pixel, and transformed
+// texture coordinates don't make for dependent texture reads on GLES2-class GPUs. New
+// varyings are only added while the fragment shader has less than maxVaryings input
+// vectors (8 is the GLES2 minimum). Vertex shader outputs that the fragment shader does
+// not read are removed. With kGlslOptionNotFullShader, this is the same as optimizing
+// the shaders one by one. Delete each shader with glslopt_shader_delete.
+void glslopt_optimize_pair (glslopt_ctx* ctx, const char* vertexSource, const char* fragmentSource, unsigned options, int maxVaryings, glslopt_shader** outVertex, glslopt_shader** outFragment);
 bool glslopt_get_status (glslopt_shader* shader);
 const char* glslopt_get_output (glslopt_shader* shader);
 const char* glslopt_get_raw_output (glslopt_shader* shader);
 const char* glslopt_get_log (glslopt_shader* shader);
 void glslopt_shader_delete (glslopt_shader* shader);
 
+// Binary blob of the optimized IR; only available if shader was optimized with
+// kGlslOptionSerializeIR (returns NULL otherwise). Blob memory is owned by the shader.
+const void* glslopt_shader_serialize (glslopt_shader* shader, size_t* outSize);
+// Create a shader from a serialized IR blob, without parsing or optimizing it again.
+// Output is lowered and printed for the target of the passed context (with its
+// glslopt_set_strength_reduction setting for fma()), so the same blob can be emitted
+// as e.g. both GLSL ES and Metal. Blobs can only be read by the same library version
+// that wrote them.
+glslopt_shader* glslopt_shader_deserialize (glslopt_ctx* ctx, const void* data, size_t size);
+
 int glslopt_shader_get_input_count (glslopt_shader* shader);
 void glslopt_shader_get_input_desc (glslopt_shader* shader, int index, const char** outName, glslopt_basic_type* outType, glslopt_precision* outPrec, int* outVecSize, int* outMatSize, int* outArraySize, int* outLocation);
 int glslopt_shader_get_uniform_count (glslopt_shader* shader);
 int glslopt_shader_get_uniform_total_size (glslopt_shader* shader);
 void glslopt_shader_get_uniform_desc (glslopt_shader* shader, int index, const char** outName, glslopt_basic_type* outType, glslopt_precision* outPrec, int* outVecSize, int* outMatSize, int* outArraySize, int* outLocation);
+// Whether the condition of an if statement or loop in the optimized shader depends
+// on uniform #index, i.e. whether baking its value (glslopt_set_uniform_values)
+// could remove branches.
+bool glslopt_shader_get_uniform_controls_branches (glslopt_shader* shader, int index);
 int glslopt_shader_get_texture_count (glslopt_shader* shader);
 void glslopt_shader_get_texture_desc (glslopt_shader* shader, int index, const char** outName, glslopt_basic_type* outType, glslopt_precision* outPrec, int* outVecSize, int* outMatSize, int* outArraySize, int* outLocation);
 
+// Preshaders: with kGlslOptionExtractPreshaders, expressions that only read uniforms
+// (like normalize(_LightDir.xyz) or 1.0/_Range) are replaced by new uniforms, which
+// are listed along with the other uniforms. The caller computes their values from
+// the original uniforms, once per draw call instead of once per vertex or pixel.
+// Original uniforms that are only used by preshaders are gone from the shader.
+// New uniforms are named _vpreN in vertex shaders and _fpreN in fragment shaders.
+// Preshaders are not kept in serialized IR.
+int glslopt_shader_get_preshader_count (glslopt_shader* shader);
+// Name of the new uniform, and the GLSL expression (in terms of the original
+// uniforms) that gives its value.
+void glslopt_shader_get_preshader_desc (glslopt_shader* shader, int index, const char** outName, const char** outExpression);
+
 // Get *very* approximate shader stats:
 // Number of math, texture and flow control instructions.
+// See glslopt_shader_get_cost for better estimates.
 void glslopt_shader_get_stats (glslopt_shader* shader, int* approxMath, int* approxTex, int* approxFlow);
 
+// Estimated cost of running main() once, with the context's cost model.
+// Loop bodies count once per iteration, calls count as the called function's cost,
+// and both sides of branches count (GPUs often run both).
+struct glslopt_shader_cost {
+	float alu;
+	float tex;
+	float flow;
+	// Peak number of registers (vec4 or scalar, as per the cost model) taken by
+	// local variables and temporaries at once; values live only within an
+	// expression are not counted.
+	int registers;
+};
+void glslopt_shader_get_cost (glslopt_shader* shader, glslopt_shader_cost* outCost);
+
+// Peak number of bytes the compiler had allocated while producing the shader,
+// outputs included; this is what a compile needs memory for. Each phase frees
+// its inputs once the next one has consumed them (the AST after conversion to
+// IR, the unlinked IR after linking and so on). Shaders from one
+// glslopt_optimize_targets or glslopt_optimize_pair call share the figure.
+size_t glslopt_shader_get_peak_memory (glslopt_shader* shader);
+
 
 #endif /* GLSL_OPTIMIZER_H */
@@ -3593,7 +3593,7 @@ yyreduce:
 #line 307 "src/glsl/glsl_parser.yy"
     {
       delete state->symbols;
-      state->symbols = new(ralloc_parent(state)) glsl_symbol_table;
+      state->symbols = new(ralloc_parent(state)) glsl_symbol_table(state->atoms);
       _mesa_glsl_initialize_types(state);
    ;}
     break;
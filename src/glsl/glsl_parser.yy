@@ -306,7 +306,7 @@ translation_unit:
    external_declaration_list
    {
       delete state->symbols;
-      state->symbols = new(ralloc_parent(state)) glsl_symbol_table;
+      state->symbols = new(ralloc_parent(state)) glsl_symbol_table(state->atoms);
       _mesa_glsl_initialize_types(state);
    }
    ;
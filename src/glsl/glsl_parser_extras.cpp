@@ -55,7 +55,8 @@ static const unsigned known_desktop_glsl_versions[] =
 
 _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
 					       gl_shader_stage stage,
-                                               void *mem_ctx)
+                                               void *mem_ctx,
+                                               glsl_atom_table *atoms)
    : ctx(_ctx), cs_input_local_size_specified(false), cs_input_local_size(),
      switch_state()
 {
@@ -63,8 +64,10 @@ _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
    this->stage = stage;
 
    this->scanner = NULL;
+   this->source = NULL;
    this->translation_unit.make_empty();
-   this->symbols = new(mem_ctx) glsl_symbol_table;
+   this->atoms = atoms ? atoms : new(mem_ctx) glsl_atom_table;
+   this->symbols = new(mem_ctx) glsl_symbol_table(this->atoms);
 
    this->info_log = ralloc_strdup(mem_ctx, "");
    this->error = false;
@@ -78,7 +81,6 @@ _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
    this->language_version = ctx->Const.ForceGLSLVersion ?
                             ctx->Const.ForceGLSLVersion : 110;
    this->es_shader = false;
-   this->metal_target = false;
    this->had_version_string = false;
    this->had_float_precision = false;
    this->ARB_texture_rectangle_enable = true;
@@ -1454,7 +1456,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       ir_variable::temporaries_allocate_names = true;
 
    state->error = !!glcpp_preprocess(state, &source, &state->info_log,
-                             &ctx->Extensions, ctx);
+                             &ctx->Extensions, ctx, NULL);
 
    if (!state->error) {
      _mesa_glsl_lexer_ctor(state, source);
@@ -33,8 +33,10 @@
 
 #include <stdlib.h>
 #include "glsl_symbol_table.h"
+#include "glsl_atom_table.h"
 
 struct gl_context;
+struct glsl_source;
 
 struct glsl_switch_state {
    /** Temporary variables needed for switch statement. */
@@ -72,7 +74,7 @@ extern void _mesa_glsl_error(YYLTYPE *locp, _mesa_glsl_parse_state *state,
 
 struct _mesa_glsl_parse_state {
    _mesa_glsl_parse_state(struct gl_context *_ctx, gl_shader_stage stage,
-			  void *mem_ctx);
+			  void *mem_ctx, glsl_atom_table *atoms = NULL);
 
    DECLARE_RALLOC_CXX_OPERATORS(_mesa_glsl_parse_state);
 
@@ -208,9 +210,17 @@ struct _mesa_glsl_parse_state {
 
    struct gl_context *const ctx;
    void *scanner;
+   /** Input of the lexer */
+   struct glsl_source *source;
    exec_list translation_unit;
    glsl_symbol_table *symbols;
 
+   /**
+    * Identifiers are interned here.  Either passed in to be shared with other
+    * compiles, or owned by this state.
+    */
+   glsl_atom_table *atoms;
+
    unsigned num_supported_versions;
    struct {
       unsigned ver;
@@ -218,7 +228,6 @@ struct _mesa_glsl_parse_state {
    } supported_versions[12];
 
    bool es_shader;
-   bool metal_target;
    unsigned language_version;
    bool had_version_string;
    bool had_float_precision;
@@ -544,6 +553,9 @@ extern void _mesa_glsl_warning(const YYLTYPE *locp,
 extern void _mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state,
 				  const char *string);
 
+extern void _mesa_glsl_lexer_ctor(struct _mesa_glsl_parse_state *state,
+				  struct glsl_source *source);
+
 extern void _mesa_glsl_lexer_dtor(struct _mesa_glsl_parse_state *state);
 
 union YYSTYPE;
@@ -581,8 +593,21 @@ extern "C" {
 extern const char *
 _mesa_shader_stage_to_string(unsigned stage);
 
+struct glcpp_include_cache;
+
 extern int glcpp_preprocess(void *ctx, const char **shader, char **info_log,
-                      const struct gl_extensions *extensions, struct gl_context *gl_ctx);
+                      const struct gl_extensions *extensions, struct gl_context *gl_ctx,
+                      struct glcpp_include_cache *includes);
+
+extern int glcpp_preprocess_source(void *ctx, struct glsl_source *source,
+                      const char **output, char **info_log,
+                      const struct gl_extensions *extensions, struct gl_context *gl_ctx,
+                      struct glcpp_include_cache *includes);
+
+extern struct glcpp_include_cache *
+glcpp_include_cache_create(void *ralloc_ctx,
+                           const char *(*resolver)(const char *name, void *data),
+                           void *data);
 
 extern void _mesa_destroy_shader_compiler(void);
 extern void _mesa_destroy_shader_compiler_caches(void);
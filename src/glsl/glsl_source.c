@@ -0,0 +1,142 @@
+#include <string.h>
+#include "util/ralloc.h"
+#include "glsl_source.h"
+
+void
+glsl_source_init(struct glsl_source *source, void *mem_ctx, unsigned count,
+                 const char *const *strings, const int *lengths)
+{
+   size_t *string_lengths = ralloc_array(mem_ctx, size_t, count);
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      if (lengths && lengths[i] >= 0)
+         string_lengths[i] = lengths[i];
+      else
+         string_lengths[i] = strlen(strings[i]);
+   }
+
+   source->strings = strings;
+   source->lengths = string_lengths;
+   source->count = count;
+   source->index = 0;
+   source->offset = 0;
+   source->string = NULL;
+   source->length = 0;
+}
+
+void
+glsl_source_init_string(struct glsl_source *source, const char *string)
+{
+   source->string = string;
+   source->length = strlen(string);
+   source->strings = &source->string;
+   source->lengths = &source->length;
+   source->count = 1;
+   source->index = 0;
+   source->offset = 0;
+}
+
+size_t
+glsl_source_read(struct glsl_source *source, char *buf, size_t max_size)
+{
+   size_t size = 0;
+   size_t line_end;
+
+   while (size < max_size && source->index < source->count) {
+      size_t left = source->lengths[source->index] - source->offset;
+      size_t n = left < max_size - size ? left : max_size - size;
+
+      memcpy(buf + size, source->strings[source->index] + source->offset, n);
+      size += n;
+      source->offset += n;
+      if (source->offset == source->lengths[source->index]) {
+         source->index++;
+         source->offset = 0;
+      }
+   }
+
+   if (source->index == source->count)
+      return size;
+
+   /* More is left, so give back the partial line at the end (if any
+    * complete line was read).
+    */
+   line_end = size;
+   while (line_end > 0 && buf[line_end - 1] != '\n' && buf[line_end - 1] != '\r')
+      line_end--;
+   if (line_end > 0) {
+      size_t unread = size - line_end;
+
+      while (unread > source->offset) {
+         unread -= source->offset;
+         source->index--;
+         source->offset = source->lengths[source->index];
+      }
+      source->offset -= unread;
+      size = line_end;
+   }
+
+   return size;
+}
+
+bool
+glsl_source_contains(const struct glsl_source *source, const char *str)
+{
+   size_t str_length = strlen(str);
+   unsigned i;
+
+   for (i = 0; i < source->count; i++) {
+      const char *end = source->strings[i] + source->lengths[i];
+      const char *p = source->strings[i];
+
+      while ((p = (const char *) memchr(p, str[0], end - p)) != NULL) {
+         /* Match the rest, carrying on into the following strings. */
+         unsigned j = i;
+         const char *q = p + 1;
+         const char *q_end = end;
+         size_t matched = 1;
+
+         while (matched < str_length) {
+            if (q == q_end) {
+               if (++j == source->count)
+                  break;
+               q = source->strings[j];
+               q_end = q + source->lengths[j];
+               continue;
+            }
+            if (*q != str[matched])
+               break;
+            q++;
+            matched++;
+         }
+
+         if (matched == str_length)
+            return true;
+         p++;
+      }
+   }
+
+   return false;
+}
+
+char *
+glsl_source_concat(const struct glsl_source *source, void *mem_ctx)
+{
+   size_t length = 0;
+   size_t offset = 0;
+   unsigned i;
+   char *str;
+
+   for (i = 0; i < source->count; i++)
+      length += source->lengths[i];
+
+   str = ralloc_array(mem_ctx, char, length + 1);
+   for (i = 0; i < source->count; i++) {
+      memcpy(str + offset, source->strings[i], source->lengths[i]);
+      offset += source->lengths[i];
+   }
+   str[length] = '\0';
+
+   return str;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef GLSL_SOURCE_H
+#define GLSL_SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Shader source made of a number of strings, the way glShaderSource takes
+ * it.
+ *
+ * The lexers read it through their own input buffers (see YY_INPUT in
+ * glcpp-lex.l and glsl_lexer.ll), so the strings are never concatenated or
+ * copied as a whole.
+ */
+struct glsl_source {
+   const char *const *strings;
+   const size_t *lengths;
+   unsigned count;
+
+   /** Position of the next character to read */
+   unsigned index;
+   size_t offset;
+
+   /** Storage for a source made of a single string */
+   const char *string;
+   size_t length;
+};
+
+/**
+ * Set up a source made of \c count strings. If \c lengths is NULL, or an
+ * entry of it is negative, the strings are NUL-terminated. Any storage
+ * needed is allocated off \c mem_ctx.
+ */
+extern void
+glsl_source_init(struct glsl_source *source, void *mem_ctx, unsigned count,
+                 const char *const *strings, const int *lengths);
+
+/** Set up a source made of a single NUL-terminated string. */
+extern void
+glsl_source_init_string(struct glsl_source *source, const char *string);
+
+/**
+ * Read up to \c max_size characters into \c buf, returning how many were
+ * read; 0 at the end of the source.
+ *
+ * Unless a line doesn't fit, only whole lines are read, which lets the
+ * preprocessor look ahead to the end of a line within its buffer.
+ */
+extern size_t
+glsl_source_read(struct glsl_source *source, char *buf, size_t max_size);
+
+/** Whether \c str occurs in the source, possibly spanning strings. */
+extern bool
+glsl_source_contains(const struct glsl_source *source, const char *str);
+
+/** Concatenate the whole source into a string allocated off \c mem_ctx. */
+extern char *
+glsl_source_concat(const struct glsl_source *source, void *mem_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GLSL_SOURCE_H */
@@ -23,6 +23,7 @@
  */
 
 #include "glsl_symbol_table.h"
+#include "glsl_atom_table.h"
 
 class symbol_table_entry {
 public:
@@ -94,10 +95,13 @@ public:
    const class ast_type_specifier *a;
 };
 
-glsl_symbol_table::glsl_symbol_table()
+glsl_symbol_table::glsl_symbol_table(glsl_atom_table *atoms)
 {
    this->separate_function_namespace = false;
-   this->table = _mesa_symbol_table_ctor();
+   this->lazy_variables = NULL;
+   this->atoms = atoms;
+   this->table = atoms ? _mesa_symbol_table_ctor_interned()
+                       : _mesa_symbol_table_ctor();
    this->mem_ctx = ralloc_context(NULL);
 }
 
@@ -117,8 +121,21 @@ void glsl_symbol_table::pop_scope()
    _mesa_symbol_table_pop_scope(table);
 }
 
+const char *glsl_symbol_table::add_name(const char *name)
+{
+   return atoms ? atoms->intern(name) : name;
+}
+
+const char *glsl_symbol_table::lookup_name(const char *name)
+{
+   return atoms ? atoms->find(name) : name;
+}
+
 bool glsl_symbol_table::name_declared_this_scope(const char *name)
 {
+   name = lookup_name(name);
+   if (name == NULL)
+      return false;
    return _mesa_symbol_table_symbol_scope(table, -1, name) == 0;
 }
 
@@ -145,7 +162,8 @@ bool glsl_symbol_table::add_variable(ir_variable *v)
 	 symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(v);
 	 if (existing != NULL)
 	    entry->f = existing->f;
-	 int added = _mesa_symbol_table_add_symbol(table, -1, v->name, entry);
+	 int added = _mesa_symbol_table_add_symbol(table, -1,
+                                                   add_name(v->name), entry);
 	 assert(added == 0);
 	 (void)added;
 	 return true;
@@ -155,13 +173,13 @@ bool glsl_symbol_table::add_variable(ir_variable *v)
 
    /* 1.20+ rules: */
    symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(v);
-   return _mesa_symbol_table_add_symbol(table, -1, v->name, entry) == 0;
+   return _mesa_symbol_table_add_symbol(table, -1, add_name(v->name), entry) == 0;
 }
 
 bool glsl_symbol_table::add_type(const char *name, const glsl_type *t)
 {
    symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(t);
-   return _mesa_symbol_table_add_symbol(table, -1, name, entry) == 0;
+   return _mesa_symbol_table_add_symbol(table, -1, add_name(name), entry) == 0;
 }
 
 bool glsl_symbol_table::add_interface(const char *name, const glsl_type *i,
@@ -173,7 +191,7 @@ bool glsl_symbol_table::add_interface(const char *name, const glsl_type *i,
       symbol_table_entry *entry =
          new(mem_ctx) symbol_table_entry(i, mode);
       bool add_interface_symbol_result =
-         _mesa_symbol_table_add_symbol(table, -1, name, entry) == 0;
+         _mesa_symbol_table_add_symbol(table, -1, add_name(name), entry) == 0;
       assert(add_interface_symbol_result);
       return add_interface_symbol_result;
    } else {
@@ -192,13 +210,24 @@ bool glsl_symbol_table::add_function(ir_function *f)
       }
    }
    symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(f);
-   return _mesa_symbol_table_add_symbol(table, -1, f->name, entry) == 0;
+   return _mesa_symbol_table_add_symbol(table, -1, add_name(f->name),
+                                        entry) == 0;
 }
 
 void glsl_symbol_table::add_global_function(ir_function *f)
 {
    symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(f);
-   int added = _mesa_symbol_table_add_global_symbol(table, -1, f->name, entry);
+   int added = _mesa_symbol_table_add_global_symbol(table, -1,
+                                                    add_name(f->name), entry);
+   assert(added == 0);
+   (void)added;
+}
+
+void glsl_symbol_table::add_global_variable(ir_variable *v)
+{
+   symbol_table_entry *entry = new(mem_ctx) symbol_table_entry(v);
+   int added = _mesa_symbol_table_add_global_symbol(table, -1,
+                                                    add_name(v->name), entry);
    assert(added == 0);
    (void)added;
 }
@@ -206,6 +235,8 @@ void glsl_symbol_table::add_global_function(ir_function *f)
 ir_variable *glsl_symbol_table::get_variable(const char *name)
 {
    symbol_table_entry *entry = get_entry(name);
+   if (entry == NULL && this->lazy_variables != NULL)
+      return this->lazy_variables->materialize(name);
    return entry != NULL ? entry->v : NULL;
 }
 
@@ -230,6 +261,9 @@ ir_function *glsl_symbol_table::get_function(const char *name)
 
 symbol_table_entry *glsl_symbol_table::get_entry(const char *name)
 {
+   name = lookup_name(name);
+   if (name == NULL)
+      return NULL;
    return (symbol_table_entry *)
       _mesa_symbol_table_find_symbol(table, -1, name);
 }
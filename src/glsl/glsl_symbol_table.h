@@ -34,8 +34,31 @@ extern "C" {
 #include "ir.h"
 
 class symbol_table_entry;
+class glsl_atom_table;
 struct glsl_type;
 
+/**
+ * Source of variables that are only created once they are first looked up
+ *
+ * Used for the built-in variables: most shaders reference only a handful of
+ * them, so there is no point in creating all of them up front.
+ */
+class glsl_lazy_variable_source {
+public:
+   virtual ~glsl_lazy_variable_source() {}
+
+   /**
+    * Create variable \c name, add it to the symbol table and return it;
+    * returns NULL if there is no such variable.
+    */
+   virtual ir_variable *materialize(const char *name) = 0;
+
+   /**
+    * Called once no more variables will be asked for.
+    */
+   virtual void finish() = 0;
+};
+
 /**
  * Facade class for _mesa_symbol_table
  *
@@ -45,12 +68,21 @@ struct glsl_type;
 struct glsl_symbol_table {
    DECLARE_RALLOC_CXX_OPERATORS(glsl_symbol_table)
 
-   glsl_symbol_table();
+   /**
+    * If \c atoms is given, names are interned into it, and symbols are
+    * hashed and compared by their atom.
+    */
+   glsl_symbol_table(glsl_atom_table *atoms = NULL);
    ~glsl_symbol_table();
 
    /* In 1.10, functions and variables have separate namespaces. */
    bool separate_function_namespace;
 
+   /**
+    * If set, asked for variables that are not found in the table.
+    */
+   glsl_lazy_variable_source *lazy_variables;
+
    void push_scope();
    void pop_scope();
 
@@ -79,6 +111,11 @@ struct glsl_symbol_table {
     */
    void add_global_function(ir_function *f);
 
+   /**
+    * Add a variable at global scope without checking for scoping conflicts.
+    */
+   void add_global_variable(ir_variable *v);
+
    /**
     * \name Methods to get symbols from the table
     */
@@ -101,7 +138,14 @@ struct glsl_symbol_table {
 private:
    symbol_table_entry *get_entry(const char *name);
 
+   /** Name to add a symbol under. */
+   const char *add_name(const char *name);
+
+   /** Name to look a symbol up by; NULL if no symbol can have the name. */
+   const char *lookup_name(const char *name);
+
    struct _mesa_symbol_table *table;
+   glsl_atom_table *atoms;
    void *mem_ctx;
 };
 
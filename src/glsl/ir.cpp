@@ -39,8 +39,8 @@ glsl_precision higher_precision (ir_instruction* a, ir_instruction* b)
 
 ir_rvalue::ir_rvalue(enum ir_node_type t, glsl_precision precision)
    : ir_instruction(t)
-   , precision(precision)
 {
+   this->precision = precision;
    this->type = glsl_type::error_type;
 }
 
@@ -641,9 +641,35 @@ ir_expression::get_operator(const char *str)
    return (ir_expression_operation) -1;
 }
 
+/**
+ * Number of 32-bit slots the value of a constant of \c type takes
+ */
+static unsigned
+value_slots(const glsl_type *type)
+{
+   if (type->is_array() || type->is_record())
+      return 0;
+   return type->components();
+}
+
+void
+ir_constant::init_value(const glsl_type *type)
+{
+   this->type = type;
+
+   const unsigned slots = value_slots(type);
+   if (slots <= Elements(this->inline_value)) {
+      memset(this->inline_value, 0, sizeof(this->inline_value));
+      this->value.u = this->inline_value;
+   } else {
+      this->value.u = rzalloc_array(this, unsigned, slots);
+   }
+}
+
 ir_constant::ir_constant()
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
+   this->value.u = this->inline_value;
 }
 
 ir_constant::ir_constant(const struct glsl_type *type,
@@ -653,66 +679,54 @@ ir_constant::ir_constant(const struct glsl_type *type,
    assert((type->base_type >= GLSL_TYPE_UINT)
 	  && (type->base_type <= GLSL_TYPE_BOOL));
 
-   this->type = type;
-   memcpy(& this->value, data, sizeof(this->value));
+   init_value(type);
+   memcpy(this->value.u, data, value_slots(type) * sizeof(this->value.u[0]));
 }
 
 ir_constant::ir_constant(float f, unsigned vector_elements)
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
    assert(vector_elements <= 4);
-   this->type = glsl_type::get_instance(GLSL_TYPE_FLOAT, vector_elements, 1);
+   init_value(glsl_type::get_instance(GLSL_TYPE_FLOAT, vector_elements, 1));
    for (unsigned i = 0; i < vector_elements; i++) {
       this->value.f[i] = f;
    }
-   for (unsigned i = vector_elements; i < 16; i++)  {
-      this->value.f[i] = 0;
-   }
 }
 
 ir_constant::ir_constant(unsigned int u, unsigned vector_elements)
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
    assert(vector_elements <= 4);
-   this->type = glsl_type::get_instance(GLSL_TYPE_UINT, vector_elements, 1);
+   init_value(glsl_type::get_instance(GLSL_TYPE_UINT, vector_elements, 1));
    for (unsigned i = 0; i < vector_elements; i++) {
       this->value.u[i] = u;
    }
-   for (unsigned i = vector_elements; i < 16; i++) {
-      this->value.u[i] = 0;
-   }
 }
 
 ir_constant::ir_constant(int integer, unsigned vector_elements)
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
    assert(vector_elements <= 4);
-   this->type = glsl_type::get_instance(GLSL_TYPE_INT, vector_elements, 1);
+   init_value(glsl_type::get_instance(GLSL_TYPE_INT, vector_elements, 1));
    for (unsigned i = 0; i < vector_elements; i++) {
       this->value.i[i] = integer;
    }
-   for (unsigned i = vector_elements; i < 16; i++) {
-      this->value.i[i] = 0;
-   }
 }
 
 ir_constant::ir_constant(bool b, unsigned vector_elements)
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
    assert(vector_elements <= 4);
-   this->type = glsl_type::get_instance(GLSL_TYPE_BOOL, vector_elements, 1);
+   init_value(glsl_type::get_instance(GLSL_TYPE_BOOL, vector_elements, 1));
    for (unsigned i = 0; i < vector_elements; i++) {
       this->value.b[i] = b;
    }
-   for (unsigned i = vector_elements; i < 16; i++) {
-      this->value.b[i] = false;
-   }
 }
 
 ir_constant::ir_constant(const ir_constant *c, unsigned i)
-   : ir_rvalue(ir_type_constant, c->precision)
+   : ir_rvalue(ir_type_constant, c->get_precision())
 {
-   this->type = c->type->get_base_type();
+   init_value(c->type->get_base_type());
 
    switch (this->type->base_type) {
    case GLSL_TYPE_UINT:  this->value.u[0] = c->value.u[i]; break;
@@ -726,38 +740,30 @@ ir_constant::ir_constant(const ir_constant *c, unsigned i)
 ir_constant::ir_constant(const struct glsl_type *type, exec_list *value_list)
    : ir_rvalue(ir_type_constant, glsl_precision_undefined)
 {
-   this->type = type;
+   init_value(type);
 
    assert(type->is_scalar() || type->is_vector() || type->is_matrix()
 	  || type->is_record() || type->is_array());
 
-   if (type->is_array()) {
-      this->array_elements = ralloc_array(this, ir_constant *, type->length);
-      unsigned i = 0;
-      foreach_in_list(ir_constant, value, value_list) {
-	 assert(value->as_constant() != NULL);
-
-	 this->array_elements[i++] = value;
-      }
-      return;
-   }
-
    /* If the constant is a record, the types of each of the entries in
     * value_list must be a 1-for-1 match with the structure components.  Each
-    * entry must also be a constant.  Just move the nodes from the value_list
-    * to the list in the ir_constant.
+    * entry must also be a constant.
     */
    /* FINISHME: Should there be some type checking and / or assertions here? */
    /* FINISHME: Should the new constant take ownership of the nodes from
     * FINISHME: value_list, or should it make copies?
     */
-   if (type->is_record()) {
-      value_list->move_nodes_to(& this->components);
-      return;
-   }
+   if (type->is_array() || type->is_record()) {
+      this->const_elements = rzalloc_array(this, ir_constant *, type->length);
+      unsigned i = 0;
+      foreach_in_list(ir_constant, value, value_list) {
+	 assert(value->as_constant() != NULL);
+	 if (i == type->length)
+	    break;
 
-   for (unsigned i = 0; i < 16; i++) {
-      this->value.u[i] = 0;
+	 this->const_elements[i++] = value;
+      }
+      return;
    }
 
    ir_constant *value = (ir_constant *) (value_list->head);
@@ -865,26 +871,34 @@ ir_constant::zero(void *mem_ctx, const glsl_type *type)
 	  || type->is_record() || type->is_array());
 
    ir_constant *c = new(mem_ctx) ir_constant;
-   c->type = type;
-   memset(&c->value, 0, sizeof(c->value));
+   c->init_value(type);
 
    if (type->is_array()) {
-      c->array_elements = ralloc_array(c, ir_constant *, type->length);
+      c->const_elements = ralloc_array(c, ir_constant *, type->length);
 
       for (unsigned i = 0; i < type->length; i++)
-	 c->array_elements[i] = ir_constant::zero(c, type->element_type());
+	 c->const_elements[i] = ir_constant::zero(c, type->element_type());
    }
 
    if (type->is_record()) {
+      c->const_elements = ralloc_array(c, ir_constant *, type->length);
+
       for (unsigned i = 0; i < type->length; i++) {
-	 ir_constant *comp = ir_constant::zero(mem_ctx, type->fields.structure[i].type);
-	 c->components.push_tail(comp);
+	 c->const_elements[i] =
+	    ir_constant::zero(mem_ctx, type->fields.structure[i].type);
       }
    }
 
    return c;
 }
 
+void
+ir_constant::get_data(ir_constant_data *data) const
+{
+   memset(data, 0, sizeof(*data));
+   memcpy(data, this->value.u, value_slots(this->type) * sizeof(data->u[0]));
+}
+
 bool
 ir_constant::get_bool_component(unsigned i) const
 {
@@ -973,7 +987,7 @@ ir_constant::get_array_element(unsigned i) const
    else if (i >= this->type->length)
       i = this->type->length - 1;
 
-   return array_elements[i];
+   return const_elements[i];
 }
 
 ir_constant *
@@ -984,21 +998,7 @@ ir_constant::get_record_field(const char *name)
    if (idx < 0)
       return NULL;
 
-   if (this->components.is_empty())
-      return NULL;
-
-   exec_node *node = this->components.head;
-   for (int i = 0; i < idx; i++) {
-      node = node->next;
-
-      /* If the end of the list is encountered before the element matching the
-       * requested field is found, return NULL.
-       */
-      if (node->is_tail_sentinel())
-	 return NULL;
-   }
-
-   return (ir_constant *) node;
+   return this->const_elements[idx];
 }
 
 void
@@ -1034,9 +1034,8 @@ ir_constant::copy_offset(ir_constant *src, int offset)
 
    case GLSL_TYPE_STRUCT: {
       assert (src->type == this->type);
-      this->components.make_empty();
-      foreach_in_list(ir_constant, orig, &src->components) {
-	 this->components.push_tail(orig->clone(this, NULL));
+      for (unsigned i = 0; i < this->type->length; i++) {
+	 this->const_elements[i] = src->const_elements[i]->clone(this, NULL);
       }
       break;
    }
@@ -1044,7 +1043,7 @@ ir_constant::copy_offset(ir_constant *src, int offset)
    case GLSL_TYPE_ARRAY: {
       assert (src->type == this->type);
       for (unsigned i = 0; i < this->type->length; i++) {
-	 this->array_elements[i] = src->array_elements[i]->clone(this, NULL);
+	 this->const_elements[i] = src->const_elements[i]->clone(this, NULL);
       }
       break;
    }
@@ -1095,34 +1094,14 @@ ir_constant::has_value(const ir_constant *c) const
    if (this->type != c->type)
       return false;
 
-   if (this->type->is_array()) {
+   if (this->type->is_array() || this->type->is_record()) {
       for (unsigned i = 0; i < this->type->length; i++) {
-	 if (!this->array_elements[i]->has_value(c->array_elements[i]))
+	 if (!this->const_elements[i]->has_value(c->const_elements[i]))
 	    return false;
       }
       return true;
    }
 
-   if (this->type->base_type == GLSL_TYPE_STRUCT) {
-      const exec_node *a_node = this->components.head;
-      const exec_node *b_node = c->components.head;
-
-      while (!a_node->is_tail_sentinel()) {
-	 assert(!b_node->is_tail_sentinel());
-
-	 const ir_constant *const a_field = (ir_constant *) a_node;
-	 const ir_constant *const b_field = (ir_constant *) b_node;
-
-	 if (!a_field->has_value(b_field))
-	    return false;
-
-	 a_node = a_node->next;
-	 b_node = b_node->next;
-      }
-
-      return true;
-   }
-
    for (unsigned i = 0; i < this->type->components(); i++) {
       switch (this->type->base_type) {
       case GLSL_TYPE_UINT:
@@ -1262,7 +1241,7 @@ ir_constant::is_uint16_constant() const
 }
 
 ir_loop::ir_loop()
-   : ir_instruction(ir_type_loop)
+   : ir_instruction(ir_type_loop), unroll_factor(1)
 {
 }
 
@@ -1833,15 +1812,10 @@ steal_memory(ir_instruction *ir, void *new_ctx)
    /* The components of aggregate constants are not visited by the normal
     * visitor, so steal their values by hand.
     */
-   if (constant != NULL) {
-      if (constant->type->is_record()) {
-	 foreach_in_list(ir_constant, field, &constant->components) {
-	    steal_memory(field, ir);
-	 }
-      } else if (constant->type->is_array()) {
-	 for (unsigned int i = 0; i < constant->type->length; i++) {
-	    steal_memory(constant->array_elements[i], ir);
-	 }
+   if (constant != NULL &&
+       (constant->type->is_array() || constant->type->is_record())) {
+      for (unsigned int i = 0; i < constant->type->length; i++) {
+	 steal_memory(constant->const_elements[i], ir);
       }
    }
 
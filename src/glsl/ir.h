@@ -190,6 +190,23 @@ protected:
    {
    }
 
+   /**
+    * \name Fields of subclasses
+    *
+    * These live here rather than in the subclasses so that they share the
+    * word after \c ir_type, which would otherwise be padding.  Compilers for
+    * the MSVC ABI never place a derived class's members in its base's tail
+    * padding, so declared in ir_rvalue or ir_assignment they would make those
+    * nodes a pointer size bigger there.
+    */
+   /*@{*/
+   /** Precision of an ir_rvalue, a \c glsl_precision */
+   unsigned precision:2;
+
+   /** Write mask of an ir_assignment */
+   unsigned write_mask:4;
+   /*@}*/
+
 private:
    ir_instruction()
    {
@@ -201,6 +218,8 @@ private:
 /**
  * The base class for all "values"/expression trees.
  */
+class ir_scratch_constant;
+
 class ir_rvalue : public ir_instruction {
 public:
    const struct glsl_type *type;
@@ -216,6 +235,22 @@ public:
 
    virtual ir_constant *constant_expression_value(struct hash_table *variable_context = NULL);
 
+   /**
+    * Non-allocating variant of constant_expression_value, for passes that
+    * look for constant operands speculatively.
+    *
+    * Returns the rvalue itself if it is an ir_constant.  Otherwise scalar,
+    * vector and matrix constant expressions are evaluated into \c scratch,
+    * which is returned; it must be cloned if it is to be put in the IR.
+    * Returns \c NULL if the value is not constant (or is an array or
+    * structure that is not an ir_constant).
+    *
+    * Variables found in \c variable_context, if any, take their values from
+    * it, as in constant_expression_value.
+    */
+   ir_constant *constant_expression_value_scratch(ir_scratch_constant *scratch,
+                                                  struct hash_table *variable_context = NULL);
+
    ir_rvalue *as_rvalue_to_saturate();
 
    virtual bool is_lvalue() const
@@ -246,7 +281,7 @@ public:
       return NULL;
    }
 
-   glsl_precision get_precision() const { return precision; }
+   glsl_precision get_precision() const { return (glsl_precision) precision; }
    void set_precision (glsl_precision prec) { precision = prec; }
 
    /**
@@ -319,8 +354,6 @@ public:
 
 protected:
    ir_rvalue(enum ir_node_type t, glsl_precision precision);
-
-   glsl_precision precision;
 };
 
 
@@ -1049,21 +1082,6 @@ private:
    const ir_function_signature *origin;
 
    friend class ir_function;
-
-   /**
-    * Helper function to run a list of instructions for constant
-    * expression evaluation.
-    *
-    * The hash table represents the values of the visible variables.
-    * There are no scoping issues because the table is indexed on
-    * ir_variable pointers, not variable names.
-    *
-    * Returns false if the expression is not constant, true otherwise,
-    * and the value in *result if result is non-NULL.
-    */
-   bool constant_expression_evaluate_expression_list(const struct exec_list &body,
-						     struct hash_table *variable_context,
-						     ir_constant **result);
 };
 
 
@@ -1179,8 +1197,29 @@ public:
 
    virtual ir_visitor_status accept(ir_hierarchical_visitor *);
 
+   /**
+    * Run the loop at compile time.
+    *
+    * \c variable_context maps ir_variable pointers to the ir_constant values
+    * of the variables visible to the loop, and is updated in place; values of
+    * variables declared in the loop body are allocated off \c mem_ctx.  The
+    * loop is abandoned if it executes more than \c max_instructions
+    * instructions.
+    *
+    * Returns false if anything non-constant happens, in which case the
+    * values of the variables assigned by the loop are undefined.
+    */
+   bool constant_expression_evaluate(struct hash_table *variable_context,
+                                     void *mem_ctx, unsigned max_instructions);
+
    /** List of ir_instruction that make up the body of the loop. */
    exec_list body_instructions;
+
+   /**
+    * Number of copies of the original body per iteration, once the loop has
+    * been partially unrolled; 1 otherwise.  Such loops aren't unrolled again.
+    */
+   unsigned unroll_factor;
 };
 
 
@@ -1207,6 +1246,15 @@ public:
       v->visit(this);
    }
 
+   /**
+    * Perform the assignment on the values in \c variable_context, which
+    * maps ir_variable pointers to ir_constant values.
+    *
+    * Returns false if the assigned variable is not in the context or the
+    * value is not constant.
+    */
+   bool constant_expression_evaluate(struct hash_table *variable_context);
+
    virtual ir_visitor_status accept(ir_hierarchical_visitor *);
 
    /**
@@ -1261,8 +1309,10 @@ public:
     * (assign (constant bool (1)) (xyw)
     *     (var_ref gl_FragColor)
     *     (swiz xyw (var_ref color)))
+    *
+    * Stored in ir_instruction, where it takes no space of its own.
     */
-   unsigned write_mask:4;
+   using ir_instruction::write_mask;
 };
 
 /* Update ir_expression::get_num_operands() and operator_strs when
@@ -1618,6 +1668,13 @@ public:
     */
    virtual ir_constant *constant_expression_value(struct hash_table *variable_context = NULL);
 
+   /**
+    * Evaluate the expression with the given constant operands, writing the
+    * result to \c data.  Returns false if the expression cannot be constant
+    * folded.
+    */
+   bool constant_expression_evaluate(ir_constant **op, union ir_constant_data &data);
+
    /**
     * Determine the number of operands used by an expression
     */
@@ -2160,6 +2217,11 @@ union ir_constant_data {
 
 class ir_constant : public ir_rvalue {
 public:
+   /**
+    * Construct a scalar, vector or matrix constant
+    *
+    * Only as many components as \c type has are read from \c data.
+    */
    ir_constant(const struct glsl_type *type, const ir_constant_data *data);
    ir_constant(bool b, unsigned vector_elements=1);
    ir_constant(unsigned int u, unsigned vector_elements=1);
@@ -2271,26 +2333,74 @@ public:
     */
    virtual bool is_uint16_constant() const;
 
+   /**
+    * Copy the components of a scalar, vector or matrix constant into \c data
+    *
+    * Components past the ones the type has are zeroed.
+    */
+   void get_data(ir_constant_data *data) const;
+
    /**
     * Value of the constant.
     *
     * The field used to back the values supplied by the constant is determined
     * by the type associated with the \c ir_instruction.  Constants may be
     * scalars, vectors, or matrices.
+    *
+    * Only as many components as the type has are stored: up to a vec4 in the
+    * constant itself, matrices in an array allocated for them.
     */
-   union ir_constant_data value;
+   union {
+      unsigned *u;
+      int *i;
+      float *f;
+      bool *b;
+   } value;
 
-   /* Array elements */
-   ir_constant **array_elements;
+   /**
+    * Array elements and structure fields
+    *
+    * One pointer, rather than an exec_list of fields next to an array of
+    * elements, as most constants are neither.
+    */
+   ir_constant **const_elements;
 
-   /* Structure fields */
-   exec_list components;
+protected:
+   /**
+    * Make \c value point at storage for the components of \c type, zeroed
+    */
+   void init_value(const glsl_type *type);
 
 private:
    /**
     * Parameterless constructor only used by the clone method
     */
    ir_constant(void);
+
+   /* \c value points into the object, so a copy would share its storage. */
+   ir_constant(const ir_constant &);
+   ir_constant &operator=(const ir_constant &);
+
+   /** Components of scalars and vectors */
+   unsigned inline_value[4];
+};
+
+
+/**
+ * An ir_constant to be kept on the stack, to hold values from
+ * ir_rvalue::constant_expression_value_scratch.  Never put one in the IR.
+ */
+class ir_scratch_constant : public ir_constant {
+public:
+   ir_scratch_constant()
+      : ir_constant(false)
+   {
+      memset(&this->storage, 0, sizeof(this->storage));
+      this->value.u = this->storage.u;
+   }
+
+   /** Room for the components of any type, unlike IR constants */
+   ir_constant_data storage;
 };
 
 
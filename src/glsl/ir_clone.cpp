@@ -133,6 +133,7 @@ ir_loop *
 ir_loop::clone(void *mem_ctx, struct hash_table *ht) const
 {
    ir_loop *new_loop = new(mem_ctx) ir_loop();
+   new_loop->unroll_factor = this->unroll_factor;
 
    foreach_in_list(ir_instruction, ir, &this->body_instructions) {
       new_loop->body_instructions.push_tail(ir->clone(mem_ctx, ht));
@@ -288,6 +289,11 @@ ir_function_signature::clone(void *mem_ctx, struct hash_table *ht) const
 
    copy->is_defined = this->is_defined;
 
+   /* The copy has a body of its own, so it doesn't need the original's;
+    * this keeps it usable once the original is freed.
+    */
+   copy->origin = this->origin;
+
    /* Clone the instruction list.
     */
    foreach_in_list(const ir_instruction, inst, &this->body) {
@@ -306,7 +312,7 @@ ir_function_signature::clone_prototype(void *mem_ctx, struct hash_table *ht) con
 
    copy->is_defined = false;
    copy->builtin_avail = this->builtin_avail;
-   copy->origin = this;
+   copy->origin = this->origin ? this->origin : this;
 
    /* Clone the parameter list, but NOT the body.
     */
@@ -329,31 +335,20 @@ ir_constant::clone(void *mem_ctx, struct hash_table *ht) const
    case GLSL_TYPE_UINT:
    case GLSL_TYPE_INT:
    case GLSL_TYPE_FLOAT:
-   case GLSL_TYPE_BOOL:
-      return new(mem_ctx) ir_constant(this->type, &this->value);
-
-   case GLSL_TYPE_STRUCT: {
-      ir_constant *c = new(mem_ctx) ir_constant;
-
-      c->type = this->type;
-      for (exec_node *node = this->components.head
-	      ; !node->is_tail_sentinel()
-	      ; node = node->next) {
-	 ir_constant *const orig = (ir_constant *) node;
-
-	 c->components.push_tail(orig->clone(mem_ctx, NULL));
-      }
-
-      return c;
+   case GLSL_TYPE_BOOL: {
+      ir_constant_data data;
+      this->get_data(&data);
+      return new(mem_ctx) ir_constant(this->type, &data);
    }
 
+   case GLSL_TYPE_STRUCT:
    case GLSL_TYPE_ARRAY: {
       ir_constant *c = new(mem_ctx) ir_constant;
 
-      c->type = this->type;
-      c->array_elements = ralloc_array(c, ir_constant *, this->type->length);
+      c->init_value(this->type);
+      c->const_elements = ralloc_array(c, ir_constant *, this->type->length);
       for (unsigned i = 0; i < this->type->length; i++) {
-	 c->array_elements[i] = this->array_elements[i]->clone(mem_ctx, NULL);
+	 c->const_elements[i] = this->const_elements[i]->clone(mem_ctx, NULL);
       }
       return c;
    }
@@ -375,7 +370,8 @@ ir_constant::clone(void *mem_ctx, struct hash_table *ht) const
 ir_precision_statement *
 ir_precision_statement::clone(void *mem_ctx, struct hash_table *ht) const
 {
-   return new(mem_ctx) ir_precision_statement(this->precision_statement);
+   /* The statement string may go away with the IR it was created for. */
+   return new(mem_ctx) ir_precision_statement(ralloc_strdup(mem_ctx, this->precision_statement));
 }
 
 ir_typedecl_statement *
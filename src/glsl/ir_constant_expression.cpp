@@ -407,8 +407,10 @@ constant_referenced(const ir_dereference *deref,
       const ir_dereference_array *const da =
          (const ir_dereference_array *) deref;
 
+      ir_scratch_constant index_scratch;
       ir_constant *const index_c =
-         da->array_index->constant_expression_value(variable_context);
+         da->array_index->constant_expression_value_scratch(&index_scratch,
+                                                            variable_context);
 
       if (!index_c || !index_c->type->is_scalar() || !index_c->type->is_integer())
          break;
@@ -428,6 +430,11 @@ constant_referenced(const ir_dereference *deref,
          break;
 
       const glsl_type *const vt = da->array->type;
+      if (index < 0 || unsigned(index) >= (vt->is_array() ? vt->length :
+                                           vt->is_matrix() ? vt->matrix_columns :
+                                           vt->vector_elements))
+         break;
+
       if (vt->is_array()) {
          store = substore->get_array_element(index);
          offset = 0;
@@ -481,6 +488,22 @@ constant_referenced(const ir_dereference *deref,
 }
 
 
+/**
+ * Evaluate a scalar, vector or matrix value on the stack, allocating only the
+ * result.
+ */
+static ir_constant *
+constant_expression_value_alloc(ir_rvalue *ir, struct hash_table *variable_context)
+{
+   ir_scratch_constant scratch;
+   ir_constant *value = ir->constant_expression_value_scratch(&scratch,
+                                                              variable_context);
+   if (value != &scratch)
+      return value;
+   return new(ralloc_parent(ir)) ir_constant(ir->type, &scratch.storage);
+}
+
+
 ir_constant *
 ir_rvalue::constant_expression_value(struct hash_table *)
 {
@@ -494,16 +517,15 @@ ir_expression::constant_expression_value(struct hash_table *variable_context)
    if (this->type->is_error())
       return NULL;
 
-   ir_constant *op[Elements(this->operands)] = { NULL, };
-   ir_constant_data data;
+   return constant_expression_value_alloc(this, variable_context);
+}
 
-   memset(&data, 0, sizeof(data));
 
-   for (unsigned operand = 0; operand < this->get_num_operands(); operand++) {
-      op[operand] = this->operands[operand]->constant_expression_value(variable_context);
-      if (!op[operand])
-	 return NULL;
-   }
+bool
+ir_expression::constant_expression_evaluate(ir_constant **op,
+                                            ir_constant_data &data)
+{
+   memset(&data, 0, sizeof(data));
 
    if (op[1] != NULL)
       switch (this->operation) {
@@ -537,20 +559,20 @@ ir_expression::constant_expression_value(struct hash_table *variable_context)
       components = op[1]->type->components();
    }
 
-   void *ctx = ralloc_parent(this);
-
    /* Handle array operations here, rather than below. */
    if (op[0]->type->is_array()) {
       assert(op[1] != NULL && op[1]->type->is_array());
       switch (this->operation) {
       case ir_binop_all_equal:
-	 return new(ctx) ir_constant(op[0]->has_value(op[1]));
+	 data.b[0] = op[0]->has_value(op[1]);
+	 return true;
       case ir_binop_any_nequal:
-	 return new(ctx) ir_constant(!op[0]->has_value(op[1]));
+	 data.b[0] = !op[0]->has_value(op[1]);
+	 return true;
       default:
 	 break;
       }
-      return NULL;
+      return false;
    }
 
    switch (this->operation) {
@@ -705,7 +727,7 @@ ir_expression::constant_expression_value(struct hash_table *variable_context)
 		}
 		// how would one express "vec3(nan)" in GLSL? no idea, so let's just not handle it
 		if (mag2 == 0.0f)
-			return NULL;
+			return false;
 		float mag = sqrtf(mag2);
 		for (unsigned c = 0; c < op[0]->type->components(); c++) {
 			data.f[c] = op[0]->value.f[c] / mag;
@@ -1581,7 +1603,7 @@ ir_expression::constant_expression_value(struct hash_table *variable_context)
    case ir_triop_vector_insert: {
       const unsigned idx = op[2]->value.u[0];
 
-      memcpy(&data, &op[0]->value, sizeof(data));
+      op[0]->get_data(&data);
 
       switch (this->type->base_type) {
       case GLSL_TYPE_INT:
@@ -1650,10 +1672,10 @@ ir_expression::constant_expression_value(struct hash_table *variable_context)
 
    default:
       /* FINISHME: Should handle all expression types. */
-      return NULL;
+      return false;
    }
 
-   return new(ctx) ir_constant(this->type, &data);
+   return true;
 }
 
 
@@ -1668,29 +1690,7 @@ ir_texture::constant_expression_value(struct hash_table *)
 ir_constant *
 ir_swizzle::constant_expression_value(struct hash_table *variable_context)
 {
-   ir_constant *v = this->val->constant_expression_value(variable_context);
-
-   if (v != NULL) {
-      ir_constant_data data = { { 0 } };
-
-      const unsigned swiz_idx[4] = {
-	 this->mask.x, this->mask.y, this->mask.z, this->mask.w
-      };
-
-      for (unsigned i = 0; i < this->mask.num_components; i++) {
-	 switch (v->type->base_type) {
-	 case GLSL_TYPE_UINT:
-	 case GLSL_TYPE_INT:   data.u[i] = v->value.u[swiz_idx[i]]; break;
-	 case GLSL_TYPE_FLOAT: data.f[i] = v->value.f[swiz_idx[i]]; break;
-	 case GLSL_TYPE_BOOL:  data.b[i] = v->value.b[swiz_idx[i]]; break;
-	 default:              assert(!"Should not get here."); break;
-	 }
-      }
-
-      void *ctx = ralloc_parent(this);
-      return new(ctx) ir_constant(this->type, &data);
-   }
-   return NULL;
+   return constant_expression_value_alloc(this, variable_context);
 }
 
 
@@ -1724,53 +1724,19 @@ ir_dereference_variable::constant_expression_value(struct hash_table *variable_c
 ir_constant *
 ir_dereference_array::constant_expression_value(struct hash_table *variable_context)
 {
+   if (!this->type->is_array() && !this->type->is_record())
+      return constant_expression_value_alloc(this, variable_context);
+
+   /* An element of an array of arrays or structures */
    ir_constant *array = this->array->constant_expression_value(variable_context);
-   ir_constant *idx = this->array_index->constant_expression_value(variable_context);
+   ir_scratch_constant idx_scratch;
+   ir_constant *idx =
+      this->array_index->constant_expression_value_scratch(&idx_scratch,
+                                                           variable_context);
 
    if ((array != NULL) && (idx != NULL)) {
-      void *ctx = ralloc_parent(this);
-      if (array->type->is_matrix()) {
-	 /* Array access of a matrix results in a vector.
-	  */
-	 const unsigned column = idx->value.u[0];
-
-	 const glsl_type *const column_type = array->type->column_type();
-
-	 /* Offset in the constant matrix to the first element of the column
-	  * to be extracted.
-	  */
-	 const unsigned mat_idx = column * column_type->vector_elements;
-
-	 ir_constant_data data = { { 0 } };
-
-	 switch (column_type->base_type) {
-	 case GLSL_TYPE_UINT:
-	 case GLSL_TYPE_INT:
-	    for (unsigned i = 0; i < column_type->vector_elements; i++)
-	       data.u[i] = array->value.u[mat_idx + i];
-
-	    break;
-
-	 case GLSL_TYPE_FLOAT:
-	    for (unsigned i = 0; i < column_type->vector_elements; i++)
-	       data.f[i] = array->value.f[mat_idx + i];
-
-	    break;
-
-	 default:
-	    assert(!"Should not get here.");
-	    break;
-	 }
-
-	 return new(ctx) ir_constant(column_type, &data);
-      } else if (array->type->is_vector()) {
-	 const unsigned component = idx->value.u[0];
-
-	 return new(ctx) ir_constant(array, component);
-      } else {
-	 const unsigned index = idx->value.u[0];
-	 return array->get_array_element(index)->clone(ctx, NULL);
-      }
+      const unsigned index = idx->value.u[0];
+      return array->get_array_element(index)->clone(ralloc_parent(this), NULL);
    }
    return NULL;
 }
@@ -1807,52 +1773,373 @@ ir_call::constant_expression_value(struct hash_table *variable_context)
 }
 
 
-bool ir_function_signature::constant_expression_evaluate_expression_list(const struct exec_list &body,
-									 struct hash_table *variable_context,
-									 ir_constant **result)
+/* Non-allocating constant evaluation, see
+ * ir_rvalue::constant_expression_value_scratch; the allocating path above
+ * uses it too.  Aggregate constants are read in place instead of being
+ * cloned, and intermediate values are kept on the stack.
+ */
+
+static bool
+constant_data(ir_rvalue *ir, struct hash_table *variable_context,
+              ir_constant_data *data);
+
+/**
+ * Get the value of a variable from the context, or its constant value.
+ */
+static ir_constant *
+constant_variable(ir_variable *var, struct hash_table *variable_context)
+{
+   if (!var)
+      return NULL;
+
+   if (variable_context) {
+      ir_constant *value = (ir_constant *) hash_table_find(variable_context, var);
+      if (value)
+         return value;
+   }
+
+   if (var->data.mode == ir_var_uniform)
+      return NULL;
+
+   return var->constant_value;
+}
+
+/**
+ * Get an existing ir_constant with the value of an array or structure typed
+ * rvalue, or \c NULL.
+ */
+static ir_constant *
+constant_aggregate(ir_rvalue *ir, struct hash_table *variable_context)
+{
+   switch (ir->ir_type) {
+   case ir_type_constant:
+      return (ir_constant *) ir;
+
+   case ir_type_dereference_variable:
+      return constant_variable(((ir_dereference_variable *) ir)->var,
+                               variable_context);
+
+   case ir_type_dereference_array: {
+      ir_dereference_array *da = (ir_dereference_array *) ir;
+      ir_constant_data idx;
+      if (!da->array->type->is_array() ||
+          !constant_data(da->array_index, variable_context, &idx))
+         return NULL;
+      ir_constant *array = constant_aggregate(da->array, variable_context);
+      return array ? array->get_array_element(idx.u[0]) : NULL;
+   }
+
+   case ir_type_dereference_record: {
+      ir_dereference_record *dr = (ir_dereference_record *) ir;
+      ir_constant *record = constant_aggregate(dr->record, variable_context);
+      return record ? record->get_record_field(dr->field) : NULL;
+   }
+
+   default:
+      return NULL;
+   }
+}
+
+/**
+ * Evaluate a scalar, vector or matrix typed rvalue into \c data.
+ */
+static bool
+constant_data(ir_rvalue *ir, struct hash_table *variable_context,
+              ir_constant_data *data)
+{
+   switch (ir->ir_type) {
+   case ir_type_constant:
+      ((ir_constant *) ir)->get_data(data);
+      return true;
+
+   case ir_type_dereference_variable: {
+      ir_constant *value =
+         constant_variable(((ir_dereference_variable *) ir)->var,
+                           variable_context);
+      if (!value)
+         return false;
+      value->get_data(data);
+      return true;
+   }
+
+   case ir_type_swizzle: {
+      ir_swizzle *swiz = (ir_swizzle *) ir;
+      ir_constant_data v;
+      if (!constant_data(swiz->val, variable_context, &v))
+         return false;
+
+      const unsigned swiz_idx[4] = {
+         swiz->mask.x, swiz->mask.y, swiz->mask.z, swiz->mask.w
+      };
+
+      memset(data, 0, sizeof(*data));
+      for (unsigned i = 0; i < swiz->mask.num_components; i++) {
+         switch (swiz->val->type->base_type) {
+         case GLSL_TYPE_UINT:
+         case GLSL_TYPE_INT:   data->u[i] = v.u[swiz_idx[i]]; break;
+         case GLSL_TYPE_FLOAT: data->f[i] = v.f[swiz_idx[i]]; break;
+         case GLSL_TYPE_BOOL:  data->b[i] = v.b[swiz_idx[i]]; break;
+         default:              assert(!"Should not get here."); break;
+         }
+      }
+      return true;
+   }
+
+   case ir_type_dereference_array: {
+      ir_dereference_array *da = (ir_dereference_array *) ir;
+      ir_constant_data idx;
+      if (!constant_data(da->array_index, variable_context, &idx))
+         return false;
+
+      if (da->array->type->is_array()) {
+         ir_constant *array = constant_aggregate(da->array, variable_context);
+         if (!array)
+            return false;
+         array->get_array_element(idx.u[0])->get_data(data);
+         return true;
+      }
+
+      ir_constant_data array;
+      if (!constant_data(da->array, variable_context, &array))
+         return false;
+
+      /* A matrix column, or a vector component */
+      const glsl_type *const array_type = da->array->type;
+      if (idx.u[0] >= (array_type->is_matrix() ? array_type->matrix_columns :
+                       array_type->vector_elements))
+         return false;
+
+      const unsigned first = array_type->is_matrix() ?
+         idx.u[0] * array_type->vector_elements : idx.u[0];
+
+      memset(data, 0, sizeof(*data));
+      for (unsigned i = 0; i < ir->type->vector_elements; i++) {
+         switch (array_type->base_type) {
+         case GLSL_TYPE_UINT:
+         case GLSL_TYPE_INT:   data->u[i] = array.u[first + i]; break;
+         case GLSL_TYPE_FLOAT: data->f[i] = array.f[first + i]; break;
+         case GLSL_TYPE_BOOL:  data->b[i] = array.b[first + i]; break;
+         default:              assert(!"Should not get here."); break;
+         }
+      }
+      return true;
+   }
+
+   case ir_type_dereference_record: {
+      ir_dereference_record *dr = (ir_dereference_record *) ir;
+      ir_constant *record = constant_aggregate(dr->record, variable_context);
+      ir_constant *field = record ? record->get_record_field(dr->field) : NULL;
+      if (!field)
+         return false;
+      field->get_data(data);
+      return true;
+   }
+
+   case ir_type_expression: {
+      ir_expression *expr = (ir_expression *) ir;
+      ir_scratch_constant scratch[Elements(expr->operands)];
+      ir_constant *op[Elements(expr->operands)] = { NULL, };
+
+      for (unsigned i = 0; i < expr->get_num_operands(); i++) {
+         ir_rvalue *operand = expr->operands[i];
+         if (operand->type->is_array() || operand->type->is_record())
+            op[i] = constant_aggregate(operand, variable_context);
+         else
+            op[i] = operand->constant_expression_value_scratch(&scratch[i],
+                                                               variable_context);
+         if (!op[i])
+            return false;
+      }
+
+      return expr->constant_expression_evaluate(op, *data);
+   }
+
+   default:
+      return false;
+   }
+}
+
+
+ir_constant *
+ir_rvalue::constant_expression_value_scratch(ir_scratch_constant *scratch,
+                                            struct hash_table *variable_context)
+{
+   if (this->ir_type == ir_type_constant)
+      return (ir_constant *) this;
+
+   if (!this->type->is_numeric() && !this->type->is_boolean())
+      return NULL;
+
+   if (!constant_data(this, variable_context, &scratch->storage))
+      return NULL;
+
+   scratch->type = this->type;
+   return scratch;
+}
+
+
+bool
+ir_assignment::constant_expression_evaluate(struct hash_table *variable_context)
+{
+   if (this->condition) {
+      ir_scratch_constant cond_scratch;
+      ir_constant *cond =
+         this->condition->constant_expression_value_scratch(&cond_scratch,
+                                                            variable_context);
+      if (!cond)
+         return false;
+      if (!cond->get_bool_component(0))
+         return true;
+   }
+
+   ir_constant *store = NULL;
+   int offset = 0;
+
+   if (!constant_referenced(this->lhs, variable_context, store, offset))
+      return false;
+
+   if (this->lhs->type->is_array() || this->lhs->type->is_record()) {
+      ir_constant *value = constant_aggregate(this->rhs, variable_context);
+      if (!value)
+         return false;
+      if (value != store)
+         store->copy_offset(value, 0);
+      return true;
+   }
+
+   ir_scratch_constant scratch;
+   ir_constant *value =
+      this->rhs->constant_expression_value_scratch(&scratch, variable_context);
+   if (!value)
+      return false;
+
+   /* Whole matrices are assigned with an empty write mask. */
+   if (this->lhs->type->is_matrix())
+      store->copy_offset(value, offset);
+   else
+      store->copy_masked_offset(value, offset, this->write_mask);
+   return true;
+}
+
+
+namespace {
+
+/**
+ * State of a run of instructions for constant expression evaluation.
+ *
+ * The hash table represents the values of the visible variables.
+ * There are no scoping issues because the table is indexed on
+ * ir_variable pointers, not variable names.
+ */
+struct constant_interpreter {
+   struct hash_table *variable_context;
+
+   /** Context the values of declared variables are allocated off. */
+   void *mem_ctx;
+
+   /** Number of instructions left to execute before giving up. */
+   unsigned budget;
+
+   /** Value of the executed return statement, if any. */
+   ir_constant *result;
+};
+
+/** Bound on the work done evaluating a call to a built-in function. */
+const unsigned max_function_instructions = 65536;
+
+/** How control leaves a list of instructions. */
+enum constant_jump {
+   constant_jump_none,
+   constant_jump_break,
+   constant_jump_continue,
+   constant_jump_return
+};
+
+} /* anonymous namespace */
+
+static bool
+constant_evaluate_list(const exec_list &body, constant_interpreter &interp,
+                       constant_jump &jump);
+
+static bool
+constant_evaluate_loop(ir_loop *loop, constant_interpreter &interp,
+                       constant_jump &jump)
+{
+   for (;;) {
+      /* Count the iterations too, so that an empty loop terminates. */
+      if (interp.budget == 0)
+         return false;
+      interp.budget--;
+
+      constant_jump body_jump = constant_jump_none;
+      if (!constant_evaluate_list(loop->body_instructions, interp, body_jump))
+         return false;
+
+      if (body_jump == constant_jump_break)
+         return true;
+
+      if (body_jump == constant_jump_return) {
+         jump = constant_jump_return;
+         return true;
+      }
+   }
+}
+
+/**
+ * Run a list of instructions.
+ *
+ * Returns false if the expression is not constant, true otherwise; a
+ * jump out of the list is returned in \c jump.
+ */
+static bool
+constant_evaluate_list(const exec_list &body, constant_interpreter &interp,
+                       constant_jump &jump)
 {
    foreach_in_list(ir_instruction, inst, &body) {
+      if (interp.budget == 0)
+         return false;
+      interp.budget--;
+
       switch(inst->ir_type) {
 
 	 /* (declare () type symbol) */
       case ir_type_variable: {
 	 ir_variable *var = inst->as_variable();
-	 hash_table_insert(variable_context, ir_constant::zero(this, var->type), var);
+	 /* Variables declared in loop bodies keep their (undefined) value
+	  * from the previous iteration.
+	  */
+	 if (!hash_table_find(interp.variable_context, var))
+	    hash_table_insert(interp.variable_context,
+			      ir_constant::zero(interp.mem_ctx, var->type), var);
 	 break;
       }
 
 	 /* (assign [condition] (write-mask) (ref) (value)) */
-      case ir_type_assignment: {
-	 ir_assignment *asg = inst->as_assignment();
-	 if (asg->condition) {
-	    ir_constant *cond = asg->condition->constant_expression_value(variable_context);
-	    if (!cond)
-	       return false;
-	    if (!cond->get_bool_component(0))
-	       break;
-	 }
-
-	 ir_constant *store = NULL;
-	 int offset = 0;
-
-	 if (!constant_referenced(asg->lhs, variable_context, store, offset))
+      case ir_type_assignment:
+	 if (!inst->as_assignment()->constant_expression_evaluate(interp.variable_context))
 	    return false;
+	 break;
 
-	 ir_constant *value = asg->rhs->constant_expression_value(variable_context);
-
+	 /* (return (expression)) */
+      case ir_type_return: {
+	 ir_rvalue *value = inst->as_return()->value;
 	 if (!value)
 	    return false;
 
-	 store->copy_masked_offset(value, offset, asg->write_mask);
-	 break;
+	 if (value->type->is_array() || value->type->is_record()) {
+	    interp.result = constant_aggregate(value, interp.variable_context);
+	 } else {
+	    ir_scratch_constant scratch;
+	    interp.result =
+	       value->constant_expression_value_scratch(&scratch,
+							interp.variable_context);
+	    if (interp.result)
+	       interp.result = interp.result->clone(interp.mem_ctx, NULL);
+	 }
+	 jump = constant_jump_return;
+	 return interp.result != NULL;
       }
 
-	 /* (return (expression)) */
-      case ir_type_return:
-	 assert (result);
-	 *result = inst->as_return()->value->constant_expression_value(variable_context);
-	 return *result != NULL;
-
 	 /* (call name (ref) (params))*/
       case ir_type_call: {
 	 ir_call *call = inst->as_call();
@@ -1867,11 +2154,11 @@ bool ir_function_signature::constant_expression_evaluate_expression_list(const s
 	 ir_constant *store = NULL;
 	 int offset = 0;
 
-	 if (!constant_referenced(call->return_deref, variable_context,
+	 if (!constant_referenced(call->return_deref, interp.variable_context,
                                   store, offset))
 	    return false;
 
-	 ir_constant *value = call->constant_expression_value(variable_context);
+	 ir_constant *value = call->constant_expression_value(interp.variable_context);
 
 	 if(!value)
 	    return false;
@@ -1884,23 +2171,41 @@ bool ir_function_signature::constant_expression_evaluate_expression_list(const s
       case ir_type_if: {
 	 ir_if *iif = inst->as_if();
 
-	 ir_constant *cond = iif->condition->constant_expression_value(variable_context);
+	 ir_scratch_constant scratch;
+	 ir_constant *cond =
+	    iif->condition->constant_expression_value_scratch(&scratch,
+							      interp.variable_context);
 	 if (!cond || !cond->type->is_boolean())
 	    return false;
 
 	 exec_list &branch = cond->get_bool_component(0) ? iif->then_instructions : iif->else_instructions;
 
-	 *result = NULL;
-	 if (!constant_expression_evaluate_expression_list(branch, variable_context, result))
+	 if (!constant_evaluate_list(branch, interp, jump))
 	    return false;
 
-	 /* If there was a return in the branch chosen, drop out now. */
-	 if (*result)
+	 /* If there was a jump in the branch chosen, drop out now. */
+	 if (jump != constant_jump_none)
 	    return true;
 
 	 break;
       }
 
+	 /* (loop (body-instructions)) */
+      case ir_type_loop:
+	 if (!constant_evaluate_loop(inst->as_loop(), interp, jump))
+	    return false;
+
+	 if (jump != constant_jump_none)
+	    return true;
+
+	 break;
+
+	 /* (break) or (continue) */
+      case ir_type_loop_jump:
+	 jump = ((ir_loop_jump *) inst)->is_break() ?
+	    constant_jump_break : constant_jump_continue;
+	 return true;
+
 	 /* Every other expression type, we drop out. */
       default:
 	 return false;
@@ -1908,12 +2213,24 @@ bool ir_function_signature::constant_expression_evaluate_expression_list(const s
    }
 
    /* Reaching the end of the block is not an error condition */
-   if (result)
-      *result = NULL;
-
    return true;
 }
 
+
+bool
+ir_loop::constant_expression_evaluate(struct hash_table *variable_context,
+                                      void *mem_ctx, unsigned max_instructions)
+{
+   constant_interpreter interp = {
+      variable_context, mem_ctx, max_instructions, NULL
+   };
+   constant_jump jump = constant_jump_none;
+
+   /* A return from within the loop can't be replaced by its values. */
+   return constant_evaluate_loop(this, interp, jump) &&
+          jump == constant_jump_none;
+}
+
 ir_constant *
 ir_function_signature::constant_expression_value(exec_list *actual_parameters, struct hash_table *variable_context)
 {
@@ -1943,6 +2260,7 @@ ir_function_signature::constant_expression_value(exec_list *actual_parameters, s
     */
    hash_table *deref_hash = hash_table_ctor(8, hash_table_pointer_hash,
 					    hash_table_pointer_compare);
+   void *local_ctx = ralloc_context(NULL);
 
    /* If "origin" is non-NULL, then the function body is there.  So we
     * have to use the variable objects from the object with the body,
@@ -1951,27 +2269,38 @@ ir_function_signature::constant_expression_value(exec_list *actual_parameters, s
    const exec_node *parameter_info = origin ? origin->parameters.head : parameters.head;
 
    foreach_in_list(ir_rvalue, n, actual_parameters) {
-      ir_constant *constant = n->constant_expression_value(variable_context);
+      ir_scratch_constant scratch;
+      ir_constant *constant = n->type->is_array() || n->type->is_record() ?
+         constant_aggregate(n, variable_context) :
+         n->constant_expression_value_scratch(&scratch, variable_context);
       if (constant == NULL) {
+         ralloc_free(local_ctx);
          hash_table_dtor(deref_hash);
          return NULL;
       }
 
 
+      /* The body may assign its parameters; don't let it write the IR. */
       ir_variable *var = (ir_variable *)parameter_info;
-      hash_table_insert(deref_hash, constant, var);
+      hash_table_insert(deref_hash, constant->clone(local_ctx, NULL), var);
 
       parameter_info = parameter_info->next;
    }
 
+   constant_interpreter interp = {
+      deref_hash, local_ctx, max_function_instructions, NULL
+   };
+   constant_jump jump = constant_jump_none;
    ir_constant *result = NULL;
 
    /* Now run the builtin function until something non-constant
     * happens or we get the result.
     */
-   if (constant_expression_evaluate_expression_list(origin ? origin->body : body, deref_hash, &result) && result)
-      result = result->clone(ralloc_parent(this), NULL);
+   if (constant_evaluate_list(origin ? origin->body : body, interp, jump) &&
+       jump == constant_jump_return)
+      result = interp.result->clone(ralloc_parent(this), NULL);
 
+   ralloc_free(local_ctx);
    hash_table_dtor(deref_hash);
 
    return result;
@@ -0,0 +1,232 @@
+#include "ir_flatten_branches.h"
+#include "ir_stats.h"
+#include "ir_visitor.h"
+#include "glsl_types.h"
+#include "util/hash_table.h"
+
+// Both sides of an if are turned into assignments that are no-ops when
+// their side isn't taken:
+//
+//   if (c) { x = a; y = b; } else { x = d; }
+//
+// becomes
+//
+//   bool flat = c;
+//   y = flat ? b : y;
+//   x = flat ? a : d;
+//
+// The last assignments of both sides are merged into one select when they
+// write the same thing; that is right since whatever the other side does
+// in between is a no-op when the first side is taken. Variables declared
+// in the blocks only live there, so their assignments need no selects.
+
+static bool is_selectable(const glsl_type* type)
+{
+	// csel conditions need as many components as the selected values; keep
+	// to scalars and vectors
+	return type->is_scalar() || type->is_vector();
+}
+
+static bool is_local(hash_table* locals, const ir_variable* var)
+{
+	return var && _mesa_hash_table_search(locals, _mesa_hash_pointer(var), var);
+}
+
+static float select_cost(const glsl_type* type, const glslopt_cost_model* model)
+{
+	return model->weights[kGlslCostCompare] * (model->scalarALU ? type->vector_elements : 1);
+}
+
+
+namespace {
+
+// Cost of running a block unconditionally; also checks that it has nothing
+// but assignments in it.
+struct flatten_block_visitor : public ir_hierarchical_visitor {
+	flatten_block_visitor(const glslopt_cost_model* model, hash_table* locals)
+		: model(model), locals(locals), cost(0.0f), flattenable(true)
+	{
+	}
+
+	void check(exec_list* block)
+	{
+		foreach_in_list(ir_instruction, ir, block)
+		{
+			ir_variable* var = ir->as_variable();
+			if (var)
+			{
+				_mesa_hash_table_insert(locals, _mesa_hash_pointer(var), var, var);
+				continue;
+			}
+			ir_assignment* assign = ir->as_assignment();
+			if (!assign || assign->condition || !is_selectable(assign->lhs->type))
+			{
+				flattenable = false;
+				return;
+			}
+			if (assign->accept(this) == visit_stop)
+				return;
+			if (!is_local(locals, assign->lhs->variable_referenced()))
+				cost += select_cost(assign->rhs->type, model);
+			else if (!assign->rhs->as_expression() && !assign->rhs->as_texture())
+				cost += model->weights[kGlslCostMove] * (model->scalarALU ? assign->rhs->type->vector_elements : 1);
+		}
+	}
+
+	virtual ir_visitor_status visit_leave(ir_expression* ir)
+	{
+		cost += expression_cost(ir, model);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_texture*)
+	{
+		// fetches that aren't needed still cost bandwidth and latency, which
+		// the ALU cost doesn't capture
+		flattenable = false;
+		return visit_stop;
+	}
+	virtual ir_visitor_status visit_leave(ir_dereference_array* ir)
+	{
+		// same for dynamically indexed reads, and the index could be out of
+		// bounds on the side that isn't taken
+		if (ir->array_index->as_constant())
+			return visit_continue;
+		flattenable = false;
+		return visit_stop;
+	}
+
+	const glslopt_cost_model* model;
+	hash_table* locals;
+	float cost;
+	bool flattenable;
+};
+
+
+struct ir_flatten_branches_visitor : public ir_hierarchical_visitor {
+	ir_flatten_branches_visitor(const glslopt_cost_model* model, float maxCost)
+		: model(model), maxCost(maxCost), progress(false)
+	{
+	}
+
+	// Nested ifs are done first, so that the outer ones see only their
+	// flattened assignments.
+	virtual ir_visitor_status visit_leave(ir_if* ir);
+
+	void move_block(ir_if* ir, exec_list* block, ir_variable* cond, bool then_side, ir_assignment* skip, hash_table* locals);
+
+	const glslopt_cost_model* model;
+	float maxCost;
+	bool progress;
+};
+
+} // anonymous namespace
+
+
+static ir_rvalue* broadcast_condition(void* mem_ctx, ir_variable* cond, const glsl_type* type)
+{
+	ir_rvalue* deref = new(mem_ctx) ir_dereference_variable(cond);
+	if (type->vector_elements == 1)
+		return deref;
+	return new(mem_ctx) ir_swizzle(deref, 0, 0, 0, 0, type->vector_elements);
+}
+
+// Value the assignment leaves in the components it writes, before it runs
+static ir_rvalue* previous_value(void* mem_ctx, ir_assignment* assign)
+{
+	ir_rvalue* lhs = assign->lhs->clone(mem_ctx, NULL);
+	if (assign->rhs->type->vector_elements == lhs->type->vector_elements)
+		return lhs;
+
+	unsigned components[4];
+	unsigned count = 0;
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		if (assign->write_mask & (1 << i))
+			components[count++] = i;
+	}
+	return new(mem_ctx) ir_swizzle(lhs, components, count);
+}
+
+static ir_rvalue* make_select(void* mem_ctx, ir_variable* cond, ir_rvalue* ifTrue, ir_rvalue* ifFalse)
+{
+	return new(mem_ctx) ir_expression(ir_triop_csel, broadcast_condition(mem_ctx, cond, ifTrue->type), ifTrue, ifFalse);
+}
+
+void ir_flatten_branches_visitor::move_block(ir_if* ir, exec_list* block, ir_variable* cond, bool then_side, ir_assignment* skip, hash_table* locals)
+{
+	void* mem_ctx = ralloc_parent(ir);
+	foreach_in_list_safe(ir_instruction, node, block)
+	{
+		node->remove();
+		if (node == skip)
+			continue;
+		ir_assignment* assign = node->as_assignment();
+		if (assign && !is_local(locals, assign->lhs->variable_referenced()))
+		{
+			ir_rvalue* previous = previous_value(mem_ctx, assign);
+			if (then_side)
+				assign->rhs = make_select(mem_ctx, cond, assign->rhs, previous);
+			else
+				assign->rhs = make_select(mem_ctx, cond, previous, assign->rhs);
+		}
+		ir->insert_before(node);
+	}
+}
+
+// Last instruction of a block, if it's an assignment to something declared
+// outside of it
+static ir_assignment* last_outer_assignment(exec_list* block, hash_table* locals)
+{
+	ir_instruction* last = (ir_instruction*)block->get_tail();
+	ir_assignment* assign = last ? last->as_assignment() : NULL;
+	if (!assign || is_local(locals, assign->lhs->variable_referenced()))
+		return NULL;
+	return assign;
+}
+
+ir_visitor_status ir_flatten_branches_visitor::visit_leave(ir_if* ir)
+{
+	hash_table* locals = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+	flatten_block_visitor block(model, locals);
+	block.check(&ir->then_instructions);
+	if (block.flattenable)
+		block.check(&ir->else_instructions);
+
+	if (!block.flattenable || block.cost > maxCost)
+	{
+		_mesa_hash_table_destroy(locals, NULL);
+		return visit_continue;
+	}
+
+	void* mem_ctx = ralloc_parent(ir);
+	ir_variable* cond = new(mem_ctx) ir_variable(glsl_type::bool_type, "flat_cond", ir_var_temporary, glsl_precision_low);
+	ir->insert_before(cond);
+	ir->insert_before(new(mem_ctx) ir_assignment(new(mem_ctx) ir_dereference_variable(cond), ir->condition));
+
+	ir_assignment* lastThen = last_outer_assignment(&ir->then_instructions, locals);
+	ir_assignment* lastElse = last_outer_assignment(&ir->else_instructions, locals);
+	const bool merge = lastThen && lastElse &&
+		lastThen->write_mask == lastElse->write_mask &&
+		lastThen->lhs->equals(lastElse->lhs);
+
+	move_block(ir, &ir->then_instructions, cond, true, merge ? lastThen : NULL, locals);
+	move_block(ir, &ir->else_instructions, cond, false, merge ? lastElse : NULL, locals);
+	if (merge)
+	{
+		lastElse->rhs = make_select(mem_ctx, cond, lastThen->rhs, lastElse->rhs);
+		ir->insert_before(lastElse);
+	}
+
+	ir->remove();
+	_mesa_hash_table_destroy(locals, NULL);
+	progress = true;
+	return visit_continue;
+}
+
+
+bool flatten_branches(exec_list* instructions, const glslopt_cost_model* model, float maxCost)
+{
+	ir_flatten_branches_visitor v(model, maxCost);
+	v.run(instructions);
+	return v.progress;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#ifndef IR_FLATTEN_BRANCHES_H
+#define IR_FLATTEN_BRANCHES_H
+
+#include "ir.h"
+#include "glsl_optimizer.h"
+
+// Turns if/else blocks made of nothing but assignments into unconditional
+// code, with selects (c ? a : b) picking the values to keep. Both sides run,
+// so only blocks costing up to maxCost together (as per the cost model) are
+// flattened, and never ones with texture fetches.
+// Returns true if anything was flattened.
+bool flatten_branches(exec_list* instructions, const glslopt_cost_model* model, float maxCost);
+
+#endif /* IR_FLATTEN_BRANCHES_H */
@@ -0,0 +1,384 @@
+#include "ir_hoist_varyings.h"
+#include "ir_rvalue_visitor.h"
+#include "glsl_types.h"
+#include "program/hash_table.h"
+
+static bool is_builtin(const ir_variable* var)
+{
+	return strncmp(var->name, "gl_", 3) == 0;
+}
+
+static ir_variable* find_global(exec_list* ir, const char* name)
+{
+	foreach_in_list(ir_instruction, node, ir)
+	{
+		ir_variable* var = node->as_variable();
+		if (var && !strcmp(var->name, name))
+			return var;
+	}
+	return NULL;
+}
+
+static void add_global(exec_list* ir, ir_variable* var)
+{
+	// declare it along with the other globals, before any function
+	foreach_in_list(ir_instruction, node, ir)
+	{
+		if (node->as_function())
+		{
+			node->insert_before(var);
+			return;
+		}
+	}
+	ir->push_tail(var);
+}
+
+static int count_input_vectors(exec_list* ir)
+{
+	int count = 0;
+	foreach_in_list(ir_instruction, node, ir)
+	{
+		ir_variable* var = node->as_variable();
+		if (var && var->data.mode == ir_var_shader_in && !is_builtin(var))
+			count += var->type->count_attribute_slots();
+	}
+	return count;
+}
+
+static ir_function_signature* find_main(exec_list* ir)
+{
+	foreach_in_list(ir_instruction, node, ir)
+	{
+		ir_function* func = node->as_function();
+		if (!func || strcmp(func->name, "main") != 0)
+			continue;
+		foreach_in_list(ir_function_signature, sig, &func->signatures)
+		{
+			if (sig->is_defined)
+				return sig;
+		}
+	}
+	return NULL;
+}
+
+struct find_return_visitor : public ir_hierarchical_visitor {
+	find_return_visitor()
+		: found(false)
+	{
+	}
+
+	virtual ir_visitor_status visit_enter(ir_return*)
+	{
+		found = true;
+		return visit_stop;
+	}
+
+	bool found;
+};
+
+
+// How an rvalue depends on the fragment shader inputs
+enum affine_kind {
+	kAffineNone = 0, // only constants and uniforms
+	kAffineLinear, // affine function of inputs
+	kAffineOther, // anything else, can't be moved
+};
+
+struct varying_hoister {
+	varying_hoister(exec_list* vertexIR, exec_list* fragmentIR, ir_function_signature* vertexMain, int freeVectors)
+		: vertexIR(vertexIR), fragmentIR(fragmentIR), vertexMain(vertexMain), freeVectors(freeVectors), counter(0), progress(false)
+	{
+		// keyed by fragment shader globals and the varyings we add; clone()
+		// takes a fixed-size table, so size it for all of them up front
+		unsigned numVars = freeVectors > 0 ? freeVectors : 0;
+		foreach_in_list(ir_instruction, node, fragmentIR)
+			if (node->as_variable())
+				numVars++;
+		vars = hash_table_ctor(numVars, hash_table_pointer_hash, hash_table_pointer_compare);
+	}
+	~varying_hoister()
+	{
+		hash_table_dtor(vars);
+	}
+
+	void map_inputs();
+	affine_kind classify(ir_rvalue* ir);
+	void try_hoist(ir_rvalue** rvalue);
+	ir_variable* add_varying(ir_expression* expr);
+	void map_uniforms(ir_rvalue* ir);
+
+	exec_list* vertexIR;
+	exec_list* fragmentIR;
+	ir_function_signature* vertexMain;
+	// Fragment shader variables -> vertex shader ones
+	hash_table* vars;
+	// Expressions moved so far (as assignments to their fragment shader inputs)
+	exec_list hoisted;
+	int freeVectors;
+	int counter;
+	bool progress;
+};
+
+// Inputs that are smoothly interpolated from matching vertex shader outputs
+void varying_hoister::map_inputs()
+{
+	foreach_in_list(ir_instruction, node, fragmentIR)
+	{
+		ir_variable* var = node->as_variable();
+		if (!var || var->data.mode != ir_var_shader_in || is_builtin(var))
+			continue;
+		// new varyings are smooth, so only smooth inputs combine into them
+		if (!var->type->is_float() || var->data.centroid || var->data.sample)
+			continue;
+		if (var->data.interpolation != INTERP_QUALIFIER_NONE && var->data.interpolation != INTERP_QUALIFIER_SMOOTH)
+			continue;
+		ir_variable* out = find_global(vertexIR, var->name);
+		if (out && out->data.mode == ir_var_shader_out && out->type == var->type)
+			hash_table_insert(vars, out, var);
+	}
+}
+
+affine_kind varying_hoister::classify(ir_rvalue* ir)
+{
+	switch (ir->ir_type)
+	{
+	case ir_type_constant:
+		return kAffineNone;
+
+	case ir_type_dereference_variable:
+	{
+		ir_variable* var = ((ir_dereference_variable*)ir)->var;
+		if (var->data.mode == ir_var_uniform && !var->type->contains_sampler() && !is_builtin(var))
+		{
+			// the vertex shader gets the uniform if it does not have it yet
+			ir_variable* other = find_global(vertexIR, var->name);
+			if (other && (other->data.mode != ir_var_uniform || other->type != var->type))
+				return kAffineOther;
+			return kAffineNone;
+		}
+		return hash_table_find(vars, var) ? kAffineLinear : kAffineOther;
+	}
+
+	case ir_type_dereference_array:
+	{
+		// uniform arrays indexed by constants
+		ir_dereference_array* deref = (ir_dereference_array*)ir;
+		if (classify(deref->array) != kAffineNone || !deref->array_index->as_constant())
+			return kAffineOther;
+		return kAffineNone;
+	}
+
+	case ir_type_swizzle:
+		return classify(((ir_swizzle*)ir)->val);
+
+	case ir_type_expression:
+		break;
+
+	default:
+		return kAffineOther;
+	}
+
+	ir_expression* expr = (ir_expression*)ir;
+	if (expr->type->base_type != GLSL_TYPE_FLOAT)
+	{
+		// integer or bool math is fine as long as it only involves uniforms
+		for (unsigned i = 0; i < expr->get_num_operands(); ++i)
+			if (classify(expr->operands[i]) != kAffineNone)
+				return kAffineOther;
+		return kAffineNone;
+	}
+
+	affine_kind kinds[4];
+	bool linear = false;
+	for (unsigned i = 0; i < expr->get_num_operands(); ++i)
+	{
+		kinds[i] = classify(expr->operands[i]);
+		if (kinds[i] == kAffineOther)
+			return kAffineOther;
+		linear |= kinds[i] == kAffineLinear;
+	}
+	if (!linear)
+	{
+		switch (expr->operation)
+		{
+		case ir_unop_dFdx: case ir_unop_dFdx_coarse: case ir_unop_dFdx_fine:
+		case ir_unop_dFdy: case ir_unop_dFdy_coarse: case ir_unop_dFdy_fine:
+			return kAffineOther;
+		default:
+			return kAffineNone;
+		}
+	}
+
+	switch (expr->operation)
+	{
+	case ir_unop_neg:
+	case ir_binop_add:
+	case ir_binop_sub:
+		return kAffineLinear;
+	case ir_binop_mul:
+	case ir_binop_dot:
+		// products of two inputs are not linear any more
+		return kinds[0] == kAffineLinear && kinds[1] == kAffineLinear ? kAffineOther : kAffineLinear;
+	case ir_binop_div:
+		return kinds[1] == kAffineNone ? kAffineLinear : kAffineOther;
+	case ir_triop_lrp:
+		// lerp between inputs by a uniform factor
+		return kinds[2] == kAffineNone ? kAffineLinear : kAffineOther;
+	default:
+		return kAffineOther;
+	}
+}
+
+// Vertex shader uniforms to read where the fragment shader ones are read
+struct map_uniforms_visitor : public ir_hierarchical_visitor {
+	map_uniforms_visitor(varying_hoister* hoister)
+		: hoister(hoister)
+	{
+	}
+
+	virtual ir_visitor_status visit(ir_dereference_variable* ir)
+	{
+		ir_variable* var = ir->var;
+		if (hash_table_find(hoister->vars, var))
+			return visit_continue;
+		ir_variable* uniform = find_global(hoister->vertexIR, var->name);
+		if (!uniform)
+		{
+			uniform = var->clone(ralloc_parent(hoister->vertexMain), NULL);
+			add_global(hoister->vertexIR, uniform);
+		}
+		hash_table_insert(hoister->vars, uniform, var);
+		return visit_continue;
+	}
+
+	varying_hoister* hoister;
+};
+
+ir_variable* varying_hoister::add_varying(ir_expression* expr)
+{
+	char name[32];
+	do {
+		snprintf(name, sizeof(name), "xlv_hoist%d", counter++);
+	} while (find_global(fragmentIR, name) || find_global(vertexIR, name));
+
+	glsl_precision prec = expr->get_precision();
+	if (prec == glsl_precision_undefined)
+		prec = glsl_precision_high;
+
+	void* fsCtx = ralloc_parent(expr);
+	ir_variable* input = new(fsCtx) ir_variable(expr->type, name, ir_var_shader_in, prec);
+	input->data.read_only = true;
+	add_global(fragmentIR, input);
+
+	void* vsCtx = ralloc_parent(vertexMain);
+	ir_variable* output = new(vsCtx) ir_variable(expr->type, name, ir_var_shader_out, prec);
+	add_global(vertexIR, output);
+
+	// computed at the end of the vertex shader, once all outputs it reads
+	// are written
+	map_uniforms_visitor uniforms(this);
+	expr->accept(&uniforms);
+	ir_rvalue* value = expr->clone(vsCtx, vars);
+	vertexMain->body.push_tail(new(vsCtx) ir_assignment(new(vsCtx) ir_dereference_variable(output), value));
+
+	hash_table_insert(vars, output, input);
+	hoisted.push_tail(new(fsCtx) ir_assignment(new(fsCtx) ir_dereference_variable(input), expr));
+	freeVectors -= expr->type->count_attribute_slots();
+	return input;
+}
+
+void varying_hoister::try_hoist(ir_rvalue** rvalue)
+{
+	ir_expression* expr = *rvalue ? (*rvalue)->as_expression() : NULL;
+	if (!expr || !expr->type->is_float() || classify(expr) != kAffineLinear)
+		return;
+
+	ir_variable* input = NULL;
+	foreach_in_list(ir_assignment, prev, &hoisted)
+	{
+		if (prev->rhs->equals(expr))
+		{
+			input = prev->lhs->variable_referenced();
+			break;
+		}
+	}
+	if (!input)
+	{
+		if (freeVectors < (int)expr->type->count_attribute_slots())
+			return;
+		input = add_varying(expr);
+	}
+	*rvalue = new(ralloc_parent(expr)) ir_dereference_variable(input);
+	progress = true;
+}
+
+struct texcoord_hoisting_visitor : public ir_hierarchical_visitor {
+	texcoord_hoisting_visitor(varying_hoister* hoister)
+		: hoister(hoister)
+	{
+	}
+
+	virtual ir_visitor_status visit_enter(ir_texture* ir)
+	{
+		hoister->try_hoist(&ir->coordinate);
+		return visit_continue;
+	}
+
+	varying_hoister* hoister;
+};
+
+struct varying_hoisting_visitor : public ir_rvalue_enter_visitor {
+	varying_hoisting_visitor(varying_hoister* hoister)
+		: hoister(hoister)
+	{
+	}
+
+	virtual void handle_rvalue(ir_rvalue** rvalue)
+	{
+		hoister->try_hoist(rvalue);
+	}
+
+	varying_hoister* hoister;
+};
+
+
+bool hoist_varying_math(exec_list* vertexIR, exec_list* fragmentIR, int maxVaryings)
+{
+	const int freeVectors = maxVaryings - count_input_vectors(fragmentIR);
+	if (freeVectors <= 0)
+		return false;
+
+	ir_function_signature* vertexMain = find_main(vertexIR);
+	if (!vertexMain)
+		return false;
+	find_return_visitor returns;
+	vertexMain->accept(&returns);
+	if (returns.found)
+		return false;
+
+	varying_hoister hoister(vertexIR, fragmentIR, vertexMain, freeVectors);
+	hoister.map_inputs();
+
+	texcoord_hoisting_visitor texcoords(&hoister);
+	texcoords.run(fragmentIR);
+	varying_hoisting_visitor others(&hoister);
+	others.run(fragmentIR);
+	return hoister.progress;
+}
+
+bool remove_unread_varyings(exec_list* vertexIR, exec_list* fragmentIR)
+{
+	bool progress = false;
+	foreach_in_list(ir_instruction, node, vertexIR)
+	{
+		ir_variable* var = node->as_variable();
+		if (!var || var->data.mode != ir_var_shader_out || is_builtin(var))
+			continue;
+		ir_variable* input = find_global(fragmentIR, var->name);
+		if (input && input->data.mode == ir_var_shader_in)
+			continue;
+		var->data.mode = ir_var_auto;
+		progress = true;
+	}
+	return progress;
+}
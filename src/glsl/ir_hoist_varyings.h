@@ -0,0 +1,20 @@
+#pragma once
+#ifndef IR_HOIST_VARYINGS_H
+#define IR_HOIST_VARYINGS_H
+
+#include "ir.h"
+
+// Replaces affine math on fragment shader inputs (like uv * _Tiling + _Offset)
+// with new inputs, computed by the vertex shader and interpolated. Texture
+// coordinates are done first, as that also turns dependent texture reads into
+// independent ones. New varyings are only added while the fragment shader
+// has less than maxVaryings input vectors. Both shaders must be linked and
+// optimized. Returns true if anything was moved.
+bool hoist_varying_math(exec_list* vertexIR, exec_list* fragmentIR, int maxVaryings);
+
+// Turns vertex shader outputs that the fragment shader does not read into
+// plain globals, for dead code removal to take care of. Returns true if
+// there were any.
+bool remove_unread_varyings(exec_list* vertexIR, exec_list* fragmentIR);
+
+#endif /* IR_HOIST_VARYINGS_H */
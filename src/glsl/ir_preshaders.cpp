@@ -0,0 +1,133 @@
+#include "ir_preshaders.h"
+#include "ir_rvalue_visitor.h"
+#include "glsl_types.h"
+
+static bool is_preshader_input(const ir_variable* var)
+{
+	// built-in uniforms are set by GL, the caller might not know their values
+	return var->data.mode == ir_var_uniform && !var->type->is_sampler() && strncmp(var->name, "gl_", 3) != 0;
+}
+
+// Checks that an expression only reads uniforms the caller knows; texture
+// fetches can't be done up front.
+struct uniform_only_visitor : public ir_hierarchical_visitor {
+	uniform_only_visitor()
+		: uniformOnly(true), readsUniforms(false)
+	{
+	}
+
+	virtual ir_visitor_status visit(ir_dereference_variable* ir)
+	{
+		if (!is_preshader_input(ir->var))
+		{
+			uniformOnly = false;
+			return visit_stop;
+		}
+		readsUniforms = true;
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_enter(ir_texture*)
+	{
+		uniformOnly = false;
+		return visit_stop;
+	}
+
+	bool uniformOnly;
+	bool readsUniforms;
+};
+
+struct preshader_visitor : public ir_rvalue_enter_visitor {
+	preshader_visitor(exec_list* instructions, exec_list* preshaders, const char* prefix)
+		: instructions(instructions), preshaders(preshaders), prefix(prefix), counter(0), progress(false)
+	{
+	}
+
+	virtual void handle_rvalue(ir_rvalue** rvalue);
+	ir_variable* new_uniform(ir_expression* expr);
+	bool name_in_use(const char* name) const;
+
+	exec_list* instructions;
+	exec_list* preshaders;
+	const char* prefix;
+	int counter;
+	bool progress;
+};
+
+bool preshader_visitor::name_in_use(const char* name) const
+{
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_variable* var = node->as_variable();
+		if (var && !strcmp(var->name, name))
+			return true;
+	}
+	return false;
+}
+
+ir_variable* preshader_visitor::new_uniform(ir_expression* expr)
+{
+	void* mem_ctx = ralloc_parent(expr);
+	char* name;
+	do {
+		name = ralloc_asprintf(mem_ctx, "%s%d", prefix, counter++);
+	} while (name_in_use(name));
+
+	glsl_precision prec = expr->get_precision();
+	if (prec == glsl_precision_undefined && expr->type->base_type == GLSL_TYPE_FLOAT)
+		prec = glsl_precision_high;
+	ir_variable* var = new(mem_ctx) ir_variable(expr->type, name, ir_var_uniform, prec);
+	var->data.read_only = true;
+
+	// declare it along with the other globals, before any function
+	ir_instruction* insertPoint = NULL;
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		if (node->as_function())
+		{
+			insertPoint = node;
+			break;
+		}
+	}
+	if (insertPoint)
+		insertPoint->insert_before(var);
+	else
+		instructions->push_tail(var);
+	return var;
+}
+
+void preshader_visitor::handle_rvalue(ir_rvalue** rvalue)
+{
+	ir_expression* expr = *rvalue ? (*rvalue)->as_expression() : NULL;
+	if (!expr)
+		return;
+
+	uniform_only_visitor check;
+	expr->accept(&check);
+	if (!check.uniformOnly || !check.readsUniforms)
+		return;
+
+	ir_variable* var = NULL;
+	foreach_in_list(ir_assignment, pre, preshaders)
+	{
+		if (pre->rhs->equals(expr))
+		{
+			var = pre->lhs->variable_referenced();
+			break;
+		}
+	}
+	void* mem_ctx = ralloc_parent(expr);
+	if (!var)
+	{
+		var = new_uniform(expr);
+		preshaders->push_tail(new(mem_ctx) ir_assignment(new(mem_ctx) ir_dereference_variable(var), expr));
+	}
+	*rvalue = new(mem_ctx) ir_dereference_variable(var);
+	progress = true;
+}
+
+bool extract_preshaders(exec_list* instructions, exec_list* outPreshaders, const char* namePrefix)
+{
+	preshader_visitor v(instructions, outPreshaders, namePrefix);
+	v.run(instructions);
+	return v.progress;
+}
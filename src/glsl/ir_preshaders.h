@@ -0,0 +1,15 @@
+#pragma once
+#ifndef IR_PRESHADERS_H
+#define IR_PRESHADERS_H
+
+#include "ir.h"
+
+// Replaces the largest expressions that only read uniforms (and constants) with
+// new uniforms, so that the caller can compute them once per draw call. For each
+// new uniform, an assignment of the expression it stands for is added to
+// outPreshaders; identical expressions share a uniform. Returns true if anything
+// was replaced. New uniforms are named namePrefix followed by a number; give each
+// shader stage its own prefix so that linked stages don't declare the same name.
+bool extract_preshaders(exec_list* instructions, exec_list* outPreshaders, const char* namePrefix);
+
+#endif /* IR_PRESHADERS_H */
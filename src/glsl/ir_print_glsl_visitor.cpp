@@ -153,7 +153,17 @@ _mesa_print_ir_glsl(exec_list *instructions,
 	    struct _mesa_glsl_parse_state *state,
 		char* buffer, PrintGlslMode mode)
 {
-	string_buffer str(buffer);
+	string_buffer str(buffer, _mesa_print_ir_size_hint(instructions));
+	_mesa_print_ir_glsl(instructions, state, str, mode);
+	return str.release();
+}
+
+
+void
+_mesa_print_ir_glsl(exec_list *instructions,
+	    struct _mesa_glsl_parse_state *state,
+		string_buffer& str, PrintGlslMode mode)
+{
 
 	// print version & extensions
 	if (state) {
@@ -196,7 +206,7 @@ _mesa_print_ir_glsl(exec_list *instructions,
 	{
 		if (ir->ir_type == ir_type_variable) {
 			ir_variable *var = static_cast<ir_variable*>(ir);
-			if ((strstr(var->name, "gl_") == var->name)
+			if ((strncmp(var->name, "gl_", 3) == 0)
 			  && !var->data.invariant)
 				continue;
 		}
@@ -210,8 +220,51 @@ _mesa_print_ir_glsl(exec_list *instructions,
 	}
 	
 	delete ls;
+}
+
 
-	return ralloc_strdup(buffer, str.c_str());
+void
+_mesa_print_rvalue_glsl(ir_rvalue *ir,
+	    struct _mesa_glsl_parse_state *state,
+		string_buffer& str)
+{
+	global_print_tracker gtracker;
+	ir_print_glsl_visitor v (str, &gtracker, kPrintGlslNone, false, state);
+	ir->accept(&v);
+}
+
+
+namespace {
+
+class ir_count_visitor : public ir_hierarchical_visitor {
+public:
+	ir_count_visitor() : count(0) {}
+
+	virtual ir_visitor_status visit(ir_variable *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit(ir_constant *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit(ir_dereference_variable *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_expression *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_swizzle *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_assignment *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_call *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_texture *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_if *) { ++count; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_loop *) { ++count; return visit_continue; }
+
+	size_t count;
+};
+
+} // anonymous namespace
+
+
+size_t
+_mesa_print_ir_size_hint(exec_list *instructions)
+{
+	// Printed GLSL takes about 10 characters per IR node, and rarely over 15;
+	// round up so that shaders print without growing the buffer.
+	ir_count_visitor v;
+	v.run(instructions);
+	return 256 + v.count * 16;
 }
 
 
@@ -307,9 +360,13 @@ void ir_print_glsl_visitor::print_precision (ir_instruction* ir, const glsl_type
 			return;
 	}
 	
-	if (prec == glsl_precision_high || prec == glsl_precision_undefined)
+	// highp is the default for function return types in vertex shaders only;
+	// fragment shaders have no (or a lower) default float precision
+	if (ir->ir_type == ir_type_function_signature)
 	{
-		if (ir->ir_type == ir_type_function_signature)
+		if (prec == glsl_precision_undefined)
+			return;
+		if (prec == glsl_precision_high && this->state->stage != MESA_SHADER_FRAGMENT)
 			return;
 	}
 	buffer.asprintf_append ("%s", get_precision_string(prec));
@@ -391,7 +448,7 @@ void ir_print_glsl_visitor::visit(ir_variable *ir)
 	}
 	
 	// keep invariant declaration for builtin variables
-	if (strstr(ir->name, "gl_") == ir->name) {
+	if (strncmp(ir->name, "gl_", 3) == 0) {
 		buffer.asprintf_append ("%s", inv);
 		print_var_name (ir);
 		return;
@@ -638,6 +695,16 @@ static bool is_binop_func_like(ir_expression_operation op, const glsl_type* type
 	return false;
 }
 
+// Selects are printed as the ?: operator, which takes a single bool; vector
+// selects have it broadcast by a swizzle.
+static ir_rvalue* select_condition(ir_expression* ir)
+{
+	ir_swizzle* swizzle = ir->operands[0]->as_swizzle();
+	if (swizzle && swizzle->val->type->is_scalar())
+		return swizzle->val;
+	return ir->operands[0];
+}
+
 void ir_print_glsl_visitor::visit(ir_expression *ir)
 {
 	++this->expression_depth;
@@ -704,6 +771,31 @@ void ir_print_glsl_visitor::visit(ir_expression *ir)
 			ir->operands[1]->accept(this);
 		buffer.asprintf_append (")");
 	}
+	else if (ir->operation == ir_triop_csel)
+	{
+		ir_rvalue* cond = select_condition(ir);
+		if (cond->type->is_scalar())
+		{
+			buffer.asprintf_append ("(");
+			cond->accept(this);
+			buffer.asprintf_append (" ? ");
+			ir->operands[1]->accept(this);
+			buffer.asprintf_append (" : ");
+			ir->operands[2]->accept(this);
+			buffer.asprintf_append (")");
+		}
+		else
+		{
+			// per component select; ?: needs a scalar condition
+			buffer.asprintf_append ("mix (");
+			ir->operands[2]->accept(this);
+			buffer.asprintf_append (", ");
+			ir->operands[1]->accept(this);
+			buffer.asprintf_append (", ");
+			cond->accept(this);
+			buffer.asprintf_append (")");
+		}
+	}
 	else
 	{
 		// ternary op
@@ -1230,13 +1322,11 @@ void ir_print_glsl_visitor::visit(ir_constant *ir)
 	 ir->get_array_element(i)->accept(this);
       }
    } else if (ir->type->is_record()) {
-      bool first = true;
-      foreach_in_list(ir_constant, inst, &ir->components) {
-	 if (!first)
+      for (unsigned i = 0; i < ir->type->length; i++) {
+	 if (i != 0)
 	    buffer.asprintf_append (", ");
-	 first = false;
-	 inst->accept(this);
-     } 
+	 ir->const_elements[i]->accept(this);
+      }
    }else {
       bool first = true;
       for (unsigned i = 0; i < ir->type->components(); i++) {
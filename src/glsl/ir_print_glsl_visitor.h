@@ -34,21 +34,38 @@ enum PrintGlslMode {
 	kPrintGlslFragment,
 };
 
+class string_buffer;
+
 extern char* _mesa_print_ir_glsl(exec_list *instructions,
 			struct _mesa_glsl_parse_state *state,
 			char* buf, PrintGlslMode mode);
+extern void _mesa_print_ir_glsl(exec_list *instructions,
+			struct _mesa_glsl_parse_state *state,
+			string_buffer& out, PrintGlslMode mode);
+
+// Prints a single expression, without precision qualifiers.
+extern void _mesa_print_rvalue_glsl(ir_rvalue *ir,
+			struct _mesa_glsl_parse_state *state,
+			string_buffer& out);
+
+// Rough guess of how long printed IR will be, for sizing output buffers.
+extern size_t _mesa_print_ir_size_hint(exec_list *instructions);
 
 
+// Called with consecutive pieces of a string_buffer's contents.
+typedef void (*string_buffer_writer)(const char* data, size_t size, void* user_data);
 
 class string_buffer
 {
 public:
-	string_buffer(void* mem_ctx)
+	string_buffer(void* mem_ctx, size_t capacity = 512)
 	{
-		m_Capacity = 512;
+		m_Capacity = MAX2 (capacity, (size_t)2);
 		m_Ptr = (char*)ralloc_size(mem_ctx, m_Capacity);
 		m_Size = 0;
 		m_Ptr[0] = 0;
+		m_Writer = NULL;
+		m_WriterData = NULL;
 	}
 	
 	~string_buffer()
@@ -56,10 +73,63 @@ public:
 		ralloc_free(m_Ptr);
 	}
 	
+	// With a writer set, the buffer only holds what was not written yet; it
+	// is passed on to the writer whenever the buffer would have to grow, and
+	// on flush().
+	void set_writer(string_buffer_writer writer, void* user_data)
+	{
+		m_Writer = writer;
+		m_WriterData = user_data;
+	}
+	
+	void flush()
+	{
+		if (m_Writer && m_Size)
+			m_Writer(m_Ptr, m_Size, m_WriterData);
+		m_Size = 0;
+		m_Ptr[0] = 0;
+	}
+	
 	bool empty() const { return m_Size == 0; }
 	
+	size_t size() const { return m_Size; }
+	
 	const char* c_str() const { return m_Ptr; }
 	
+	// Hands over the string (allocated off the buffer's mem_ctx) to the
+	// caller, leaving the buffer unusable.
+	char* release()
+	{
+		char* ptr = m_Ptr;
+		m_Ptr = NULL;
+		return ptr;
+	}
+	
+	void append(const char* data, size_t size)
+	{
+		assert (m_Ptr != NULL);
+		
+		if (m_Writer && m_Size + size + 1 > m_Capacity)
+		{
+			flush();
+			// big pieces go to the writer as they are
+			if (size + 1 > m_Capacity)
+			{
+				m_Writer(data, size, m_WriterData);
+				return;
+			}
+		}
+		reserve(size);
+		memcpy(m_Ptr + m_Size, data, size);
+		m_Size += size;
+		m_Ptr[m_Size] = 0;
+	}
+	
+	void append(const string_buffer& other)
+	{
+		append(other.m_Ptr, other.m_Size);
+	}
+	
 	void asprintf_append(const char *fmt, ...) PRINTFLIKE(2, 3)
 	{
 		va_list args;
@@ -79,23 +149,32 @@ public:
 		assert (m_Ptr != NULL);
 		
 		size_t new_length = printf_length(fmt, args);
-		size_t needed_length = m_Size + new_length + 1;
+		if (m_Writer && m_Size + new_length + 1 > m_Capacity)
+			flush();
+		reserve(new_length);
+		
+		vsnprintf(m_Ptr + m_Size, new_length+1, fmt, args);
+		m_Size += new_length;
+		assert (m_Capacity >= m_Size);
+	}
+	
+private:
+	void reserve(size_t length)
+	{
+		size_t needed_length = m_Size + length + 1;
 		
 		if (m_Capacity < needed_length)
 		{
 			m_Capacity = MAX2 (m_Capacity + m_Capacity/2, needed_length);
 			m_Ptr = (char*)reralloc_size(ralloc_parent(m_Ptr), m_Ptr, m_Capacity);
 		}
-		
-		vsnprintf(m_Ptr + m_Size, new_length+1, fmt, args);
-		m_Size += new_length;
-		assert (m_Capacity >= m_Size);
 	}
 	
-private:
 	char* m_Ptr;
 	size_t m_Size;
 	size_t m_Capacity;
+	string_buffer_writer m_Writer;
+	void* m_WriterData;
 };
 
 
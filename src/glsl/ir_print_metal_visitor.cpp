@@ -29,6 +29,7 @@
 #include "loop_analysis.h"
 #include "program/hash_table.h"
 #include <math.h>
+#include <limits>
 
 
 static void print_type(string_buffer& buffer, ir_instruction* ir, const glsl_type *t, bool arraySize);
@@ -91,14 +92,14 @@ struct global_print_tracker_metal
 
 struct metal_print_context
 {
-	metal_print_context(char* buffer)
-	: str(buffer)
-	, prefixStr(ralloc_strdup(buffer, ""))
-	, inputStr(ralloc_strdup(buffer, ""))
-	, outputStr(ralloc_strdup(buffer, ""))
-	, inoutStr(ralloc_strdup(buffer, ""))
-	, uniformStr(ralloc_strdup(buffer, ""))
-	, paramsStr(ralloc_strdup(buffer, ""))
+	metal_print_context(void* mem_ctx, size_t size_hint)
+	: str(mem_ctx, size_hint)
+	, prefixStr(mem_ctx)
+	, inputStr(mem_ctx)
+	, outputStr(mem_ctx)
+	, inoutStr(mem_ctx)
+	, uniformStr(mem_ctx)
+	, paramsStr(mem_ctx)
 	, writingParams(false)
 	, matrixCastsDone(false)
 	, shadowSamplerDone(false)
@@ -132,6 +133,7 @@ public:
 		: ctx(ctx_)
 		, buffer(buf)
 		, loopstate(NULL)
+		, current_function(NULL)
 		, inside_loop_body(false)
 		, inside_lhs(false)
 		, skipped_this_ir(false)
@@ -190,6 +192,7 @@ public:
 	PrintGlslMode mode;
 	const PrintGlslMode mode_whole;
 	loop_state* loopstate;
+	ir_function_signature* current_function;
 	bool	inside_loop_body;
 	bool	inside_lhs;
 	bool	skipped_this_ir;
@@ -202,7 +205,19 @@ _mesa_print_ir_metal(exec_list *instructions,
 	    struct _mesa_glsl_parse_state *state,
 		char* buffer, PrintGlslMode mode, int* outUniformsSize)
 {
-	metal_print_context ctx(buffer);
+	string_buffer str(buffer, _mesa_print_ir_size_hint(instructions));
+	_mesa_print_ir_metal(instructions, state, str, mode, outUniformsSize);
+	return str.release();
+}
+
+
+void
+_mesa_print_ir_metal(exec_list *instructions,
+	    struct _mesa_glsl_parse_state *state,
+		string_buffer& out, PrintGlslMode mode, int* outUniformsSize)
+{
+	// section buffers free themselves
+	metal_print_context ctx(NULL, _mesa_print_ir_size_hint(instructions));
 
 	// includes, prefix etc.
 	ctx.prefixStr.asprintf_append ("#include <metal_stdlib>\n");
@@ -230,7 +245,7 @@ _mesa_print_ir_metal(exec_list *instructions,
 			ir_variable *var = static_cast<ir_variable*>(ir);
 
 			// skip gl_ variables if they aren't used/assigned
-			if (strstr(var->name, "gl_") == var->name)
+			if (strncmp(var->name, "gl_", 3) == 0)
 			{
 				if (!var->data.used && !var->data.assigned)
 					continue;
@@ -279,8 +294,8 @@ _mesa_print_ir_metal(exec_list *instructions,
 	// append inout variables to both input & output structs
 	if (!ctx.inoutStr.empty())
 	{
-		ctx.inputStr.asprintf_append("%s", ctx.inoutStr.c_str());
-		ctx.outputStr.asprintf_append("%s", ctx.inoutStr.c_str());
+		ctx.inputStr.append(ctx.inoutStr);
+		ctx.outputStr.append(ctx.inoutStr);
 	}
 	ctx.inputStr.asprintf_append("};\n");
 	ctx.outputStr.asprintf_append("};\n");
@@ -311,27 +326,24 @@ _mesa_print_ir_metal(exec_list *instructions,
 		else
 		{
 			assert(c->type->is_record());
-			bool first = true;
-			foreach_in_list(ir_constant, inst, &c->components)
+			for (unsigned i = 0; i < c->type->length; i++)
 			{
-				if (!first)
+				if (i != 0)
 					v.buffer.asprintf_append (", ");
-				first = false;
-				inst->accept(&v);
+				c->const_elements[i]->accept(&v);
 			}
 		}
 		v.buffer.asprintf_append ("};\n");
 	}
 
 
-	ctx.prefixStr.asprintf_append("%s", ctx.inputStr.c_str());
-	ctx.prefixStr.asprintf_append("%s", ctx.outputStr.c_str());
-	ctx.prefixStr.asprintf_append("%s", ctx.uniformStr.c_str());
-	ctx.prefixStr.asprintf_append("%s", ctx.str.c_str());
+	out.append(ctx.prefixStr);
+	out.append(ctx.inputStr);
+	out.append(ctx.outputStr);
+	out.append(ctx.uniformStr);
+	out.append(ctx.str);
 
 	*outUniformsSize = ctx.uniformLocationCounter;
-
-	return ralloc_strdup(buffer, ctx.prefixStr.c_str());
 }
 
 
@@ -536,7 +548,8 @@ void ir_print_metal_visitor::visit(ir_variable *ir)
 {
 	const char *const cent = (ir->data.centroid) ? "centroid " : "";
 	const char *const inv = (ir->data.invariant) ? "invariant " : "";
-	const char *const mode[ir_var_mode_count] = { "", "  ", "  ", "  ", "  ", "in ", "out ", "inout ", "", "", "" };
+	// out & inout parameters are references
+	const char *const mode[ir_var_mode_count] = { "", "  ", "  ", "  ", "  ", "", "thread ", "thread ", "", "", "" };
 
 	const char *const interp[] = { "", "smooth ", "flat ", "noperspective " };
 
@@ -575,6 +588,8 @@ void ir_print_metal_visitor::visit(ir_variable *ir)
 	buffer.asprintf_append ("%s%s%s%s",
 							cent, inv, interp[ir->data.interpolation], mode[ir->data.mode]);
 	print_type(buffer, ir, ir->type, false);
+	if (ir->data.mode == ir_var_function_out || ir->data.mode == ir_var_function_inout)
+		buffer.asprintf_append ("&");
 	buffer.asprintf_append (" ");
 	print_var_name (ir);
 	print_type_post(buffer, ir->type, false);
@@ -702,7 +717,7 @@ void ir_print_metal_visitor::visit(ir_function_signature *ir)
 		buffer.asprintf_append ("xlatMtlShaderOutput xlatMtlMain (xlatMtlShaderInput _mtl_i [[stage_in]], constant xlatMtlShaderUniform& _mtl_u [[buffer(0)]]");
 		if (!ctx.paramsStr.empty())
 		{
-			buffer.asprintf_append ("%s", ctx.paramsStr.c_str());
+			buffer.append (ctx.paramsStr);
 		}
 	}
 
@@ -717,6 +732,7 @@ void ir_print_metal_visitor::visit(ir_function_signature *ir)
    indent();
    buffer.asprintf_append ("{\n");
    indentation++; previous_skipped = false;
+	current_function = ir;
 
 	if (isMain)
 	{
@@ -921,6 +937,16 @@ static void print_cast(string_buffer& buffer, glsl_precision prec, ir_rvalue* ir
 }
 
 
+// Selects are printed as the ?: operator, which takes a single bool; vector
+// selects have it broadcast by a swizzle.
+static ir_rvalue* select_condition(ir_expression* ir)
+{
+	ir_swizzle* swizzle = ir->operands[0]->as_swizzle();
+	if (swizzle && swizzle->val->type->is_scalar())
+		return swizzle->val;
+	return ir->operands[0];
+}
+
 void ir_print_metal_visitor::visit(ir_expression *ir)
 {
 	++this->expression_depth;
@@ -1038,6 +1064,39 @@ void ir_print_metal_visitor::visit(ir_expression *ir)
 		}
 		buffer.asprintf_append (")");
 	}
+	else if (ir->operation == ir_triop_csel)
+	{
+		ir_rvalue* cond = select_condition(ir);
+		if (cond->type->is_scalar())
+		{
+			buffer.asprintf_append ("(");
+			cond->accept(this);
+			buffer.asprintf_append (" ? ");
+			if (op1cast)
+				print_cast (buffer, arg_prec, ir->operands[1]);
+			ir->operands[1]->accept(this);
+			buffer.asprintf_append (" : ");
+			if (op2cast)
+				print_cast (buffer, arg_prec, ir->operands[2]);
+			ir->operands[2]->accept(this);
+			buffer.asprintf_append (")");
+		}
+		else
+		{
+			// per component select; ?: needs a scalar condition
+			buffer.asprintf_append ("select (");
+			if (op2cast)
+				print_cast (buffer, arg_prec, ir->operands[2]);
+			ir->operands[2]->accept(this);
+			buffer.asprintf_append (", ");
+			if (op1cast)
+				print_cast (buffer, arg_prec, ir->operands[1]);
+			ir->operands[1]->accept(this);
+			buffer.asprintf_append (", ");
+			cond->accept(this);
+			buffer.asprintf_append (")");
+		}
+	}
 	else
 	{
 		// ternary op
@@ -1503,6 +1562,19 @@ void ir_print_metal_visitor::visit(ir_assignment *ir)
 
 static void print_float (string_buffer& buffer, float f)
 {
+	// snprintf formats infinity and NaN as inf or nan, which aren't valid
+	// Metal; use the metal_stdlib constants instead.
+	if (f != f)
+	{
+		buffer.asprintf_append ("NAN");
+		return;
+	}
+	if (f == std::numeric_limits<float>::infinity() || f == -std::numeric_limits<float>::infinity())
+	{
+		buffer.asprintf_append (f > 0 ? "INFINITY" : "(-INFINITY)");
+		return;
+	}
+
 	// Kind of roundabout way, but this is to satisfy two things:
 	// * MSVC and gcc-based compilers differ a bit in how they treat float
 	//   widht/precision specifiers. Want to match for tests.
@@ -1635,18 +1707,28 @@ ir_print_metal_visitor::visit(ir_call *ir)
 		return;
 	}
 
+	// Metal does not convert between half & float vectors implicitly
 	if (ir->return_deref)
 	{
 		visit(ir->return_deref);
 		buffer.asprintf_append (" = ");
+		const glsl_precision prec = ir->return_deref->get_precision();
+		if (!ir->return_deref->type->is_matrix() && is_different_precision(prec, ir->callee->precision))
+			print_cast (buffer, prec, ir->return_deref);
 	}
 
    buffer.asprintf_append ("%s (", ir->callee_name());
    bool first = true;
-   foreach_in_list(ir_instruction, inst, &ir->actual_parameters) {
+   foreach_two_lists(formal_node, &ir->callee->parameters, actual_node, &ir->actual_parameters) {
+	  ir_variable* formal = (ir_variable*)formal_node;
+	  ir_rvalue* actual = (ir_rvalue*)actual_node;
 	  if (!first)
 		  buffer.asprintf_append (", ");
-      inst->accept(this);
+	  const glsl_precision prec = (glsl_precision)formal->data.precision;
+	  if (formal->data.mode == ir_var_function_in && actual->type->base_type == GLSL_TYPE_FLOAT && !actual->type->is_matrix() &&
+		  is_different_precision(prec, actual->get_precision()))
+		  print_cast (buffer, prec, actual);
+      actual->accept(this);
 	  first = false;
    }
    buffer.asprintf_append (")");
@@ -1661,6 +1743,9 @@ ir_print_metal_visitor::visit(ir_return *ir)
    ir_rvalue *const value = ir->get_value();
    if (value) {
       buffer.asprintf_append (" ");
+      if (current_function && value->type->base_type == GLSL_TYPE_FLOAT && !value->type->is_matrix() &&
+          is_different_precision(current_function->precision, value->get_precision()))
+         print_cast (buffer, current_function->precision, value);
       value->accept(this);
    }
 }
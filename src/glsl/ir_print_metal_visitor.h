@@ -32,5 +32,8 @@
 extern char* _mesa_print_ir_metal(exec_list *instructions,
 			struct _mesa_glsl_parse_state *state,
 			char* buf, PrintGlslMode mode, int* outUniformsSize);
+extern void _mesa_print_ir_metal(exec_list *instructions,
+			struct _mesa_glsl_parse_state *state,
+			string_buffer& out, PrintGlslMode mode, int* outUniformsSize);
 
 #endif /* IR_PRINT_GLSL_VISITOR_H */
@@ -0,0 +1,1309 @@
+#include "ir_serialize.h"
+#include "glsl_parser_extras.h"
+#include "util/hash_table.h"
+
+
+// Blob layout: header, then type, variable, signature and function tables,
+// then the instruction stream. Everything the instructions point to (types,
+// variables, callees) is referenced by table index. Integers are stored as
+// LEB128 varints, which keeps the common small values down to a byte.
+
+static const unsigned char kSerializedMagic[4] = { 'G', 'L', 'S', 'B' };
+static const unsigned kSerializedVersion = 1;
+
+enum serialized_type_kind {
+	kSerTypeBuiltin = 0,
+	kSerTypeArray,
+	kSerTypeStruct,
+	kSerTypeInterface,
+};
+
+enum serialized_extension_bits {
+	kSerExtARBShaderTextureLod = (1<<0),
+	kSerExtEXTShaderTextureLod = (1<<1),
+	kSerExtOESStandardDerivatives = (1<<2),
+	kSerExtEXTShadowSamplers = (1<<3),
+	kSerExtEXTFragDepth = (1<<4),
+	kSerExtEXTDrawBuffers = (1<<5),
+	kSerExtEXTShaderFramebufferFetch = (1<<6),
+};
+
+
+struct builtin_type_table
+{
+	builtin_type_table()
+	{
+		count = 0;
+		#define DECL_TYPE(NAME, ...) types[count++] = glsl_type::NAME##_type;
+		#define STRUCT_TYPE(NAME) types[count++] = glsl_type::struct_##NAME##_type;
+		#include "builtin_type_macros.h"
+		#undef DECL_TYPE
+		#undef STRUCT_TYPE
+		assert(count <= sizeof(types) / sizeof(types[0]));
+	}
+	const glsl_type* types[256];
+	unsigned count;
+};
+
+static const glsl_type* const* get_builtin_types(unsigned* outCount)
+{
+	static builtin_type_table table;
+	*outCount = table.count;
+	return table.types;
+}
+
+// Built-in signatures only need to be flagged as such; availability was
+// already checked when the IR was originally compiled.
+static bool serialized_builtin_available(const _mesa_glsl_parse_state *)
+{
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+// writing
+
+struct blob_writer
+{
+	blob_writer(void* mem_ctx)
+		: mem_ctx(mem_ctx), data(NULL), size(0), capacity(0)
+	{
+	}
+
+	void write_bytes(const void* bytes, size_t count)
+	{
+		if (size + count > capacity)
+		{
+			capacity = MAX2(capacity + capacity/2, size + count);
+			capacity = MAX2(capacity, (size_t)256);
+			data = (unsigned char*)reralloc_size(mem_ctx, data, capacity);
+		}
+		memcpy(data + size, bytes, count);
+		size += count;
+	}
+	void write_uint(unsigned v)
+	{
+		unsigned char buf[5];
+		int n = 0;
+		do {
+			buf[n] = v & 0x7F;
+			v >>= 7;
+			if (v)
+				buf[n] |= 0x80;
+			++n;
+		} while (v);
+		write_bytes(buf, n);
+	}
+	void write_int(int v)
+	{
+		// zigzag so that small negative values stay small
+		write_uint(((unsigned)v << 1) ^ (unsigned)(v >> 31));
+	}
+	void write_string(const char* str)
+	{
+		if (!str)
+		{
+			write_uint(0);
+			return;
+		}
+		const size_t len = strlen(str);
+		write_uint(len + 1);
+		write_bytes(str, len);
+	}
+
+	void* mem_ctx;
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+};
+
+
+class ir_serialize_writer
+{
+public:
+	ir_serialize_writer(void* mem_ctx)
+		: mem_ctx(mem_ctx)
+		, types(mem_ctx), vars(mem_ctx), sigs(mem_ctx), funcs(mem_ctx), body(mem_ctx)
+		, type_count(0), var_count(0), sig_count(0), func_count(0)
+	{
+		ids = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+		type_list = NULL;
+		var_list = NULL;
+		sig_list = NULL;
+		func_list = NULL;
+	}
+	~ir_serialize_writer()
+	{
+		_mesa_hash_table_destroy(ids, NULL);
+	}
+
+	char* serialize(exec_list* instructions, _mesa_glsl_parse_state* state, size_t* outSize);
+
+private:
+	bool find_id(const void* ptr, unsigned* outId)
+	{
+		hash_entry* e = _mesa_hash_table_search(ids, _mesa_hash_pointer(ptr), ptr);
+		if (!e)
+			return false;
+		*outId = (unsigned)(uintptr_t)e->data;
+		return true;
+	}
+	void add_id(const void* ptr, unsigned id)
+	{
+		_mesa_hash_table_insert(ids, _mesa_hash_pointer(ptr), ptr, (void*)(uintptr_t)id);
+	}
+	template <typename T> unsigned append(T**& list, unsigned& count, T* item)
+	{
+		if ((count & (count - 1)) == 0)
+			list = reralloc(mem_ctx, list, T*, count ? count * 2 : 1);
+		list[count] = item;
+		add_id(item, count);
+		return count++;
+	}
+
+	unsigned type_id(const glsl_type* type);
+	unsigned var_id(ir_variable* var);
+	unsigned sig_id(ir_function_signature* sig);
+	unsigned func_id(ir_function* func);
+
+	void write_type_record(const glsl_type* type);
+	void write_var_record(ir_variable* var);
+	void write_sig_record(ir_function_signature* sig);
+	void write_func_record(ir_function* func);
+
+	void write_list(blob_writer& b, exec_list* list);
+	void write_instruction(blob_writer& b, ir_instruction* ir);
+	void write_rvalue(blob_writer& b, ir_rvalue* ir);
+
+	void* mem_ctx;
+	hash_table* ids;
+	blob_writer types, vars, sigs, funcs, body;
+	const glsl_type** type_list;
+	ir_variable** var_list;
+	ir_function_signature** sig_list;
+	ir_function** func_list;
+	unsigned type_count, var_count, sig_count, func_count;
+};
+
+
+unsigned ir_serialize_writer::type_id(const glsl_type* type)
+{
+	unsigned id;
+	if (find_id(type, &id))
+		return id;
+
+	// register dependencies first, so that the table is in read order
+	if (type->is_array())
+		type_id(type->fields.array);
+	else if (type->is_record() || type->is_interface())
+	{
+		for (unsigned i = 0; i < type->length; ++i)
+			type_id(type->fields.structure[i].type);
+	}
+	return append(type_list, type_count, type);
+}
+
+unsigned ir_serialize_writer::var_id(ir_variable* var)
+{
+	unsigned id;
+	if (find_id(var, &id))
+		return id;
+	return append(var_list, var_count, var);
+}
+
+unsigned ir_serialize_writer::sig_id(ir_function_signature* sig)
+{
+	unsigned id;
+	if (find_id(sig, &id))
+		return id;
+	func_id((ir_function*)sig->function());
+	return append(sig_list, sig_count, sig);
+}
+
+unsigned ir_serialize_writer::func_id(ir_function* func)
+{
+	unsigned id;
+	if (find_id(func, &id))
+		return id;
+	return append(func_list, func_count, func);
+}
+
+
+void ir_serialize_writer::write_type_record(const glsl_type* type)
+{
+	unsigned builtinCount;
+	const glsl_type* const* builtins = get_builtin_types(&builtinCount);
+	for (unsigned i = 0; i < builtinCount; ++i)
+	{
+		if (builtins[i] == type)
+		{
+			types.write_uint(kSerTypeBuiltin);
+			types.write_uint(i);
+			return;
+		}
+	}
+
+	if (type->is_array())
+	{
+		types.write_uint(kSerTypeArray);
+		types.write_uint(type_id(type->fields.array));
+		types.write_uint(type->length);
+		return;
+	}
+
+	assert(type->is_record() || type->is_interface());
+	types.write_uint(type->is_interface() ? kSerTypeInterface : kSerTypeStruct);
+	types.write_string(type->name);
+	if (type->is_interface())
+		types.write_uint(type->interface_packing);
+	types.write_uint(type->length);
+	for (unsigned i = 0; i < type->length; ++i)
+	{
+		const glsl_struct_field& f = type->fields.structure[i];
+		types.write_uint(type_id(f.type));
+		types.write_string(f.name);
+		types.write_uint(f.precision);
+		types.write_int(f.location);
+		types.write_uint(f.interpolation);
+		types.write_uint(f.centroid);
+		types.write_uint(f.sample);
+		types.write_uint(f.matrix_layout);
+		types.write_int(f.stream);
+	}
+}
+
+void ir_serialize_writer::write_var_record(ir_variable* var)
+{
+	vars.write_uint(type_id(var->type));
+	if (!var->is_name_ralloced())
+		vars.write_uint(1);
+	else
+	{
+		vars.write_uint(0);
+		vars.write_string(var->name);
+	}
+	vars.write_bytes(&var->data, sizeof(var->data));
+
+	vars.write_uint(var->get_interface_type() ? type_id(var->get_interface_type()) + 1 : 0);
+	if (var->is_interface_instance())
+	{
+		const unsigned* access = var->get_max_ifc_array_access();
+		const unsigned n = access ? var->get_interface_type()->length : 0;
+		vars.write_uint(n);
+		for (unsigned i = 0; i < n; ++i)
+			vars.write_uint(access[i]);
+	}
+	else
+	{
+		const unsigned n = var->get_state_slots() ? var->get_num_state_slots() : 0;
+		vars.write_uint(n);
+		if (n)
+			vars.write_bytes(var->get_state_slots(), n * sizeof(ir_state_slot));
+	}
+
+	write_rvalue(vars, var->constant_value);
+	write_rvalue(vars, var->constant_initializer);
+}
+
+void ir_serialize_writer::write_sig_record(ir_function_signature* sig)
+{
+	sigs.write_uint(type_id(sig->return_type));
+	sigs.write_uint(sig->precision);
+	sigs.write_uint(sig->is_defined);
+	sigs.write_uint(sig->is_intrinsic);
+	sigs.write_uint(sig->is_builtin());
+	sigs.write_uint(sig->parameters.length());
+	foreach_in_list(ir_variable, param, &sig->parameters)
+		sigs.write_uint(var_id(param));
+}
+
+void ir_serialize_writer::write_func_record(ir_function* func)
+{
+	funcs.write_string(func->name);
+	unsigned count = 0, id;
+	foreach_in_list(ir_function_signature, sig, &func->signatures)
+		count += find_id(sig, &id);
+	funcs.write_uint(count);
+	foreach_in_list(ir_function_signature, sig, &func->signatures)
+	{
+		if (find_id(sig, &id))
+			funcs.write_uint(id);
+	}
+}
+
+
+void ir_serialize_writer::write_list(blob_writer& b, exec_list* list)
+{
+	b.write_uint(list->length());
+	foreach_in_list(ir_instruction, ir, list)
+		write_instruction(b, ir);
+}
+
+void ir_serialize_writer::write_instruction(blob_writer& b, ir_instruction* ir)
+{
+	if (ir->as_rvalue())
+	{
+		write_rvalue(b, ir->as_rvalue());
+		return;
+	}
+
+	b.write_uint(ir->ir_type);
+	switch (ir->ir_type)
+	{
+	case ir_type_variable:
+		b.write_uint(var_id((ir_variable*)ir));
+		break;
+	case ir_type_function:
+	{
+		ir_function* func = (ir_function*)ir;
+		b.write_uint(func_id(func));
+		b.write_uint(func->signatures.length());
+		foreach_in_list(ir_function_signature, sig, &func->signatures)
+		{
+			b.write_uint(sig_id(sig));
+			write_list(b, &sig->body);
+		}
+		break;
+	}
+	case ir_type_assignment:
+	{
+		ir_assignment* ass = (ir_assignment*)ir;
+		write_rvalue(b, ass->lhs);
+		write_rvalue(b, ass->rhs);
+		write_rvalue(b, ass->condition);
+		b.write_uint(ass->write_mask);
+		break;
+	}
+	case ir_type_call:
+	{
+		ir_call* call = (ir_call*)ir;
+		b.write_uint(sig_id(call->callee));
+		write_rvalue(b, call->return_deref);
+		b.write_uint(call->actual_parameters.length());
+		foreach_in_list(ir_rvalue, param, &call->actual_parameters)
+			write_rvalue(b, param);
+		b.write_uint(call->use_builtin);
+		break;
+	}
+	case ir_type_return:
+		write_rvalue(b, ((ir_return*)ir)->value);
+		break;
+	case ir_type_loop_jump:
+		b.write_uint(((ir_loop_jump*)ir)->mode);
+		break;
+	case ir_type_discard:
+		write_rvalue(b, ((ir_discard*)ir)->condition);
+		break;
+	case ir_type_if:
+	{
+		ir_if* iif = (ir_if*)ir;
+		write_rvalue(b, iif->condition);
+		write_list(b, &iif->then_instructions);
+		write_list(b, &iif->else_instructions);
+		break;
+	}
+	case ir_type_loop:
+		write_list(b, &((ir_loop*)ir)->body_instructions);
+		break;
+	case ir_type_typedecl:
+		b.write_uint(type_id(((ir_typedecl_statement*)ir)->type_decl));
+		break;
+	case ir_type_precision:
+		b.write_string(((ir_precision_statement*)ir)->precision_statement);
+		break;
+	case ir_type_emit_vertex:
+		write_rvalue(b, ((ir_emit_vertex*)ir)->stream);
+		break;
+	case ir_type_end_primitive:
+		write_rvalue(b, ((ir_end_primitive*)ir)->stream);
+		break;
+	default:
+		assert(!"unexpected IR node in serialization");
+		break;
+	}
+}
+
+void ir_serialize_writer::write_rvalue(blob_writer& b, ir_rvalue* ir)
+{
+	if (!ir)
+	{
+		b.write_uint(ir_type_unset);
+		return;
+	}
+
+	b.write_uint(ir->ir_type);
+	b.write_uint(type_id(ir->type));
+	b.write_uint(ir->get_precision());
+	switch (ir->ir_type)
+	{
+	case ir_type_dereference_variable:
+		b.write_uint(var_id(((ir_dereference_variable*)ir)->var));
+		break;
+	case ir_type_dereference_array:
+	{
+		ir_dereference_array* deref = (ir_dereference_array*)ir;
+		write_rvalue(b, deref->array);
+		write_rvalue(b, deref->array_index);
+		break;
+	}
+	case ir_type_dereference_record:
+	{
+		ir_dereference_record* deref = (ir_dereference_record*)ir;
+		write_rvalue(b, deref->record);
+		b.write_string(deref->field);
+		break;
+	}
+	case ir_type_swizzle:
+	{
+		ir_swizzle* swz = (ir_swizzle*)ir;
+		write_rvalue(b, swz->val);
+		b.write_uint(swz->mask.x | (swz->mask.y << 2) | (swz->mask.z << 4) | (swz->mask.w << 6));
+		b.write_uint(swz->mask.num_components);
+		break;
+	}
+	case ir_type_expression:
+	{
+		ir_expression* expr = (ir_expression*)ir;
+		const unsigned n = expr->get_num_operands();
+		b.write_uint(expr->operation);
+		b.write_uint(n);
+		for (unsigned i = 0; i < n; ++i)
+			write_rvalue(b, expr->operands[i]);
+		break;
+	}
+	case ir_type_texture:
+	{
+		ir_texture* tex = (ir_texture*)ir;
+		b.write_uint(tex->op);
+		write_rvalue(b, tex->sampler);
+		write_rvalue(b, tex->coordinate);
+		write_rvalue(b, tex->offset);
+		switch (tex->op)
+		{
+		case ir_tex:
+		case ir_lod:
+		case ir_query_levels:
+			break;
+		case ir_txb:
+			write_rvalue(b, tex->lod_info.bias);
+			break;
+		case ir_txl:
+		case ir_txf:
+		case ir_txs:
+			write_rvalue(b, tex->lod_info.lod);
+			break;
+		case ir_txf_ms:
+			write_rvalue(b, tex->lod_info.sample_index);
+			break;
+		case ir_txd:
+			write_rvalue(b, tex->lod_info.grad.dPdx);
+			write_rvalue(b, tex->lod_info.grad.dPdy);
+			break;
+		case ir_tg4:
+			write_rvalue(b, tex->lod_info.component);
+			break;
+		}
+		break;
+	}
+	case ir_type_constant:
+	{
+		ir_constant* c = (ir_constant*)ir;
+		if (c->type->is_array() || c->type->is_record())
+		{
+			for (unsigned i = 0; i < c->type->length; ++i)
+				write_rvalue(b, c->const_elements[i]);
+		}
+		else
+		{
+			const unsigned n = c->type->components();
+			for (unsigned i = 0; i < n; ++i)
+			{
+				if (c->type->base_type == GLSL_TYPE_BOOL)
+					b.write_uint(c->value.b[i]);
+				else
+					b.write_bytes(&c->value.u[i], sizeof(c->value.u[i]));
+			}
+		}
+		break;
+	}
+	default:
+		assert(!"unexpected rvalue in serialization");
+		break;
+	}
+}
+
+
+char* ir_serialize_writer::serialize(exec_list* instructions, _mesa_glsl_parse_state* state, size_t* outSize)
+{
+	write_list(body, instructions);
+
+	// Tables are written after the instructions, since that is when we know
+	// what is referenced. Signatures can pull in parameter variables, and
+	// variables can pull in types; so write them in that order.
+	for (unsigned i = 0; i < sig_count; ++i)
+		write_sig_record(sig_list[i]);
+	for (unsigned i = 0; i < func_count; ++i)
+		write_func_record(func_list[i]);
+	for (unsigned i = 0; i < var_count; ++i)
+		write_var_record(var_list[i]);
+	for (unsigned i = 0; i < type_count; ++i)
+		write_type_record(type_list[i]);
+
+	unsigned extensions = 0;
+	if (state->ARB_shader_texture_lod_enable) extensions |= kSerExtARBShaderTextureLod;
+	if (state->EXT_shader_texture_lod_enable) extensions |= kSerExtEXTShaderTextureLod;
+	if (state->OES_standard_derivatives_enable) extensions |= kSerExtOESStandardDerivatives;
+	if (state->EXT_shadow_samplers_enable) extensions |= kSerExtEXTShadowSamplers;
+	if (state->EXT_frag_depth_enable) extensions |= kSerExtEXTFragDepth;
+	if (state->EXT_draw_buffers_enable) extensions |= kSerExtEXTDrawBuffers;
+	if (state->EXT_shader_framebuffer_fetch_enable) extensions |= kSerExtEXTShaderFramebufferFetch;
+
+	blob_writer out(mem_ctx);
+	out.write_bytes(kSerializedMagic, sizeof(kSerializedMagic));
+	out.write_uint(kSerializedVersion);
+	out.write_uint(state->stage);
+	out.write_uint(state->language_version);
+	out.write_uint(state->es_shader);
+	out.write_uint(state->had_version_string);
+	out.write_uint(state->had_float_precision);
+	out.write_uint(extensions);
+
+	out.write_uint(type_count);
+	out.write_bytes(types.data, types.size);
+	out.write_uint(var_count);
+	out.write_bytes(vars.data, vars.size);
+	out.write_uint(sig_count);
+	out.write_bytes(sigs.data, sigs.size);
+	out.write_uint(func_count);
+	out.write_bytes(funcs.data, funcs.size);
+	out.write_bytes(body.data, body.size);
+
+	*outSize = out.size;
+	return (char*)out.data;
+}
+
+
+char* serialize_ir(exec_list* instructions, _mesa_glsl_parse_state* state, void* mem_ctx, size_t* outSize)
+{
+	// scratch tables go into a temporary context, the blob itself into mem_ctx
+	void* tmp_ctx = ralloc_context(NULL);
+	ir_serialize_writer w(tmp_ctx);
+	size_t size;
+	char* data = w.serialize(instructions, state, &size);
+	char* res = (char*)ralloc_size(mem_ctx, size);
+	memcpy(res, data, size);
+	ralloc_free(tmp_ctx);
+	*outSize = size;
+	return res;
+}
+
+
+// --------------------------------------------------------------------------
+// reading
+
+struct blob_reader
+{
+	blob_reader(const void* data, size_t size)
+		: cur((const unsigned char*)data), end((const unsigned char*)data + size), overrun(false)
+	{
+	}
+
+	bool read_bytes(void* bytes, size_t count)
+	{
+		if ((size_t)(end - cur) < count)
+		{
+			overrun = true;
+			memset(bytes, 0, count);
+			return false;
+		}
+		memcpy(bytes, cur, count);
+		cur += count;
+		return true;
+	}
+	unsigned read_uint()
+	{
+		unsigned v = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (cur >= end)
+			{
+				overrun = true;
+				return 0;
+			}
+			const unsigned char c = *cur++;
+			v |= (unsigned)(c & 0x7F) << shift;
+			if (!(c & 0x80))
+				return v;
+		}
+		overrun = true;
+		return 0;
+	}
+	int read_int()
+	{
+		const unsigned v = read_uint();
+		return (int)(v >> 1) ^ -(int)(v & 1);
+	}
+	// returned string is allocated off mem_ctx
+	const char* read_string(void* mem_ctx)
+	{
+		const unsigned len = read_uint();
+		if (len == 0)
+			return NULL;
+		if ((size_t)(end - cur) < len - 1)
+		{
+			overrun = true;
+			return NULL;
+		}
+		// not ralloc_strndup; that would look for a terminating NUL past the string
+		char* str = (char*)ralloc_size(mem_ctx, len);
+		memcpy(str, cur, len - 1);
+		str[len - 1] = 0;
+		cur += len - 1;
+		return str;
+	}
+
+	const unsigned char* cur;
+	const unsigned char* end;
+	bool overrun;
+};
+
+
+class ir_serialize_reader
+{
+public:
+	ir_serialize_reader(const void* data, size_t size, void* mem_ctx)
+		: b(data, size), mem_ctx(mem_ctx), failed(false)
+		, types(NULL), vars(NULL), sigs(NULL), funcs(NULL)
+		, type_count(0), var_count(0), sig_count(0), func_count(0)
+	{
+	}
+
+	bool read_header(gl_shader_stage* outStage, _mesa_glsl_parse_state* state);
+	bool deserialize(exec_list* instructions, _mesa_glsl_parse_state* state);
+
+private:
+	bool ok() const { return !failed && !b.overrun; }
+	bool fail() { failed = true; return false; }
+
+	unsigned read_count()
+	{
+		// every element takes at least one byte, which bounds counts
+		// coming from corrupt data
+		const unsigned n = b.read_uint();
+		if (n > (size_t)(b.end - b.cur))
+		{
+			fail();
+			return 0;
+		}
+		return n;
+	}
+	const glsl_type* read_type()
+	{
+		const unsigned id = b.read_uint();
+		if (id >= type_count)
+		{
+			fail();
+			return NULL;
+		}
+		return types[id];
+	}
+	ir_variable* read_var()
+	{
+		const unsigned id = b.read_uint();
+		if (id >= var_count)
+		{
+			fail();
+			return NULL;
+		}
+		return vars[id];
+	}
+	ir_function_signature* read_sig()
+	{
+		const unsigned id = b.read_uint();
+		if (id >= sig_count)
+		{
+			fail();
+			return NULL;
+		}
+		return sigs[id];
+	}
+
+	bool read_type_records();
+	bool read_var_records();
+	bool read_sig_and_func_records();
+
+	bool read_list(exec_list* list);
+	ir_instruction* read_instruction();
+	ir_rvalue* read_rvalue(unsigned tag);
+	ir_rvalue* read_rvalue() { return read_rvalue(b.read_uint()); }
+	ir_dereference* read_deref()
+	{
+		ir_rvalue* rv = read_rvalue();
+		if (rv && !rv->as_dereference())
+		{
+			fail();
+			return NULL;
+		}
+		return (ir_dereference*)rv;
+	}
+
+	blob_reader b;
+	void* mem_ctx;
+	bool failed;
+	const glsl_type** types;
+	ir_variable** vars;
+	ir_function_signature** sigs;
+	ir_function** funcs;
+	unsigned type_count, var_count, sig_count, func_count;
+};
+
+
+bool ir_serialize_reader::read_header(gl_shader_stage* outStage, _mesa_glsl_parse_state* state)
+{
+	unsigned char magic[sizeof(kSerializedMagic)];
+	b.read_bytes(magic, sizeof(magic));
+	if (memcmp(magic, kSerializedMagic, sizeof(magic)) != 0)
+		return fail();
+	if (b.read_uint() != kSerializedVersion)
+		return fail();
+	const unsigned stage = b.read_uint();
+	if (stage >= MESA_SHADER_STAGES)
+		return fail();
+	*outStage = (gl_shader_stage)stage;
+
+	const unsigned language_version = b.read_uint();
+	const bool es_shader = b.read_uint() != 0;
+	const bool had_version_string = b.read_uint() != 0;
+	const bool had_float_precision = b.read_uint() != 0;
+	const unsigned extensions = b.read_uint();
+	if (state)
+	{
+		state->language_version = language_version;
+		state->es_shader = es_shader;
+		state->had_version_string = had_version_string;
+		state->had_float_precision = had_float_precision;
+		state->ARB_shader_texture_lod_enable = (extensions & kSerExtARBShaderTextureLod) != 0;
+		state->EXT_shader_texture_lod_enable = (extensions & kSerExtEXTShaderTextureLod) != 0;
+		state->OES_standard_derivatives_enable = (extensions & kSerExtOESStandardDerivatives) != 0;
+		state->EXT_shadow_samplers_enable = (extensions & kSerExtEXTShadowSamplers) != 0;
+		state->EXT_frag_depth_enable = (extensions & kSerExtEXTFragDepth) != 0;
+		state->EXT_draw_buffers_enable = (extensions & kSerExtEXTDrawBuffers) != 0;
+		state->EXT_shader_framebuffer_fetch_enable = (extensions & kSerExtEXTShaderFramebufferFetch) != 0;
+	}
+	return ok();
+}
+
+
+bool ir_serialize_reader::read_type_records()
+{
+	unsigned builtinCount;
+	const glsl_type* const* builtins = get_builtin_types(&builtinCount);
+
+	const unsigned count = read_count();
+	types = ralloc_array(mem_ctx, const glsl_type*, count);
+	for (unsigned i = 0; i < count && ok(); ++i)
+	{
+		const glsl_type* type = NULL;
+		const unsigned kind = b.read_uint();
+		switch (kind)
+		{
+		case kSerTypeBuiltin:
+		{
+			const unsigned idx = b.read_uint();
+			if (idx < builtinCount)
+				type = builtins[idx];
+			break;
+		}
+		case kSerTypeArray:
+		{
+			const glsl_type* elem = read_type();
+			const unsigned length = b.read_uint();
+			if (elem)
+				type = glsl_type::get_array_instance(elem, length);
+			break;
+		}
+		case kSerTypeStruct:
+		case kSerTypeInterface:
+		{
+			const bool iface = kind == kSerTypeInterface;
+			const char* name = b.read_string(mem_ctx);
+			const unsigned packing = iface ? b.read_uint() : 0;
+			const unsigned nfields = read_count();
+			glsl_struct_field* fields = ralloc_array(mem_ctx, glsl_struct_field, nfields);
+			bool fields_ok = true;
+			for (unsigned j = 0; j < nfields; ++j)
+			{
+				glsl_struct_field& f = fields[j];
+				f.type = read_type();
+				f.name = b.read_string(mem_ctx);
+				if (!f.type || !f.name)
+					fields_ok = false;
+				f.precision = (glsl_precision)b.read_uint();
+				f.location = b.read_int();
+				f.interpolation = b.read_uint();
+				f.centroid = b.read_uint();
+				f.sample = b.read_uint();
+				f.matrix_layout = b.read_uint();
+				f.stream = b.read_int();
+			}
+			if (!ok() || !name || !fields_ok)
+				break;
+			if (iface)
+				type = glsl_type::get_interface_instance(fields, nfields, (glsl_interface_packing)packing, name);
+			else
+				type = glsl_type::get_record_instance(fields, nfields, name);
+			break;
+		}
+		}
+		if (!type)
+			return fail();
+		types[type_count++] = type;
+	}
+	return ok();
+}
+
+
+bool ir_serialize_reader::read_var_records()
+{
+	const unsigned count = read_count();
+	vars = ralloc_array(mem_ctx, ir_variable*, count);
+	for (unsigned i = 0; i < count && ok(); ++i)
+	{
+		const glsl_type* type = read_type();
+		const bool tmp = b.read_uint() != 0;
+		const char* name = tmp ? NULL : b.read_string(mem_ctx);
+		if (!ok() || !type)
+			return fail();
+
+		// actual mode & precision come with the rest of the data; don't create
+		// as a temporary unless it was one, since that drops the name
+		ir_variable* var = new(mem_ctx) ir_variable(type, name, tmp ? ir_var_temporary : ir_var_auto, glsl_precision_undefined);
+		b.read_bytes(&var->data, sizeof(var->data));
+		var->set_num_state_slots(0);
+		if (var->data.mode >= ir_var_mode_count)
+			return fail();
+
+		const unsigned ifaceId = b.read_uint();
+		if (ifaceId)
+		{
+			if (ifaceId > type_count)
+				return fail();
+			var->init_interface_type(types[ifaceId - 1]);
+		}
+		const unsigned n = read_count();
+		if (var->is_interface_instance())
+		{
+			unsigned* access = var->get_max_ifc_array_access();
+			if (n && (!access || n != var->get_interface_type()->length))
+				return fail();
+			for (unsigned j = 0; j < n; ++j)
+				access[j] = b.read_uint();
+		}
+		else if (n)
+		{
+			ir_state_slot* slots = var->allocate_state_slots(n);
+			b.read_bytes(slots, n * sizeof(ir_state_slot));
+		}
+
+		// constants reference types only, so they can be read right away
+		var->constant_value = (ir_constant*)read_rvalue();
+		var->constant_initializer = (ir_constant*)read_rvalue();
+		if ((var->constant_value && !var->constant_value->as_constant()) ||
+			(var->constant_initializer && !var->constant_initializer->as_constant()))
+			return fail();
+
+		vars[var_count++] = var;
+	}
+	return ok();
+}
+
+
+bool ir_serialize_reader::read_sig_and_func_records()
+{
+	const unsigned count = read_count();
+	sigs = ralloc_array(mem_ctx, ir_function_signature*, count);
+	for (unsigned i = 0; i < count && ok(); ++i)
+	{
+		const glsl_type* return_type = read_type();
+		const glsl_precision precision = (glsl_precision)b.read_uint();
+		const bool is_defined = b.read_uint() != 0;
+		const bool is_intrinsic = b.read_uint() != 0;
+		const bool is_builtin = b.read_uint() != 0;
+		if (!ok() || !return_type)
+			return fail();
+		ir_function_signature* sig = new(mem_ctx) ir_function_signature(return_type, precision, is_builtin ? serialized_builtin_available : NULL);
+		sig->is_defined = is_defined;
+		sig->is_intrinsic = is_intrinsic;
+		const unsigned nparams = read_count();
+		for (unsigned j = 0; j < nparams; ++j)
+		{
+			ir_variable* param = read_var();
+			if (!param)
+				return fail();
+			sig->parameters.push_tail(param);
+		}
+		sigs[sig_count++] = sig;
+	}
+
+	const unsigned nfuncs = read_count();
+	funcs = ralloc_array(mem_ctx, ir_function*, nfuncs);
+	for (unsigned i = 0; i < nfuncs && ok(); ++i)
+	{
+		const char* name = b.read_string(mem_ctx);
+		if (!name)
+			return fail();
+		ir_function* func = new(mem_ctx) ir_function(name);
+		const unsigned nsigs = read_count();
+		for (unsigned j = 0; j < nsigs; ++j)
+		{
+			ir_function_signature* sig = read_sig();
+			if (!sig || sig->function())
+				return fail();
+			func->add_signature(sig);
+		}
+		funcs[func_count++] = func;
+	}
+	return ok();
+}
+
+
+bool ir_serialize_reader::read_list(exec_list* list)
+{
+	const unsigned count = read_count();
+	for (unsigned i = 0; i < count; ++i)
+	{
+		ir_instruction* ir = read_instruction();
+		if (!ir)
+			return fail();
+		list->push_tail(ir);
+	}
+	return ok();
+}
+
+
+ir_instruction* ir_serialize_reader::read_instruction()
+{
+	const unsigned tag = b.read_uint();
+	if (!ok())
+		return NULL;
+	switch (tag)
+	{
+	case ir_type_dereference_array:
+	case ir_type_dereference_record:
+	case ir_type_dereference_variable:
+	case ir_type_constant:
+	case ir_type_expression:
+	case ir_type_swizzle:
+	case ir_type_texture:
+		return read_rvalue(tag);
+	case ir_type_variable:
+	{
+		ir_variable* var = read_var();
+		// a variable can only be declared once
+		if (!var || var->next)
+			return NULL;
+		return var;
+	}
+	case ir_type_function:
+	{
+		const unsigned id = b.read_uint();
+		if (id >= func_count)
+			return NULL;
+		ir_function* func = funcs[id];
+		const unsigned nsigs = b.read_uint();
+		for (unsigned i = 0; i < nsigs; ++i)
+		{
+			ir_function_signature* sig = read_sig();
+			if (!sig || sig->function() != func || !read_list(&sig->body))
+				return NULL;
+		}
+		return func;
+	}
+	case ir_type_assignment:
+	{
+		ir_dereference* lhs = read_deref();
+		ir_rvalue* rhs = read_rvalue();
+		ir_rvalue* condition = read_rvalue();
+		const unsigned write_mask = b.read_uint();
+		if (!lhs || !rhs)
+			return NULL;
+		return new(mem_ctx) ir_assignment(lhs, rhs, condition, write_mask);
+	}
+	case ir_type_call:
+	{
+		ir_function_signature* callee = read_sig();
+		ir_rvalue* ret = read_rvalue();
+		if (!callee || (ret && !ret->as_dereference_variable()))
+			return NULL;
+		exec_list params;
+		const unsigned nparams = read_count();
+		if (nparams != callee->parameters.length())
+			return NULL;
+		for (unsigned i = 0; i < nparams; ++i)
+		{
+			ir_rvalue* param = read_rvalue();
+			if (!param)
+				return NULL;
+			params.push_tail(param);
+		}
+		ir_call* call = new(mem_ctx) ir_call(callee, (ir_dereference_variable*)ret, &params);
+		call->use_builtin = b.read_uint() != 0;
+		return call;
+	}
+	case ir_type_return:
+		return new(mem_ctx) ir_return(read_rvalue());
+	case ir_type_loop_jump:
+		return new(mem_ctx) ir_loop_jump(b.read_uint() ? ir_loop_jump::jump_continue : ir_loop_jump::jump_break);
+	case ir_type_discard:
+		return new(mem_ctx) ir_discard(read_rvalue());
+	case ir_type_if:
+	{
+		ir_rvalue* condition = read_rvalue();
+		if (!condition)
+			return NULL;
+		ir_if* iif = new(mem_ctx) ir_if(condition);
+		if (!read_list(&iif->then_instructions) || !read_list(&iif->else_instructions))
+			return NULL;
+		return iif;
+	}
+	case ir_type_loop:
+	{
+		ir_loop* loop = new(mem_ctx) ir_loop();
+		if (!read_list(&loop->body_instructions))
+			return NULL;
+		return loop;
+	}
+	case ir_type_typedecl:
+	{
+		const glsl_type* type = read_type();
+		return type ? new(mem_ctx) ir_typedecl_statement(type) : NULL;
+	}
+	case ir_type_precision:
+	{
+		const char* str = b.read_string(mem_ctx);
+		return str ? new(mem_ctx) ir_precision_statement(str) : NULL;
+	}
+	case ir_type_emit_vertex:
+	case ir_type_end_primitive:
+	{
+		ir_rvalue* stream = read_rvalue();
+		if (!stream)
+			return NULL;
+		if (tag == ir_type_emit_vertex)
+			return new(mem_ctx) ir_emit_vertex(stream);
+		return new(mem_ctx) ir_end_primitive(stream);
+	}
+	default:
+		return NULL;
+	}
+}
+
+
+// Operands a texture operation can't do without; a blob missing them is corrupt
+static bool tex_operands_present(const ir_texture* tex)
+{
+	if (!tex->sampler || !tex->sampler->type->is_sampler())
+		return false;
+	if (!tex->coordinate && tex->op != ir_txs && tex->op != ir_query_levels)
+		return false;
+	switch (tex->op)
+	{
+	case ir_txb:
+		return tex->lod_info.bias != NULL;
+	case ir_txl:
+	case ir_txf:
+	case ir_txs:
+		return tex->lod_info.lod != NULL;
+	case ir_txf_ms:
+		return tex->lod_info.sample_index != NULL;
+	case ir_txd:
+		return tex->lod_info.grad.dPdx && tex->lod_info.grad.dPdy;
+	case ir_tg4:
+		return tex->lod_info.component != NULL;
+	default:
+		return true;
+	}
+}
+
+
+ir_rvalue* ir_serialize_reader::read_rvalue(unsigned tag)
+{
+	if (tag == ir_type_unset || !ok())
+		return NULL;
+
+	const glsl_type* type = read_type();
+	const glsl_precision precision = (glsl_precision)b.read_uint();
+	if (!type)
+		return NULL;
+
+	ir_rvalue* res = NULL;
+	switch (tag)
+	{
+	case ir_type_dereference_variable:
+	{
+		ir_variable* var = read_var();
+		if (var)
+			res = new(mem_ctx) ir_dereference_variable(var);
+		break;
+	}
+	case ir_type_dereference_array:
+	{
+		ir_rvalue* array = read_rvalue();
+		ir_rvalue* index = read_rvalue();
+		if (array && index && index->type->is_scalar() && index->type->is_integer() &&
+			(array->type->is_array() || array->type->is_matrix() || array->type->is_vector()))
+			res = new(mem_ctx) ir_dereference_array(array, index);
+		break;
+	}
+	case ir_type_dereference_record:
+	{
+		ir_rvalue* record = read_rvalue();
+		const char* field = b.read_string(mem_ctx);
+		if (record && field && record->type->field_type(field) != glsl_type::error_type)
+			res = new(mem_ctx) ir_dereference_record(record, field);
+		break;
+	}
+	case ir_type_swizzle:
+	{
+		ir_rvalue* val = read_rvalue();
+		const unsigned comps = b.read_uint();
+		const unsigned count = b.read_uint();
+		if (val && count >= 1 && count <= 4)
+		{
+			const unsigned c[4] = { comps & 3, (comps >> 2) & 3, (comps >> 4) & 3, (comps >> 6) & 3 };
+			bool inRange = true;
+			for (unsigned i = 0; i < count; ++i)
+				inRange &= c[i] < val->type->vector_elements;
+			if (inRange)
+				res = new(mem_ctx) ir_swizzle(val, c, count);
+		}
+		break;
+	}
+	case ir_type_expression:
+	{
+		const unsigned op = b.read_uint();
+		const unsigned n = b.read_uint();
+		if (op > ir_last_opcode)
+			break;
+		// vector constructors have as many operands as components
+		const unsigned expected = op == ir_quadop_vector ? type->vector_elements : ir_expression::get_num_operands((ir_expression_operation)op);
+		if (n != expected || n > 4)
+			break;
+		ir_rvalue* ops[4] = { NULL, NULL, NULL, NULL };
+		for (unsigned i = 0; i < n; ++i)
+		{
+			ops[i] = read_rvalue();
+			if (!ops[i])
+				return NULL;
+		}
+		res = new(mem_ctx) ir_expression(op, type, ops[0], ops[1], ops[2], ops[3]);
+		break;
+	}
+	case ir_type_texture:
+	{
+		const unsigned op = b.read_uint();
+		if (op > ir_query_levels)
+			break;
+		ir_texture* tex = new(mem_ctx) ir_texture((ir_texture_opcode)op);
+		tex->sampler = read_deref();
+		tex->coordinate = read_rvalue();
+		tex->offset = read_rvalue();
+		switch (tex->op)
+		{
+		case ir_tex:
+		case ir_lod:
+		case ir_query_levels:
+			break;
+		case ir_txb:
+			tex->lod_info.bias = read_rvalue();
+			break;
+		case ir_txl:
+		case ir_txf:
+		case ir_txs:
+			tex->lod_info.lod = read_rvalue();
+			break;
+		case ir_txf_ms:
+			tex->lod_info.sample_index = read_rvalue();
+			break;
+		case ir_txd:
+			tex->lod_info.grad.dPdx = read_rvalue();
+			tex->lod_info.grad.dPdy = read_rvalue();
+			break;
+		case ir_tg4:
+			tex->lod_info.component = read_rvalue();
+			break;
+		}
+		if (tex_operands_present(tex))
+			res = tex;
+		break;
+	}
+	case ir_type_constant:
+	{
+		ir_constant* c;
+		if (type->is_array() || type->is_record())
+		{
+			exec_list values;
+			for (unsigned i = 0; i < type->length; ++i)
+			{
+				ir_rvalue* elem = read_rvalue();
+				if (!elem || !elem->as_constant())
+					return NULL;
+				values.push_tail(elem);
+			}
+			c = new(mem_ctx) ir_constant(type, &values);
+		}
+		else
+		{
+			ir_constant_data data;
+			memset(&data, 0, sizeof(data));
+			const unsigned n = MIN2(type->components(), 16u);
+			for (unsigned i = 0; i < n; ++i)
+			{
+				if (type->base_type == GLSL_TYPE_BOOL)
+					data.b[i] = b.read_uint() != 0;
+				else
+					b.read_bytes(&data.u[i], sizeof(data.u[i]));
+			}
+			c = new(mem_ctx) ir_constant(type, &data);
+		}
+		res = c;
+		break;
+	}
+	}
+
+	if (!res)
+	{
+		fail();
+		return NULL;
+	}
+	res->type = type;
+	res->set_precision(precision);
+	return res;
+}
+
+
+bool ir_serialize_reader::deserialize(exec_list* instructions, _mesa_glsl_parse_state* state)
+{
+	gl_shader_stage stage;
+	if (!read_header(&stage, state))
+		return false;
+	if (!read_type_records() || !read_var_records() || !read_sig_and_func_records())
+		return false;
+	if (!read_list(instructions))
+		return false;
+	// trailing garbage means the blob is not what we think it is
+	return ok() && b.cur == b.end;
+}
+
+
+bool serialized_ir_stage(const void* data, size_t size, gl_shader_stage* outStage)
+{
+	ir_serialize_reader r(data, size, NULL);
+	return r.read_header(outStage, NULL);
+}
+
+bool deserialize_ir(const void* data, size_t size, exec_list* instructions, _mesa_glsl_parse_state* state, void* mem_ctx)
+{
+	ir_serialize_reader r(data, size, mem_ctx);
+	return r.deserialize(instructions, state);
+}
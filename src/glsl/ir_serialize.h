@@ -0,0 +1,24 @@
+#pragma once
+#ifndef IR_SERIALIZE_H
+#define IR_SERIALIZE_H
+
+#include "ir.h"
+
+struct _mesa_glsl_parse_state;
+
+// Binary (de)serialization of the IR; types, variables, functions and
+// instructions along with their precision. Blobs are only meant to be read back
+// by the same library build that wrote them.
+
+// Writes instructions (and the parse state bits needed for printing) into a blob
+// allocated off mem_ctx.
+char* serialize_ir(exec_list* instructions, _mesa_glsl_parse_state* state, void* mem_ctx, size_t* outSize);
+
+// Gets shader stage the blob was written for; returns false if blob is invalid.
+bool serialized_ir_stage(const void* data, size_t size, gl_shader_stage* outStage);
+
+// Reads blob back into instructions (allocated off mem_ctx), and sets up state
+// for printing. Returns false if blob is invalid.
+bool deserialize_ir(const void* data, size_t size, exec_list* instructions, _mesa_glsl_parse_state* state, void* mem_ctx);
+
+#endif /* IR_SERIALIZE_H */
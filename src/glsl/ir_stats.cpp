@@ -1,7 +1,10 @@
+#include "ir_stats.h"
 #include "ir.h"
 #include "ir_visitor.h"
 #include "ir_unused_structs.h"
 #include "glsl_types.h"
+#include "loop_analysis.h"
+#include "program/hash_table.h"
 
 struct ir_stats_counter_visitor : public ir_hierarchical_visitor {
 	ir_stats_counter_visitor()
@@ -62,3 +65,394 @@ void calculate_shader_stats(exec_list* instructions, int* outMath, int* outTex,
 	*outTex = v.tex;
 	*outFlow = v.flow;
 }
+
+
+// Cost model
+//
+// Operations are weighed by kind and size; a vec4 GPU does a vector (or a
+// matrix column) in one instruction, a scalar one needs an instruction per
+// component. Division and the transcendental functions are per component on
+// both.
+
+void get_default_cost_model(glslopt_cost_family family, glslopt_cost_model* outModel)
+{
+	const bool scalar = family == kGlslCostFamilyScalar;
+	float* w = outModel->weights;
+	for (int i = 0; i < kGlslCostOpCount; ++i)
+		w[i] = 1.0f;
+	// scalar GPUs run transcendentals at a quarter rate or so
+	w[kGlslCostDiv] = scalar ? 5.0f : 2.0f;
+	w[kGlslCostSqrt] = scalar ? 4.0f : 1.0f;
+	w[kGlslCostExp] = scalar ? 4.0f : 1.0f;
+	w[kGlslCostPow] = scalar ? 9.0f : 3.0f;
+	w[kGlslCostTrig] = scalar ? 4.0f : 1.0f;
+	outModel->scalarALU = scalar;
+	outModel->unknownLoopIterations = 8;
+}
+
+static float alu_cost(const glslopt_cost_model* model, glslopt_cost_op op, unsigned components, unsigned vectors)
+{
+	return model->weights[op] * (model->scalarALU ? components : vectors);
+}
+
+static float per_component_cost(const glslopt_cost_model* model, glslopt_cost_op op, unsigned components)
+{
+	return model->weights[op] * components;
+}
+
+float expression_cost(const ir_expression* expr, const glslopt_cost_model* model)
+{
+	// size of the widest of the result and operands
+	unsigned width = expr->type->vector_elements;
+	unsigned columns = expr->type->matrix_columns;
+	for (unsigned i = 0; i < expr->get_num_operands(); ++i)
+	{
+		const glsl_type* type = expr->operands[i]->type;
+		width = MAX2(width, type->vector_elements);
+		columns = MAX2(columns, type->matrix_columns);
+	}
+	const unsigned comps = width * columns;
+	const unsigned vecs = columns;
+
+	switch (expr->operation)
+	{
+	case ir_unop_bitcast_i2f:
+	case ir_unop_bitcast_f2i:
+	case ir_unop_bitcast_u2f:
+	case ir_unop_bitcast_f2u:
+		return 0.0f;
+
+	case ir_unop_f2i:
+	case ir_unop_f2u:
+	case ir_unop_i2f:
+	case ir_unop_f2b:
+	case ir_unop_b2f:
+	case ir_unop_i2b:
+	case ir_unop_b2i:
+	case ir_unop_u2f:
+	case ir_unop_i2u:
+	case ir_unop_u2i:
+		return alu_cost(model, kGlslCostConvert, comps, vecs);
+
+	case ir_unop_rcp:
+	case ir_binop_div:
+		return per_component_cost(model, kGlslCostDiv, comps);
+	case ir_binop_mod:
+		// x - y * floor(x/y)
+		return per_component_cost(model, kGlslCostDiv, comps) + alu_cost(model, kGlslCostAdd, comps, vecs) + alu_cost(model, kGlslCostMad, comps, vecs);
+	case ir_unop_rsq:
+	case ir_unop_sqrt:
+		return per_component_cost(model, kGlslCostSqrt, comps);
+	case ir_unop_normalize:
+		return alu_cost(model, kGlslCostDot, comps, vecs) + per_component_cost(model, kGlslCostSqrt, 1) + alu_cost(model, kGlslCostMul, comps, vecs);
+	case ir_unop_exp:
+	case ir_unop_log:
+	case ir_unop_exp2:
+	case ir_unop_log2:
+		return per_component_cost(model, kGlslCostExp, comps);
+	case ir_binop_pow:
+		return per_component_cost(model, kGlslCostPow, comps);
+	case ir_unop_sin:
+	case ir_unop_cos:
+	case ir_unop_sin_reduced:
+	case ir_unop_cos_reduced:
+	case ir_unop_noise:
+		return per_component_cost(model, kGlslCostTrig, comps);
+
+	case ir_unop_dFdx:
+	case ir_unop_dFdx_coarse:
+	case ir_unop_dFdx_fine:
+	case ir_unop_dFdy:
+	case ir_unop_dFdy_coarse:
+	case ir_unop_dFdy_fine:
+		return alu_cost(model, kGlslCostDerivative, comps, vecs);
+
+	case ir_binop_mul:
+	{
+		const glsl_type* a = expr->operands[0]->type;
+		const glsl_type* b = expr->operands[1]->type;
+		if ((a->is_matrix() || b->is_matrix()) && !a->is_scalar() && !b->is_scalar())
+		{
+			// a multiply-add per result component and step of the inner
+			// dimension; vec4 GPUs do a column (or a dot) at a time
+			const unsigned inner = a->is_matrix() ? a->matrix_columns : a->vector_elements;
+			const unsigned madComps = expr->type->components() * inner;
+			const unsigned rows = a->is_matrix() ? a->vector_elements : inner;
+			return alu_cost(model, kGlslCostMad, madComps, madComps / rows);
+		}
+		return alu_cost(model, kGlslCostMul, comps, vecs);
+	}
+	case ir_binop_imul_high:
+	case ir_binop_ldexp:
+		return alu_cost(model, kGlslCostMul, comps, vecs);
+
+	case ir_triop_fma:
+		return alu_cost(model, kGlslCostMad, comps, vecs);
+	case ir_triop_lrp:
+		// x + (y - x) * a
+		return alu_cost(model, kGlslCostAdd, comps, vecs) + alu_cost(model, kGlslCostMad, comps, vecs);
+	case ir_triop_clamp:
+		return 2.0f * alu_cost(model, kGlslCostAdd, comps, vecs);
+
+	case ir_binop_dot:
+		return alu_cost(model, kGlslCostDot, comps, 1);
+
+	case ir_unop_logic_not:
+	case ir_unop_any:
+	case ir_binop_less:
+	case ir_binop_greater:
+	case ir_binop_lequal:
+	case ir_binop_gequal:
+	case ir_binop_equal:
+	case ir_binop_nequal:
+	case ir_binop_all_equal:
+	case ir_binop_any_nequal:
+	case ir_binop_logic_and:
+	case ir_binop_logic_xor:
+	case ir_binop_logic_or:
+	case ir_triop_csel:
+		return alu_cost(model, kGlslCostCompare, comps, vecs);
+
+	case ir_binop_vector_extract:
+	case ir_triop_vector_insert:
+	case ir_quadop_vector:
+	case ir_binop_ubo_load:
+		return alu_cost(model, kGlslCostMove, expr->type->components(), 1);
+
+	default:
+		return alu_cost(model, kGlslCostAdd, comps, vecs);
+	}
+}
+
+
+// Sums up costs of a function body, with loop bodies scaled by their
+// iteration counts and calls by the cost of the called function.
+struct ir_cost_visitor : public ir_hierarchical_visitor {
+	ir_cost_visitor(const glslopt_cost_model* model, loop_state* loops, hash_table* functionCosts, void* mem_ctx)
+		: model(model), loops(loops), functionCosts(functionCosts), mem_ctx(mem_ctx), scale(1.0f)
+	{
+		cost.alu = cost.tex = cost.flow = 0.0f;
+		cost.registers = 0;
+	}
+
+	unsigned loop_iterations(const ir_loop* ir) const
+	{
+		loop_variable_state* ls = loops->get(ir);
+		if (ls && ls->limiting_terminator)
+			return ls->limiting_terminator->iterations;
+		return model->unknownLoopIterations;
+	}
+
+	void add_flow()
+	{
+		cost.flow += scale * model->weights[kGlslCostBranch];
+	}
+
+	virtual ir_visitor_status visit_enter(ir_loop* ir)
+	{
+		const float outerScale = scale;
+		scale *= loop_iterations(ir);
+		add_flow();
+		visit_list_elements(this, &ir->body_instructions);
+		scale = outerScale;
+		return visit_continue_with_parent;
+	}
+	virtual ir_visitor_status visit_leave(ir_expression* ir)
+	{
+		cost.alu += scale * expression_cost(ir, model);
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_texture*)
+	{
+		cost.tex += scale * model->weights[kGlslCostTexture];
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_assignment* ir)
+	{
+		// results of expressions & texture fetches are written in place
+		ir_rvalue* rhs = ir->rhs;
+		if (!rhs->as_expression() && !rhs->as_texture())
+		{
+			const glsl_type* type = ir->lhs->type;
+			const unsigned comps = type->is_vector() || type->is_scalar() ? _mesa_bitcount(ir->write_mask) : type->component_slots();
+			cost.alu += scale * alu_cost(model, kGlslCostMove, comps, MAX2(type->matrix_columns, 1u));
+		}
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_enter(ir_call* ir)
+	{
+		const glslopt_shader_cost callee = function_cost(ir->callee);
+		cost.alu += scale * callee.alu;
+		cost.tex += scale * callee.tex;
+		cost.flow += scale * callee.flow;
+		add_flow();
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_if*)
+	{
+		add_flow();
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_return*)
+	{
+		add_flow();
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_leave(ir_discard*)
+	{
+		add_flow();
+		return visit_continue;
+	}
+
+	glslopt_shader_cost function_cost(const ir_function_signature* sig)
+	{
+		glslopt_shader_cost* known = (glslopt_shader_cost*)hash_table_find(functionCosts, sig);
+		if (known)
+			return *known;
+
+		ir_cost_visitor v(model, loops, functionCosts, mem_ctx);
+		v.run(const_cast<exec_list*>(&sig->body));
+		known = ralloc(mem_ctx, glslopt_shader_cost);
+		*known = v.cost;
+		hash_table_insert(functionCosts, known, sig);
+		return v.cost;
+	}
+
+	const glslopt_cost_model* model;
+	loop_state* loops;
+	hash_table* functionCosts;
+	void* mem_ctx;
+	float scale;
+	glslopt_shader_cost cost;
+};
+
+
+// Estimates register pressure: a local variable takes its registers from its
+// first to its last use, and for the whole of any loop that uses it if it
+// was set before the loop.
+struct ir_live_range_visitor : public ir_hierarchical_visitor {
+	struct live_range : public exec_node {
+		ir_variable* var;
+		int first;
+		int last;
+	};
+
+	ir_live_range_visitor(void* mem_ctx)
+		: mem_ctx(mem_ctx), position(0)
+	{
+		rangeHash = hash_table_ctor(0, hash_table_pointer_hash, hash_table_pointer_compare);
+	}
+	~ir_live_range_visitor()
+	{
+		hash_table_dtor(rangeHash);
+	}
+
+	virtual ir_visitor_status visit(ir_dereference_variable* ir)
+	{
+		ir_variable* var = ir->var;
+		if (var->data.mode != ir_var_auto && var->data.mode != ir_var_temporary)
+			return visit_continue;
+
+		live_range* range = (live_range*)hash_table_find(rangeHash, var);
+		if (!range)
+		{
+			range = ralloc(mem_ctx, live_range);
+			range->var = var;
+			range->first = position;
+			ranges.push_tail(range);
+			hash_table_insert(rangeHash, range, var);
+		}
+		range->last = position;
+		return visit_continue;
+	}
+	virtual ir_visitor_status visit_enter(ir_loop* ir)
+	{
+		const int start = ++position;
+		visit_list_elements(this, &ir->body_instructions);
+		const int end = ++position;
+		foreach_in_list(live_range, range, &ranges)
+		{
+			if (range->first < start && range->last >= start)
+				range->last = end;
+		}
+		return visit_continue_with_parent;
+	}
+	virtual ir_visitor_status visit_enter(ir_assignment*) { ++position; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_call*) { ++position; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_if*) { ++position; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_return*) { ++position; return visit_continue; }
+	virtual ir_visitor_status visit_enter(ir_discard*) { ++position; return visit_continue; }
+
+	// A value dies where it's last read, so the instruction can reuse its
+	// registers for its result.
+	int peak_registers(bool scalarALU)
+	{
+		int* delta = rzalloc_array(mem_ctx, int, position + 2);
+		foreach_in_list(live_range, range, &ranges)
+		{
+			const glsl_type* type = range->var->type;
+			const int size = scalarALU ? type->component_slots() : type->count_attribute_slots();
+			delta[range->first] += size;
+			delta[MAX2(range->last, range->first + 1)] -= size;
+		}
+		int live = 0, peak = 0;
+		for (int i = 0; i <= position; ++i)
+		{
+			live += delta[i];
+			peak = MAX2(peak, live);
+		}
+		return peak;
+	}
+
+	void* mem_ctx;
+	hash_table* rangeHash;
+	exec_list ranges;
+	int position;
+};
+
+
+void calculate_shader_cost(exec_list* instructions, const glslopt_cost_model* model, glslopt_shader_cost* outCost)
+{
+	void* mem_ctx = ralloc_context(NULL);
+	hash_table* functionCosts = hash_table_ctor(0, hash_table_pointer_hash, hash_table_pointer_compare);
+	loop_state* loops = analyze_loop_variables(instructions);
+	ir_cost_visitor costs(model, loops, functionCosts, mem_ctx);
+	int registers = 0;
+
+	// main() if there's one, otherwise everything
+	ir_function_signature* mainSig = NULL;
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_function* func = node->as_function();
+		if (func && !strcmp(func->name, "main"))
+		{
+			foreach_in_list(ir_function_signature, sig, &func->signatures)
+			{
+				if (sig->is_defined)
+					mainSig = sig;
+			}
+		}
+	}
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_function* func = node->as_function();
+		if (!func)
+			continue;
+		foreach_in_list(ir_function_signature, sig, &func->signatures)
+		{
+			if (!sig->is_defined || sig->is_builtin() || (mainSig && sig != mainSig))
+				continue;
+			costs.run(&sig->body);
+			ir_live_range_visitor ranges(mem_ctx);
+			ranges.run(&sig->body);
+			registers = MAX2(registers, ranges.peak_registers(model->scalarALU));
+		}
+	}
+
+	*outCost = costs.cost;
+	outCost->registers = registers;
+
+	delete loops;
+	hash_table_dtor(functionCosts);
+	ralloc_free(mem_ctx);
+}
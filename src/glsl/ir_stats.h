@@ -1,3 +1,14 @@
+#pragma once
 #include "ir.h"
+#include "glsl_optimizer.h"
 
 void calculate_shader_stats(exec_list* instructions, int* outMath, int* outTex, int* outFlow);
+
+// Fills in the default cost model of a GPU family.
+void get_default_cost_model(glslopt_cost_family family, glslopt_cost_model* outModel);
+
+// Estimated cost of main() (or of all functions, if there's no main).
+void calculate_shader_cost(exec_list* instructions, const glslopt_cost_model* model, glslopt_shader_cost* outCost);
+
+// ALU cost of a single expression node, not counting its operands.
+float expression_cost(const ir_expression* expr, const glslopt_cost_model* model);
@@ -0,0 +1,134 @@
+#include "ir_uniform_values.h"
+#include "ir_rvalue_visitor.h"
+#include "glsl_types.h"
+#include "util/hash_table.h"
+
+static bool can_bake(const ir_variable* var)
+{
+	const glsl_type* type = var->type;
+	return var->data.mode == ir_var_uniform && (type->is_scalar() || type->is_vector() || type->is_matrix());
+}
+
+static ir_constant* make_uniform_constant(void* mem_ctx, const glsl_type* type, const glslopt_uniform_value& value)
+{
+	ir_constant_data data;
+	memset(&data, 0, sizeof(data));
+	for (unsigned i = 0; i < type->components(); ++i)
+	{
+		switch (type->base_type)
+		{
+		case GLSL_TYPE_FLOAT: data.f[i] = value.values[i]; break;
+		case GLSL_TYPE_INT: data.i[i] = value.intValues[i]; break;
+		case GLSL_TYPE_UINT: data.u[i] = value.uintValues[i]; break;
+		case GLSL_TYPE_BOOL: data.b[i] = value.intValues[i] != 0; break;
+		default: assert(!"unexpected uniform type"); break;
+		}
+	}
+	return new(mem_ctx) ir_constant(type, &data);
+}
+
+struct uniform_baking_visitor : public ir_rvalue_visitor {
+	uniform_baking_visitor(hash_table* values)
+		: values(values)
+	{
+	}
+
+	virtual void handle_rvalue(ir_rvalue** rvalue)
+	{
+		ir_dereference_variable* deref = *rvalue ? (*rvalue)->as_dereference_variable() : NULL;
+		if (!deref)
+			return;
+		hash_entry* e = _mesa_hash_table_search(values, _mesa_hash_pointer(deref->var), deref->var);
+		if (e)
+			*rvalue = ((ir_constant*)e->data)->clone(ralloc_parent(deref), NULL);
+	}
+
+	// ir_variable -> ir_constant of its value
+	hash_table* values;
+};
+
+bool bake_uniform_values(exec_list* instructions, const glslopt_uniform_value* values, int count)
+{
+	hash_table* baked = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+	bool progress = false;
+	foreach_in_list_safe(ir_instruction, node, instructions)
+	{
+		ir_variable* var = node->as_variable();
+		if (!var || !can_bake(var))
+			continue;
+		for (int i = 0; i < count; ++i)
+		{
+			if (strcmp(var->name, values[i].name) != 0)
+				continue;
+			_mesa_hash_table_insert(baked, _mesa_hash_pointer(var), var, make_uniform_constant(ralloc_parent(var), var->type, values[i]));
+			var->remove();
+			progress = true;
+			break;
+		}
+	}
+
+	if (progress)
+	{
+		uniform_baking_visitor v(baked);
+		v.run(instructions);
+	}
+	_mesa_hash_table_destroy(baked, NULL);
+	return progress;
+}
+
+
+// Adds the variables read by the IR it is run on to a set.
+struct variable_reads_visitor : public ir_hierarchical_visitor {
+	variable_reads_visitor(hash_table* variables)
+		: variables(variables), progress(false)
+	{
+	}
+
+	virtual ir_visitor_status visit(ir_dereference_variable* ir)
+	{
+		const uint32_t hash = _mesa_hash_pointer(ir->var);
+		if (!_mesa_hash_table_search(variables, hash, ir->var))
+		{
+			_mesa_hash_table_insert(variables, hash, ir->var, ir->var);
+			progress = true;
+		}
+		return visit_continue;
+	}
+
+	hash_table* variables;
+	bool progress;
+};
+
+struct branch_inputs_visitor : public ir_hierarchical_visitor {
+	branch_inputs_visitor(hash_table* variables)
+		: reads(variables)
+	{
+	}
+
+	virtual ir_visitor_status visit_enter(ir_if* ir)
+	{
+		ir->condition->accept(&reads);
+		return visit_continue;
+	}
+
+	virtual ir_visitor_status visit_enter(ir_assignment* ir)
+	{
+		// assignments to anything the branches depend on make whatever they
+		// read a dependency too
+		ir_variable* var = ir->lhs->variable_referenced();
+		if (var && _mesa_hash_table_search(reads.variables, _mesa_hash_pointer(var), var))
+			ir->accept(&reads);
+		return visit_continue_with_parent;
+	}
+
+	variable_reads_visitor reads;
+};
+
+void find_branch_inputs(exec_list* instructions, hash_table* outVariables)
+{
+	branch_inputs_visitor v(outVariables);
+	do {
+		v.reads.progress = false;
+		v.run(instructions);
+	} while (v.reads.progress);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#ifndef IR_UNIFORM_VALUES_H
+#define IR_UNIFORM_VALUES_H
+
+#include "ir.h"
+#include "glsl_optimizer.h"
+
+struct hash_table;
+
+// Replaces reads of the named uniforms with constants of the passed values, and
+// removes their declarations. Only non-array scalar, vector and matrix uniforms
+// are baked. Returns true if anything was replaced.
+bool bake_uniform_values(exec_list* instructions, const glslopt_uniform_value* values, int count);
+
+// Adds the variables read by conditions of if statements (loop exits included)
+// to outVariables (a pointer hash table, see util/hash_table.h), along with
+// the variables that the values of those are computed from.
+void find_branch_inputs(exec_list* instructions, hash_table* outVariables);
+
+#endif /* IR_UNIFORM_VALUES_H */
@@ -56,6 +56,13 @@ extern bool
 unroll_loops(exec_list *instructions, loop_state *ls,
              const struct gl_shader_compiler_options *options);
 
+
+/**
+ * Move loop invariant expressions and texture fetches out of loops
+ */
+extern bool
+hoist_loop_invariants(exec_list *instructions, loop_state *ls);
+
 ir_rvalue *
 find_initial_value(ir_loop *loop, ir_variable *var);
 
@@ -0,0 +1,265 @@
+/**
+ * \file loop_invariants.cpp
+ *
+ * Moves computations whose value doesn't change from one iteration of a loop
+ * to the next out of the loop, into temporaries set up right before it.
+ *
+ * Loops that get unrolled don't need this (CSE and constant folding clean up
+ * the unrolled copies), but loops that are too large or have an unknown trip
+ * count are otherwise left recomputing uniform-only math every iteration.
+ *
+ * An expression is invariant when all the variables it reads are declared
+ * outside of the loop and not assigned anywhere in it, according to loop
+ * analysis.  Only whole expression trees and texture fetches are moved;
+ * moving a plain variable read gains nothing.  Texture fetches are only
+ * moved when they run on every iteration, i.e. are not inside an if
+ * statement in the loop.  Loops containing calls are left alone, as calls
+ * may write to any of the variables.
+ *
+ * A moved expression is evaluated even if the loop runs no iterations at
+ * all; GLSL expressions have no side effects, so that only costs time.
+ */
+
+#include "ir.h"
+#include "ir_rvalue_visitor.h"
+#include "loop_analysis.h"
+#include "glsl_types.h"
+#include "util/hash_table.h"
+
+static bool
+leaves_loop(exec_list *instructions)
+{
+   ir_instruction *last = (ir_instruction *) instructions->get_tail();
+   if (last == NULL)
+      return false;
+
+   switch (last->ir_type) {
+   case ir_type_loop_jump:
+      return ((ir_loop_jump *) last)->is_break();
+   case ir_type_return:
+      return true;
+   case ir_type_discard:
+      return ((ir_discard *) last)->condition == NULL;
+   default:
+      return false;
+   }
+}
+
+
+namespace {
+
+class invariant_rvalue_check : public ir_hierarchical_visitor {
+public:
+   invariant_rvalue_check(loop_variable_state *ls, hash_table *loop_locals)
+      : ls(ls), loop_locals(loop_locals), invariant(true), reads_variables(false)
+   {
+   }
+
+   virtual ir_visitor_status visit(ir_dereference_variable *ir)
+   {
+      ir_variable *var = ir->var;
+      loop_variable *lv = ls->get(var);
+
+      reads_variables = true;
+      if (_mesa_hash_table_search(loop_locals, _mesa_hash_pointer(var), var) ||
+          (lv && lv->num_assignments != 0 && !var->data.read_only)) {
+         invariant = false;
+         return visit_stop;
+      }
+      return visit_continue;
+   }
+
+   loop_variable_state *ls;
+   hash_table *loop_locals;
+   bool invariant;
+   bool reads_variables;
+};
+
+
+class loop_invariant_visitor : public ir_rvalue_enter_visitor {
+public:
+   loop_invariant_visitor(ir_loop *loop, loop_variable_state *ls,
+                          hash_table *loop_locals)
+      : loop(loop), ls(ls), loop_locals(loop_locals), if_depth(0),
+        progress(false)
+   {
+   }
+
+   virtual ir_visitor_status visit_enter(ir_loop *)
+   {
+      /* Nested loops get their own turn; whatever they hoist lands in this
+       * loop's body and is picked up on the next round.
+       */
+      return visit_continue_with_parent;
+   }
+
+   virtual ir_visitor_status visit_enter(ir_if *ir)
+   {
+      handle_rvalue(&ir->condition);
+
+      /* A branch leaving the loop runs at most once, so there's nothing to
+       * gain from moving its code out.
+       */
+      if_depth++;
+      if (!leaves_loop(&ir->then_instructions))
+         visit_list_elements(this, &ir->then_instructions);
+      if (!leaves_loop(&ir->else_instructions))
+         visit_list_elements(this, &ir->else_instructions);
+      if_depth--;
+      return visit_continue_with_parent;
+   }
+
+   virtual void handle_rvalue(ir_rvalue **rvalue);
+
+   ir_loop *loop;
+   loop_variable_state *ls;
+   hash_table *loop_locals;
+   unsigned if_depth;
+   bool progress;
+};
+
+} /* anonymous namespace */
+
+
+void
+loop_invariant_visitor::handle_rvalue(ir_rvalue **rvalue)
+{
+   ir_rvalue *ir = *rvalue;
+   if (ir == NULL)
+      return;
+
+   if (ir->as_expression() == NULL) {
+      if (ir->as_texture() == NULL || if_depth != 0)
+         return;
+   }
+
+   invariant_rvalue_check check(ls, loop_locals);
+   ir->accept(&check);
+   if (!check.invariant || !check.reads_variables)
+      return;
+
+   void *mem_ctx = ralloc_parent(ir);
+   ir_variable *var = new(mem_ctx) ir_variable(ir->type, "licm",
+                                               ir_var_temporary,
+                                               ir->get_precision());
+   loop->insert_before(var);
+   loop->insert_before(new(mem_ctx) ir_assignment(
+                          new(mem_ctx) ir_dereference_variable(var), ir));
+   *rvalue = new(mem_ctx) ir_dereference_variable(var);
+   progress = true;
+}
+
+
+namespace {
+
+/**
+ * Collects the variables declared in a loop body, nested blocks included.
+ */
+class loop_locals_visitor : public ir_hierarchical_visitor {
+public:
+   loop_locals_visitor(hash_table *locals) : locals(locals)
+   {
+   }
+
+   virtual ir_visitor_status visit(ir_variable *ir)
+   {
+      _mesa_hash_table_insert(locals, _mesa_hash_pointer(ir), ir, ir);
+      return visit_continue;
+   }
+
+   hash_table *locals;
+};
+
+
+class loop_invariant_hoisting_visitor : public ir_hierarchical_visitor {
+public:
+   loop_invariant_hoisting_visitor(loop_state *state)
+      : state(state), progress(false)
+   {
+      this->mem_ctx = ralloc_context(NULL);
+      this->hoisted_into = _mesa_hash_table_create(NULL,
+                                                   _mesa_key_pointer_equal);
+   }
+
+   ~loop_invariant_hoisting_visitor()
+   {
+      _mesa_hash_table_destroy(this->hoisted_into, NULL);
+      ralloc_free(this->mem_ctx);
+   }
+
+   virtual ir_visitor_status visit_enter(ir_loop *ir);
+   virtual ir_visitor_status visit_leave(ir_loop *ir);
+
+   loop_state *state;
+
+   /** Enclosing loops of the current one, innermost first. */
+   exec_list loop_stack;
+
+   /**
+    * Loops that got code hoisted into their bodies; loop analysis of them
+    * doesn't know about it, so they're left for the next round.
+    */
+   hash_table *hoisted_into;
+
+   void *mem_ctx;
+   bool progress;
+};
+
+
+struct loop_stack_entry : public exec_node {
+   ir_loop *loop;
+};
+
+} /* anonymous namespace */
+
+
+ir_visitor_status
+loop_invariant_hoisting_visitor::visit_enter(ir_loop *ir)
+{
+   loop_stack_entry *entry = ralloc(this->mem_ctx, loop_stack_entry);
+   entry->loop = ir;
+   this->loop_stack.push_head(entry);
+   return visit_continue;
+}
+
+
+ir_visitor_status
+loop_invariant_hoisting_visitor::visit_leave(ir_loop *ir)
+{
+   ralloc_free(this->loop_stack.pop_head());
+
+   loop_variable_state *const ls = this->state->get(ir);
+   if (ls == NULL || ls->contains_calls ||
+       _mesa_hash_table_search(this->hoisted_into, _mesa_hash_pointer(ir), ir))
+      return visit_continue;
+
+   hash_table *locals = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+   loop_locals_visitor find_locals(locals);
+   visit_list_elements(&find_locals, &ir->body_instructions);
+
+   loop_invariant_visitor v(ir, ls, locals);
+   visit_list_elements(&v, &ir->body_instructions);
+   _mesa_hash_table_destroy(locals, NULL);
+
+   if (v.progress) {
+      this->progress = true;
+      if (!this->loop_stack.is_empty()) {
+         ir_loop *outer = ((loop_stack_entry *) this->loop_stack.get_head())->loop;
+         _mesa_hash_table_insert(this->hoisted_into, _mesa_hash_pointer(outer),
+                                 outer, outer);
+      }
+   }
+
+   return visit_continue;
+}
+
+
+bool
+hoist_loop_invariants(exec_list *instructions, loop_state *ls)
+{
+   loop_invariant_hoisting_visitor v(ls);
+
+   v.run(instructions);
+
+   return v.progress;
+}
@@ -24,6 +24,7 @@
 #include "glsl_types.h"
 #include "loop_analysis.h"
 #include "ir_hierarchical_visitor.h"
+#include "ir_rvalue_visitor.h"
 
 #include "main/mtypes.h"
 
@@ -44,6 +45,7 @@ public:
    void complex_unroll(ir_loop *ir, int iterations,
                        bool continue_from_then_branch);
    void splice_post_if_instructions(ir_if *ir_if, exec_list *splice_dest);
+   void partial_unroll(ir_loop *ir, loop_variable_state *ls, int iterations);
 
    loop_state *state;
 
@@ -63,6 +65,7 @@ is_break(ir_instruction *ir)
 class loop_unroll_count : public ir_hierarchical_visitor {
 public:
    int nodes;
+   int textures;
    bool unsupported_variable_indexing;
    /* If there are nested loops, the node count will be inaccurate. */
    bool nested_loop;
@@ -72,6 +75,7 @@ public:
       : ls(ls), options(options)
    {
       nodes = 0;
+      textures = 0;
       nested_loop = false;
       unsupported_variable_indexing = false;
 
@@ -90,6 +94,12 @@ public:
       return visit_continue;
    }
 
+   virtual ir_visitor_status visit_enter(ir_texture *)
+   {
+      textures++;
+      return visit_continue;
+   }
+
    virtual ir_visitor_status visit_enter(ir_loop *)
    {
       nested_loop = true;
@@ -244,6 +254,187 @@ loop_unroll_visitor::complex_unroll(ir_loop *ir, int iterations,
 }
 
 
+namespace {
+
+/**
+ * Replaces reads of a loop counter with copies of \c value.
+ */
+class counter_replace_visitor : public ir_rvalue_visitor {
+public:
+   counter_replace_visitor(ir_variable *counter, ir_rvalue *value)
+      : counter(counter), value(value)
+   {
+   }
+
+   virtual void handle_rvalue(ir_rvalue **rvalue)
+   {
+      ir_dereference_variable *deref =
+         *rvalue ? (*rvalue)->as_dereference_variable() : NULL;
+      if (deref == NULL || deref->var != counter)
+         return;
+
+      *rvalue = value->clone(ralloc_parent(deref), NULL);
+   }
+
+   ir_variable *counter;
+   ir_rvalue *value;
+};
+
+} /* anonymous namespace */
+
+
+/**
+ * Value \c steps increments of \c increment after \c start, or after zero
+ * if \c start is NULL.
+ */
+static ir_constant *
+counter_value(void *mem_ctx, ir_constant *start, ir_constant *increment,
+              int steps)
+{
+   return new(mem_ctx) ir_constant((start ? start->value.i[0] : 0) +
+                                   increment->value.i[0] * steps);
+}
+
+
+/**
+ * Unroll a loop partially: repeat its body \c factor times per iteration,
+ * and run the iterations left over after the loop.  For example, a loop
+ * with 11 iterations
+ *
+ *     (loop (
+ *        (if (i >= 11) (break))
+ *        ...body...
+ *        (assign i (i + 1))))
+ *
+ * unrolled by a factor of 4 becomes
+ *
+ *     (loop (
+ *        (if (i >= 8) (break))
+ *        ...body...
+ *        ...body with i + 1 for i...
+ *        ...body with i + 2 for i...
+ *        ...body with i + 3 for i...
+ *        (assign i (i + 4))))
+ *     ...body with 8 for i...
+ *     ...body with 9 for i...
+ *     ...body with 10 for i...
+ *     (assign i 11)  if i is read after the loop
+ *
+ * The counter stays the only induction variable of the loop, which keeps
+ * it a canonical for loop for GLSL ES 1.00, and the leftover iterations
+ * don't read it.
+ *
+ * The factor is the largest power of two up to MaxUnrollFactor that keeps
+ * the unrolled body within the size allowed for completely unrolled loops.
+ * Texture fetches count extra: each unrolled copy keeps its fetch results
+ * live, which raises register pressure more than plain math.
+ *
+ * Only loops that end with the single increment of an int counter, and
+ * have no jumps but the terminator, are handled.
+ */
+void
+loop_unroll_visitor::partial_unroll(ir_loop *ir, loop_variable_state *ls,
+                                    int iterations)
+{
+   if (options->MaxUnrollFactor < 2 || ls->num_loop_jumps != 1)
+      return;
+
+   ir_if *terminator = ls->limiting_terminator->ir;
+   ir_expression *cond = terminator->condition->as_expression();
+   if (cond == NULL || cond->get_num_operands() != 2)
+      return;
+
+   ir_dereference_variable *counter_deref =
+      cond->operands[0]->as_dereference_variable();
+   if (counter_deref == NULL)
+      counter_deref = cond->operands[1]->as_dereference_variable();
+   if (counter_deref == NULL)
+      return;
+
+   ir_variable *counter = counter_deref->var;
+   loop_variable *lv = ls->get(counter);
+   if (lv == NULL || !lv->is_induction_var() || lv->num_assignments != 1 ||
+       lv->conditional_or_nested_assignment ||
+       counter->type != glsl_type::int_type)
+      return;
+
+   /* Decrements are negated expressions */
+   ir_constant *start =
+      lv->initial_value ? lv->initial_value->constant_expression_value() : NULL;
+   ir_constant *increment = lv->increment->constant_expression_value();
+   if (start == NULL || increment == NULL ||
+       (ir_instruction *) ir->body_instructions.get_tail() != lv->first_assignment)
+      return;
+
+   loop_unroll_count count(&ir->body_instructions, ls, options);
+   if (count.nested_loop)
+      return;
+
+   const int cost = count.nodes + 8 * count.textures;
+   const int max_cost = (int) options->MaxUnrollIterations * 25;
+   int factor = 1;
+   while (factor * 2 <= (int) options->MaxUnrollFactor &&
+          factor * 2 <= iterations / 2 &&
+          factor * 2 * cost <= max_cost)
+      factor *= 2;
+   if (factor < 2)
+      return;
+
+   void *const mem_ctx = ralloc_parent(ir);
+   const int unrolled = iterations / factor * factor;
+
+   terminator->remove();
+   ir_assignment *step = lv->first_assignment;
+   step->remove();
+
+   /* Iterations left over run after the loop, with constant counters. */
+   exec_list remainder;
+   for (int i = unrolled; i < iterations; i++) {
+      exec_list copy_list;
+      clone_ir_list(mem_ctx, &copy_list, &ir->body_instructions);
+      counter_replace_visitor replace(counter,
+                                      counter_value(mem_ctx, start, increment, i));
+      replace.run(&copy_list);
+      remainder.append_list(&copy_list);
+   }
+   if (this->state->get_for_inductor(counter) == NULL) {
+      /* read after the loop */
+      remainder.push_tail(new(mem_ctx) ir_assignment(
+         new(mem_ctx) ir_dereference_variable(counter),
+         counter_value(mem_ctx, start, increment, iterations)));
+   }
+   ir->get_next()->insert_before(&remainder);
+
+   exec_list copies;
+   for (int i = 1; i < factor; i++) {
+      exec_list copy_list;
+      clone_ir_list(mem_ctx, &copy_list, &ir->body_instructions);
+      counter_replace_visitor replace(counter,
+         new(mem_ctx) ir_expression(ir_binop_add,
+                                    new(mem_ctx) ir_dereference_variable(counter),
+                                    counter_value(mem_ctx, NULL, increment, i)));
+      replace.run(&copy_list);
+      copies.append_list(&copy_list);
+   }
+   ir->body_instructions.append_list(&copies);
+
+   step->rhs = new(mem_ctx) ir_expression(ir_binop_add,
+                                          new(mem_ctx) ir_dereference_variable(counter),
+                                          counter_value(mem_ctx, NULL, increment, factor));
+   ir->body_instructions.push_tail(step);
+
+   terminator->condition =
+      new(mem_ctx) ir_expression(increment->value.i[0] > 0 ? ir_binop_gequal
+                                                           : ir_binop_lequal,
+                                 new(mem_ctx) ir_dereference_variable(counter),
+                                 counter_value(mem_ctx, start, increment, unrolled));
+   ir->body_instructions.push_head(terminator);
+
+   ir->unroll_factor = factor;
+   this->progress = true;
+}
+
+
 /**
  * Move all of the instructions which follow \c ir_if to the end of
  * \c splice_dest.
@@ -298,14 +489,24 @@ loop_unroll_visitor::visit_leave(ir_loop *ir)
    if (ls->limiting_terminator == NULL)
       return visit_continue;
 
+   /* Partially unrolled loops are left alone: unrolling them again would
+    * compound the factor past MaxUnrollFactor, and unrolling them completely
+    * would get around MaxUnrollIterations.
+    */
+   if (ir->unroll_factor > 1)
+      return visit_continue;
+
    iterations = ls->limiting_terminator->iterations;
 
    const int max_iterations = options->MaxUnrollIterations;
 
-   /* Don't try to unroll loops that have zillions of iterations either.
+   /* Don't try to unroll loops that have zillions of iterations either,
+    * but maybe repeat their bodies a few times.
     */
-   if (iterations > max_iterations)
+   if (iterations > max_iterations) {
+      partial_unroll(ir, ls, iterations);
       return visit_continue;
+   }
 
    /* Don't try to unroll nested loops and loops with a huge body.
     */
@@ -314,8 +515,10 @@ loop_unroll_visitor::visit_leave(ir_loop *ir)
    bool loop_too_large =
       count.nested_loop || count.nodes * iterations > (int)max_iterations * 25;
 
-   if (loop_too_large && !count.unsupported_variable_indexing)
+   if (loop_too_large && !count.unsupported_variable_indexing) {
+      partial_unroll(ir, ls, iterations);
       return visit_continue;
+   }
 
    /* Note: the limiting terminator contributes 1 to ls->num_loop_jumps.
     * We'll be removing the limiting terminator before we unroll.
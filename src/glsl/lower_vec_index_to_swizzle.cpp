@@ -69,7 +69,9 @@ ir_vec_index_to_swizzle_visitor::convert_vector_extract_to_swizzle(ir_rvalue *ir
    if (expr == NULL || expr->operation != ir_binop_vector_extract)
       return ir;
 
-   ir_constant *const idx = expr->operands[1]->constant_expression_value();
+   ir_scratch_constant scratch;
+   ir_constant *const idx =
+      expr->operands[1]->constant_expression_value_scratch(&scratch);
    if (idx == NULL)
       return ir;
 
@@ -246,9 +246,10 @@ ir_algebraic_visitor::reassociate_constant(ir_expression *ir1, int const_index,
        ir2->operands[1]->type->is_matrix())
       return false;
 
+   ir_scratch_constant scratch[2];
    ir_constant *ir2_const[2];
-   ir2_const[0] = ir2->operands[0]->constant_expression_value();
-   ir2_const[1] = ir2->operands[1]->constant_expression_value();
+   ir2_const[0] = ir2->operands[0]->constant_expression_value_scratch(&scratch[0]);
+   ir2_const[1] = ir2->operands[1]->constant_expression_value_scratch(&scratch[1]);
 
    if (ir2_const[0] && ir2_const[1])
       return false;
@@ -294,6 +295,10 @@ ir_algebraic_visitor::swizzle_if_required(ir_expression *expr,
 ir_rvalue *
 ir_algebraic_visitor::handle_expression(ir_expression *ir)
 {
+   /* Constant operands are only looked at, so evaluate them on the stack;
+    * one that ends up in the IR has to be cloned.
+    */
+   ir_scratch_constant scratch[4];
    ir_constant *op_const[4] = {NULL, NULL, NULL, NULL};
    ir_expression *op_expr[4] = {NULL, NULL, NULL, NULL};
    unsigned int i;
@@ -303,7 +308,7 @@ ir_algebraic_visitor::handle_expression(ir_expression *ir)
       if (ir->operands[i]->type->is_matrix())
 	 return ir;
 
-      op_const[i] = ir->operands[i]->constant_expression_value();
+      op_const[i] = ir->operands[i]->constant_expression_value_scratch(&scratch[i]);
       op_expr[i] = ir->operands[i]->as_expression();
    }
 
@@ -670,7 +675,7 @@ ir_algebraic_visitor::handle_expression(ir_expression *ir)
    case ir_binop_pow:
       /* 1^x == 1 */
       if (is_vec_one(op_const[0]))
-         return op_const[0];
+         return op_const[0]->clone(mem_ctx, NULL);
 
       /* x^1 == x */
       if (is_vec_one(op_const[1]))
@@ -726,7 +731,7 @@ ir_algebraic_visitor::handle_expression(ir_expression *ir)
              * and its variations
              */
             if (is_less_than_one(outer_const) && inner_val_b->is_zero())
-               return expr(ir_binop_min, saturate(inner_val_a), outer_const);
+               return expr(ir_binop_min, saturate(inner_val_a), outer_const->clone(mem_ctx, NULL));
 
             if (!inner_val_b->as_constant())
                continue;
@@ -740,7 +745,7 @@ ir_algebraic_visitor::handle_expression(ir_expression *ir)
             if (outer_const->is_one() && is_greater_than_zero(inner_val_b->as_constant()))
                return expr(ir_binop_max, saturate(inner_val_a), inner_val_b);
             if (inner_val_b->as_constant()->is_one() && is_greater_than_zero(outer_const))
-               return expr(ir_binop_max, saturate(inner_val_a), outer_const);
+               return expr(ir_binop_max, saturate(inner_val_a), outer_const->clone(mem_ctx, NULL));
          }
       }
 
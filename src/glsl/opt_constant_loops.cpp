@@ -0,0 +1,280 @@
+/**
+ * \file opt_constant_loops.cpp
+ *
+ * Runs loops whose inputs are all constant at compile time, and replaces
+ * them with assignments of the values they compute.
+ *
+ * Loops filling tables of weights or offsets (e.g. Gaussian kernels) are
+ * otherwise only removed by unrolling them and folding the unrolled copies,
+ * which is limited to short loops and builds a lot of IR just to throw it
+ * away; running the loop is cheaper and has no trip count limit.
+ *
+ * Only loops in the top level of function bodies are considered.  The values
+ * of local variables on entry to a loop are tracked by running the
+ * assignments preceding it; a variable declared without an initializer
+ * holds an undefined value, for which zero is as good as any.
+ */
+
+#include "ir.h"
+#include "ir_visitor.h"
+#include "ir_optimization.h"
+#include "glsl_types.h"
+#include "program/hash_table.h"
+
+/**
+ * Maximum number of instructions run for one loop before giving up on it.
+ */
+static const unsigned max_loop_instructions = 16384;
+
+namespace {
+
+struct assigned_variable : public exec_node {
+   assigned_variable(ir_variable *var) : var(var)
+   {
+   }
+
+   ir_variable *var;
+};
+
+/**
+ * Collects the variables written by a piece of IR, in the order they are
+ * first written.
+ */
+class assigned_variables_visitor : public ir_hierarchical_visitor {
+public:
+   assigned_variables_visitor(void *mem_ctx)
+      : mem_ctx(mem_ctx)
+   {
+   }
+
+   virtual ir_visitor_status visit_leave(ir_assignment *ir)
+   {
+      add(ir->lhs->variable_referenced());
+      return visit_continue;
+   }
+
+   virtual ir_visitor_status visit_enter(ir_call *ir)
+   {
+      if (ir->return_deref)
+         add(ir->return_deref->var);
+
+      foreach_two_lists(formal_node, &ir->callee->parameters,
+                        actual_node, &ir->actual_parameters) {
+         ir_variable *formal = (ir_variable *) formal_node;
+         ir_rvalue *actual = (ir_rvalue *) actual_node;
+         if (formal->data.mode == ir_var_function_out ||
+             formal->data.mode == ir_var_function_inout)
+            add(actual->variable_referenced());
+      }
+      return visit_continue;
+   }
+
+   void add(ir_variable *var)
+   {
+      if (!var)
+         return;
+
+      foreach_in_list(assigned_variable, entry, &this->variables) {
+         if (entry->var == var)
+            return;
+      }
+      this->variables.push_tail(new(mem_ctx) assigned_variable(var));
+   }
+
+   void *mem_ctx;
+   exec_list variables;
+};
+
+class constant_loop_state {
+public:
+   /**
+    * \param num_variables  Number of variables in the function, which bounds
+    *                       the number of values tracked at once.
+    */
+   constant_loop_state(unsigned num_variables)
+   {
+      this->mem_ctx = ralloc_context(NULL);
+      /* The evaluator wants a fixed-size table; give it one bucket per
+       * variable so lookups stay constant time in large functions.
+       */
+      this->values = hash_table_ctor(num_variables, hash_table_pointer_hash,
+                                     hash_table_pointer_compare);
+      this->progress = false;
+   }
+
+   ~constant_loop_state()
+   {
+      hash_table_dtor(this->values);
+      ralloc_free(this->mem_ctx);
+   }
+
+   void run(exec_list *body);
+
+   void forget_assigned(ir_instruction *ir);
+   bool evaluate_loop(ir_loop *loop);
+
+   /** Values of the local variables known at the current instruction. */
+   struct hash_table *values;
+   void *mem_ctx;
+   bool progress;
+};
+
+} /* unnamed namespace */
+
+static void
+count_variables(ir_instruction *ir, void *data)
+{
+   if (ir->as_variable() != NULL)
+      (*(unsigned *) data)++;
+}
+
+/**
+ * Emit assignments of \c value to \c lhs before \c ir, one per scalar,
+ * vector or matrix.  Arrays are written element by element since GLSL ES 1.00
+ * has no array constructors.
+ */
+static void
+emit_constant_assignments(ir_instruction *ir, ir_dereference *lhs,
+                          ir_constant *value)
+{
+   void *mem_ctx = ralloc_parent(ir);
+
+   if (value->type->is_array()) {
+      for (unsigned i = 0; i < value->type->length; i++) {
+         ir_dereference *element =
+            new(mem_ctx) ir_dereference_array(lhs->clone(mem_ctx, NULL),
+                                              new(mem_ctx) ir_constant(int(i)));
+         emit_constant_assignments(ir, element, value->get_array_element(i));
+      }
+      return;
+   }
+
+   if (value->type->is_record()) {
+      for (unsigned i = 0; i < value->type->length; i++) {
+         const char *field = value->type->fields.structure[i].name;
+         ir_dereference *member =
+            new(mem_ctx) ir_dereference_record(lhs->clone(mem_ctx, NULL), field);
+         emit_constant_assignments(ir, member, value->get_record_field(field));
+      }
+      return;
+   }
+
+   ir->insert_before(new(mem_ctx) ir_assignment(lhs, value->clone(mem_ctx, NULL)));
+}
+
+/**
+ * Stop tracking the variables written by \c ir.
+ */
+void
+constant_loop_state::forget_assigned(ir_instruction *ir)
+{
+   assigned_variables_visitor assigned(this->mem_ctx);
+   ir->accept(&assigned);
+
+   foreach_in_list(assigned_variable, entry, &assigned.variables)
+      hash_table_remove(this->values, entry->var);
+}
+
+/**
+ * Run \c loop, and replace it with the values it leaves in the variables
+ * declared outside of it.
+ */
+bool
+constant_loop_state::evaluate_loop(ir_loop *loop)
+{
+   assigned_variables_visitor assigned(this->mem_ctx);
+   loop->accept(&assigned);
+
+   /* Variables written by the loop must all have known values on entry;
+    * those declared in the loop body don't exist past it.
+    */
+   exec_list outputs;
+   foreach_in_list_safe(assigned_variable, entry, &assigned.variables) {
+      if (hash_table_find(this->values, entry->var)) {
+         entry->remove();
+         outputs.push_tail(entry);
+      }
+   }
+
+   if (outputs.is_empty() ||
+       !loop->constant_expression_evaluate(this->values, this->mem_ctx,
+                                           max_loop_instructions)) {
+      foreach_in_list(assigned_variable, entry, &outputs)
+         hash_table_remove(this->values, entry->var);
+      return false;
+   }
+
+   void *ir_ctx = ralloc_parent(loop);
+   foreach_in_list(assigned_variable, entry, &outputs) {
+      ir_constant *value =
+         (ir_constant *) hash_table_find(this->values, entry->var);
+      emit_constant_assignments(loop,
+                                new(ir_ctx) ir_dereference_variable(entry->var),
+                                value);
+   }
+
+   loop->remove();
+   return true;
+}
+
+void
+constant_loop_state::run(exec_list *body)
+{
+   foreach_in_list_safe(ir_instruction, ir, body) {
+      switch (ir->ir_type) {
+      case ir_type_variable: {
+         ir_variable *var = ir->as_variable();
+         if (var->data.mode == ir_var_auto ||
+             var->data.mode == ir_var_temporary)
+            hash_table_replace(this->values,
+                               ir_constant::zero(this->mem_ctx, var->type), var);
+         break;
+      }
+
+      case ir_type_assignment: {
+         ir_assignment *assign = ir->as_assignment();
+         ir_variable *var = assign->lhs->variable_referenced();
+         if (var && hash_table_find(this->values, var) &&
+             !assign->constant_expression_evaluate(this->values))
+            hash_table_remove(this->values, var);
+         break;
+      }
+
+      case ir_type_loop:
+         if (evaluate_loop(ir->as_loop()))
+            this->progress = true;
+         break;
+
+      default:
+         forget_assigned(ir);
+         break;
+      }
+   }
+}
+
+bool
+do_constant_loop_evaluation(exec_list *instructions)
+{
+   bool progress = false;
+
+   foreach_in_list(ir_instruction, ir, instructions) {
+      ir_function *func = ir->as_function();
+      if (!func)
+         continue;
+
+      foreach_in_list(ir_function_signature, sig, &func->signatures) {
+         if (sig->is_builtin() || !sig->is_defined)
+            continue;
+
+         unsigned num_variables = 0;
+         foreach_in_list(ir_instruction, body_ir, &sig->body)
+            visit_tree(body_ir, count_variables, &num_variables);
+
+         constant_loop_state state(num_variables);
+         state.run(&sig->body);
+         progress |= state.progress;
+      }
+   }
+
+   return progress;
+}
@@ -25,6 +25,11 @@
  * \file opt_function_inlining.cpp
  *
  * Replaces calls to functions with the body of the function.
+ *
+ * With compiler options passed, large functions called from many places are
+ * kept out of line (see gl_shader_compiler_options::MaxInlineInstructions),
+ * as long as that is possible for all targets: Metal functions can't access
+ * shader inputs, outputs or uniforms, nor take textures as parameters.
  */
 
 #include "ir.h"
@@ -33,6 +38,8 @@
 #include "ir_expression_flattening.h"
 #include "glsl_types.h"
 #include "program/hash_table.h"
+#include "util/hash_table.h"
+#include "main/mtypes.h"
 
 static void
 do_variable_replacement(exec_list *instructions,
@@ -41,12 +48,99 @@ do_variable_replacement(exec_list *instructions,
 
 namespace {
 
+/**
+ * Counts the calls to each function signature.
+ */
+class call_count_visitor : public ir_hierarchical_visitor {
+public:
+   call_count_visitor()
+   {
+      this->counts = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+   }
+
+   virtual ~call_count_visitor()
+   {
+      _mesa_hash_table_destroy(this->counts, NULL);
+   }
+
+   virtual ir_visitor_status visit_enter(ir_call *ir)
+   {
+      _mesa_hash_table_insert(this->counts, _mesa_hash_pointer(ir->callee),
+                              ir->callee, (void *) (count(ir->callee) + 1));
+      return visit_continue;
+   }
+
+   uintptr_t count(const ir_function_signature *sig)
+   {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(this->counts, _mesa_hash_pointer(sig), sig);
+      return entry ? (uintptr_t) entry->data : 0;
+   }
+
+   struct hash_table *counts;
+};
+
+/**
+ * Measures a function body, and checks whether it uses anything besides its
+ * parameters and locals.
+ */
+class function_size_visitor : public ir_hierarchical_visitor {
+public:
+   function_size_visitor(const ir_function_signature *sig)
+   {
+      this->size = 0;
+      this->uses_globals = false;
+      this->callback_enter = count_node;
+      this->data_enter = &this->size;
+      this->locals = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+      foreach_in_list(ir_variable, param, &sig->parameters)
+         add_local(param);
+   }
+
+   virtual ~function_size_visitor()
+   {
+      _mesa_hash_table_destroy(this->locals, NULL);
+   }
+
+   void add_local(ir_variable *var)
+   {
+      _mesa_hash_table_insert(this->locals, _mesa_hash_pointer(var), var, var);
+   }
+
+   static void count_node(ir_instruction *, void *data)
+   {
+      (*(unsigned *) data)++;
+   }
+
+   virtual ir_visitor_status visit(ir_variable *ir)
+   {
+      add_local(ir);
+      return ir_hierarchical_visitor::visit(ir);
+   }
+
+   virtual ir_visitor_status visit(ir_dereference_variable *ir)
+   {
+      /* Globals are ir_var_auto too, so go by where the variable is
+       * declared rather than by its mode.
+       */
+      if (_mesa_hash_table_search(this->locals, _mesa_hash_pointer(ir->var),
+                                  ir->var) == NULL)
+         this->uses_globals = true;
+      return ir_hierarchical_visitor::visit(ir);
+   }
+
+   unsigned size;
+   bool uses_globals;
+   struct hash_table *locals;
+};
+
 class ir_function_inlining_visitor : public ir_hierarchical_visitor {
 public:
-   ir_function_inlining_visitor()
+   ir_function_inlining_visitor(const struct gl_shader_compiler_options *options)
    {
       progress = false;
 	  current_function = NULL;
+      this->options = options;
    }
 
    virtual ~ir_function_inlining_visitor()
@@ -71,7 +165,11 @@ public:
 	   return ir_hierarchical_visitor::visit_leave(sig);
    }
 
+   bool keep_out_of_line(ir_call *ir);
+
    ir_function_signature* current_function;
+   const struct gl_shader_compiler_options *options;
+   call_count_visitor calls;
    bool progress;
 
 };
@@ -79,10 +177,13 @@ public:
 } /* unnamed namespace */
 
 bool
-do_function_inlining(exec_list *instructions)
+do_function_inlining(exec_list *instructions,
+                     const struct gl_shader_compiler_options *options)
 {
-   ir_function_inlining_visitor v;
+   ir_function_inlining_visitor v(options);
 
+   if (options)
+      v.calls.run(instructions);
    v.run(instructions);
 
    return v.progress;
@@ -263,10 +364,31 @@ ir_function_inlining_visitor::visit_enter(ir_swizzle *ir)
 }
 
 
+bool
+ir_function_inlining_visitor::keep_out_of_line(ir_call *ir)
+{
+   const ir_function_signature *callee = ir->callee;
+   if (this->options == NULL || callee->is_builtin() ||
+       this->calls.count(callee) <= this->options->MaxInlineCalls)
+      return false;
+
+   function_size_visitor size(callee);
+   size.run((exec_list *) &callee->body);
+   if (size.size <= this->options->MaxInlineInstructions || size.uses_globals)
+      return false;
+
+   foreach_in_list(ir_variable, param, &callee->parameters) {
+      if (param->type->contains_sampler())
+         return false;
+   }
+   return true;
+}
+
+
 ir_visitor_status
 ir_function_inlining_visitor::visit_enter(ir_call *ir)
 {
-   if (can_inline(ir)) {
+   if (can_inline(ir) && !keep_out_of_line(ir)) {
       ir->generate_inline(ir);
       ir->remove();
       this->progress = true;
@@ -0,0 +1,341 @@
+/**
+ * \file opt_slp_vectorize.cpp
+ *
+ * Packs isomorphic scalar assignments to different variables into a single
+ * vector operation (superword level parallelism).
+ *
+ * do_vectorize only combines assignments to the channels of one variable.
+ * Scalarized code, e.g. from node graph shader editors, computes each
+ * channel into its own variable instead:
+ *
+ *    (assign (x) (var_ref r) (expression float + (swiz x (var_ref c)) (var_ref o)))
+ *    (assign (x) (var_ref g) (expression float + (swiz y (var_ref c)) (var_ref o)))
+ *    (assign (x) (var_ref b) (expression float + (swiz z (var_ref c)) (var_ref o)))
+ *
+ * Consecutive assignments like these are packed into a new vector temporary,
+ * and the scalars become its channels:
+ *
+ *    (assign (xyz) (var_ref slp) (expression vec3 + (swiz xyz (var_ref c))
+ *                                                   (swiz xxx (var_ref o))))
+ *    (assign (x) (var_ref r) (swiz x (var_ref slp)))
+ *    (assign (x) (var_ref g) (swiz y (var_ref slp)))
+ *    (assign (x) (var_ref b) (swiz z (var_ref slp)))
+ *
+ * Copy propagation then turns reads of r, g and b into channels of slp, so
+ * math done on them next packs the same way, and do_vectorize can combine
+ * their uses.
+ *
+ * Expressions are isomorphic when they have the same shape and operations,
+ * and their leaves are either all constants, all single channels of the same
+ * vector, or all the same scalar.  Only scalar float and int math of local
+ * variables of equal precision is packed; an assignment can't join a group
+ * if it reads a variable written earlier in the group.
+ */
+
+#include "ir.h"
+#include "ir_visitor.h"
+#include "ir_optimization.h"
+#include "glsl_types.h"
+
+static bool
+is_packable_type(const glsl_type *type)
+{
+   return type->is_scalar() &&
+          (type->base_type == GLSL_TYPE_FLOAT ||
+           type->base_type == GLSL_TYPE_INT ||
+           type->base_type == GLSL_TYPE_UINT);
+}
+
+static bool
+is_packable_operation(ir_expression *ir)
+{
+   if (ir->is_horizontal())
+      return false;
+
+   switch (ir->operation) {
+   case ir_unop_noise:
+   case ir_unop_interpolate_at_centroid:
+   case ir_binop_interpolate_at_offset:
+   case ir_binop_interpolate_at_sample:
+   case ir_binop_ubo_load:
+      return false;
+   default:
+      return true;
+   }
+}
+
+/**
+ * Whether the n rvalues can be packed into one vector rvalue.
+ */
+static bool
+lanes_packable(ir_rvalue **lanes, unsigned n)
+{
+   if (!is_packable_type(lanes[0]->type))
+      return false;
+   for (unsigned i = 1; i < n; i++) {
+      if (lanes[i]->type != lanes[0]->type)
+         return false;
+   }
+
+   ir_expression *expr = lanes[0]->as_expression();
+   if (expr) {
+      if (!is_packable_operation(expr))
+         return false;
+      for (unsigned i = 1; i < n; i++) {
+         ir_expression *other = lanes[i]->as_expression();
+         if (other == NULL || other->operation != expr->operation)
+            return false;
+      }
+      for (unsigned j = 0; j < expr->get_num_operands(); j++) {
+         ir_rvalue *operands[4];
+         for (unsigned i = 0; i < n; i++)
+            operands[i] = lanes[i]->as_expression()->operands[j];
+         if (!lanes_packable(operands, n))
+            return false;
+      }
+      return true;
+   }
+
+   if (lanes[0]->as_constant()) {
+      for (unsigned i = 1; i < n; i++) {
+         if (lanes[i]->as_constant() == NULL)
+            return false;
+      }
+      return true;
+   }
+
+   ir_swizzle *swz = lanes[0]->as_swizzle();
+   if (swz && swz->val->type->is_vector()) {
+      for (unsigned i = 1; i < n; i++) {
+         ir_swizzle *other = lanes[i]->as_swizzle();
+         if (other == NULL || !other->val->equals(swz->val))
+            return false;
+      }
+      return true;
+   }
+
+   /* anything else must be the same scalar in all lanes */
+   for (unsigned i = 1; i < n; i++) {
+      if (!lanes[i]->equals(lanes[0]))
+         return false;
+   }
+   return true;
+}
+
+/**
+ * Build the vector rvalue of n lanes checked by lanes_packable().
+ */
+static ir_rvalue *
+pack_lanes(void *mem_ctx, ir_rvalue **lanes, unsigned n)
+{
+   const glsl_type *type =
+      glsl_type::get_instance(lanes[0]->type->base_type, n, 1);
+
+   ir_expression *expr = lanes[0]->as_expression();
+   if (expr) {
+      ir_rvalue *packed[4] = { NULL, NULL, NULL, NULL };
+      for (unsigned j = 0; j < expr->get_num_operands(); j++) {
+         ir_rvalue *operands[4];
+         for (unsigned i = 0; i < n; i++)
+            operands[i] = lanes[i]->as_expression()->operands[j];
+         packed[j] = pack_lanes(mem_ctx, operands, n);
+      }
+      return new(mem_ctx) ir_expression(expr->operation, type, packed[0],
+                                        packed[1], packed[2], packed[3]);
+   }
+
+   if (lanes[0]->as_constant()) {
+      ir_constant_data data;
+      memset(&data, 0, sizeof(data));
+      for (unsigned i = 0; i < n; i++)
+         data.u[i] = lanes[i]->as_constant()->value.u[0];
+      return new(mem_ctx) ir_constant(type, &data);
+   }
+
+   ir_swizzle *swz = lanes[0]->as_swizzle();
+   if (swz && swz->val->type->is_vector()) {
+      unsigned components[4];
+      for (unsigned i = 0; i < n; i++)
+         components[i] = lanes[i]->as_swizzle()->mask.x;
+      return new(mem_ctx) ir_swizzle(swz->val->clone(mem_ctx, NULL),
+                                     components, n);
+   }
+
+   return new(mem_ctx) ir_swizzle(lanes[0]->clone(mem_ctx, NULL),
+                                  0, 0, 0, 0, n);
+}
+
+static void
+find_variable(ir_instruction *ir, void *data)
+{
+   ir_dereference_variable *deref = ir->as_dereference_variable();
+   ir_variable **var = (ir_variable **) data;
+   if (deref && deref->var == var[0])
+      var[1] = deref->var;
+}
+
+static bool
+reads_variable(ir_rvalue *ir, ir_variable *var)
+{
+   ir_variable *search[2] = { var, NULL };
+   visit_tree(ir, find_variable, search);
+   return search[1] != NULL;
+}
+
+/**
+ * Returns the scalar local variable an assignment writes as a whole with
+ * packable math, or NULL.
+ */
+static ir_variable *
+packable_assignment(ir_instruction *ir)
+{
+   ir_assignment *assign = ir->as_assignment();
+   if (assign == NULL || assign->condition ||
+       assign->rhs->as_expression() == NULL)
+      return NULL;
+
+   ir_dereference_variable *lhs = assign->lhs->as_dereference_variable();
+   if (lhs == NULL || !is_packable_type(lhs->type))
+      return NULL;
+
+   ir_variable *var = lhs->var;
+   if (var->data.mode != ir_var_auto && var->data.mode != ir_var_temporary)
+      return NULL;
+
+   return var;
+}
+
+
+namespace {
+
+class ir_slp_vectorize_visitor : public ir_hierarchical_visitor {
+public:
+   ir_slp_vectorize_visitor()
+      : progress(false)
+   {
+   }
+
+   virtual ir_visitor_status visit_enter(ir_function_signature *ir)
+   {
+      pack_block(&ir->body);
+      return visit_continue;
+   }
+
+   virtual ir_visitor_status visit_enter(ir_if *ir)
+   {
+      pack_block(&ir->then_instructions);
+      pack_block(&ir->else_instructions);
+      return visit_continue;
+   }
+
+   virtual ir_visitor_status visit_enter(ir_loop *ir)
+   {
+      pack_block(&ir->body_instructions);
+      return visit_continue;
+   }
+
+   void pack_block(exec_list *instructions);
+   void pack_group(ir_assignment **group, unsigned n);
+
+   bool progress;
+};
+
+} /* unnamed namespace */
+
+
+void
+ir_slp_vectorize_visitor::pack_block(exec_list *instructions)
+{
+   ir_instruction *ir = (ir_instruction *) instructions->get_head();
+
+   while (ir && !ir->is_tail_sentinel()) {
+      ir_variable *var = packable_assignment(ir);
+      if (var == NULL) {
+         ir = (ir_instruction *) ir->get_next();
+         continue;
+      }
+
+      /* Grow a group of consecutive isomorphic assignments. */
+      ir_assignment *group[4];
+      ir_variable *vars[4];
+      ir_rvalue *lanes[4];
+      unsigned n = 0;
+      ir_instruction *next = ir;
+      while (n < 4 && !next->is_tail_sentinel()) {
+         /* declarations of the next lanes' variables sit in between */
+         if (next->as_variable()) {
+            next = (ir_instruction *) next->get_next();
+            continue;
+         }
+
+         ir_variable *lane_var = packable_assignment(next);
+         if (lane_var == NULL)
+            break;
+
+         ir_assignment *assign = next->as_assignment();
+         bool independent = true;
+         for (unsigned i = 0; i < n; i++) {
+            if (vars[i] == lane_var ||
+                vars[i]->data.precision != lane_var->data.precision ||
+                reads_variable(assign->rhs, vars[i]))
+               independent = false;
+         }
+         if (!independent)
+            break;
+
+         lanes[n] = assign->rhs;
+         if (!lanes_packable(lanes, n + 1))
+            break;
+
+         group[n] = assign;
+         vars[n] = lane_var;
+         n++;
+         next = (ir_instruction *) next->get_next();
+      }
+
+      if (n > 1)
+         pack_group(group, n);
+      ir = n > 1 ? next : (ir_instruction *) ir->get_next();
+   }
+}
+
+
+void
+ir_slp_vectorize_visitor::pack_group(ir_assignment **group, unsigned n)
+{
+   void *mem_ctx = ralloc_parent(group[0]);
+   ir_variable *first = group[0]->lhs->variable_referenced();
+   const glsl_type *type =
+      glsl_type::get_instance(first->type->base_type, n, 1);
+
+   ir_rvalue *lanes[4];
+   for (unsigned i = 0; i < n; i++)
+      lanes[i] = group[i]->rhs;
+
+   ir_variable *packed =
+      new(mem_ctx) ir_variable(type, "slp", ir_var_temporary,
+                               (glsl_precision) first->data.precision);
+   group[0]->insert_before(packed);
+   group[0]->insert_before(
+      new(mem_ctx) ir_assignment(new(mem_ctx) ir_dereference_variable(packed),
+                                 pack_lanes(mem_ctx, lanes, n)));
+
+   for (unsigned i = 0; i < n; i++) {
+      group[i]->rhs =
+         new(mem_ctx) ir_swizzle(new(mem_ctx) ir_dereference_variable(packed),
+                                 i, 0, 0, 0, 1);
+   }
+
+   this->progress = true;
+}
+
+
+bool
+do_slp_vectorize(exec_list *instructions)
+{
+   ir_slp_vectorize_visitor v;
+
+   v.run(instructions);
+
+   return v.progress;
+}
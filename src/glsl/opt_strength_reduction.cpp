@@ -0,0 +1,260 @@
+/**
+ * \file opt_strength_reduction.cpp
+ *
+ * Rewrites float math into cheaper forms that opt_algebraic leaves alone:
+ *
+ *    pow(x, 3)            ->  x * x * x
+ *    pow(x, 4)            ->  (x * x) * (x * x)
+ *    x / c                ->  x * (1 / c)
+ *    (x + c1) * c2        ->  x * c2 + c1 * c2
+ *    exp2(a) * exp2(b)    ->  exp2(a + b)
+ *    log2(pow(x, y))      ->  log2(x) * y
+ *
+ * where c, c1 and c2 are constants.  The (x + c1) * c2 case turns an add
+ * followed by a multiply into the multiply-add shape that GPUs do in one
+ * instruction; constant folding then takes care of c1 * c2.
+ *
+ * These don't give bit identical results (x * (1 / c) can be an ulp away
+ * from x / c), which is why they are optional; GPU compilers commonly do
+ * them anyway.
+ *
+ * do_fma_formation() separately fuses a * b + c into fma(a, b, c).  That is
+ * only for targets that have fma(), which GLSL ES 1.00 and 3.00 don't.  It is
+ * best done last, as the separate multiply and add are what the other passes
+ * look for (e.g. opt_algebraic turning them into lrp).
+ */
+
+#include "ir.h"
+#include "ir_rvalue_visitor.h"
+#include "ir_optimization.h"
+#include "ir_builder.h"
+#include "glsl_types.h"
+
+using namespace ir_builder;
+
+static bool
+is_float_value(const glsl_type *type)
+{
+   return type->base_type == GLSL_TYPE_FLOAT &&
+          (type->is_scalar() || type->is_vector());
+}
+
+static ir_constant *
+reciprocal_constant(void *mem_ctx, ir_constant *c)
+{
+   if (!is_float_value(c->type))
+      return NULL;
+
+   ir_constant_data data;
+   memset(&data, 0, sizeof(data));
+   for (unsigned i = 0; i < c->type->components(); i++) {
+      if (c->value.f[i] == 0.0f)
+         return NULL;
+      data.f[i] = 1.0f / c->value.f[i];
+   }
+   return new(mem_ctx) ir_constant(c->type, &data);
+}
+
+static ir_rvalue *
+broadcast(ir_rvalue *ir, const glsl_type *type)
+{
+   if (ir->type->vector_elements == type->vector_elements)
+      return ir;
+   ir_swizzle *swz = new(ralloc_parent(ir)) ir_swizzle(ir, 0, 0, 0, 0,
+                                                      type->vector_elements);
+   /* nothing folds constants after fma formation */
+   if (ir->as_constant())
+      return swz->constant_expression_value();
+   return swz;
+}
+
+
+namespace {
+
+class ir_strength_reduction_visitor : public ir_rvalue_visitor {
+public:
+   ir_strength_reduction_visitor(bool form_fma)
+      : form_fma(form_fma), progress(false)
+   {
+   }
+
+   void handle_rvalue(ir_rvalue **rvalue);
+   ir_rvalue *reduce(ir_expression *ir);
+   ir_rvalue *fuse(ir_expression *ir);
+   ir_variable *temporary(ir_rvalue *value);
+
+   bool form_fma;
+   bool progress;
+};
+
+} /* unnamed namespace */
+
+
+/**
+ * Evaluates a value into a temporary before the current instruction, so
+ * that it can be used more than once.
+ */
+ir_variable *
+ir_strength_reduction_visitor::temporary(ir_rvalue *value)
+{
+   ir_variable *var = new(ralloc_parent(value)) ir_variable(value->type, "x",
+                                                            ir_var_temporary,
+                                                            value->get_precision());
+   base_ir->insert_before(var);
+   base_ir->insert_before(assign(var, value));
+   return var;
+}
+
+
+ir_rvalue *
+ir_strength_reduction_visitor::reduce(ir_expression *ir)
+{
+   if (!is_float_value(ir->type))
+      return NULL;
+
+   void *mem_ctx = ralloc_parent(ir);
+   ir_constant *op_const[2] = { NULL, NULL };
+   ir_expression *op_expr[2] = { NULL, NULL };
+   for (unsigned i = 0; i < ir->get_num_operands() && i < 2; i++) {
+      op_const[i] = ir->operands[i]->as_constant();
+      op_expr[i] = ir->operands[i]->as_expression();
+   }
+
+   switch (ir->operation) {
+   case ir_binop_pow:
+      if (op_const[1] == NULL || op_const[0])
+         break;
+      if (op_const[1]->is_value(3.0, 3)) {
+         ir_variable *x = temporary(ir->operands[0]);
+         return mul(mul(x, x), x);
+      }
+      if (op_const[1]->is_value(4.0, 4)) {
+         ir_variable *x = temporary(ir->operands[0]);
+         ir_variable *x2 = temporary(mul(x, x));
+         return mul(x2, x2);
+      }
+      break;
+
+   case ir_binop_div:
+      if (op_const[1] && !op_const[0]) {
+         ir_constant *rcp = reciprocal_constant(mem_ctx, op_const[1]);
+         if (rcp)
+            return mul(ir->operands[0], rcp);
+      }
+      break;
+
+   case ir_binop_mul:
+      for (int i = 0; i < 2; i++) {
+         /* (x + c1) * c2 */
+         if (op_const[1 - i] && op_expr[i] &&
+             op_expr[i]->operation == ir_binop_add &&
+             is_float_value(op_expr[i]->type)) {
+            ir_expression *inner = op_expr[i];
+            for (int j = 0; j < 2; j++) {
+               if (inner->operands[1 - j]->as_constant() &&
+                   !inner->operands[j]->as_constant()) {
+                  return add(mul(inner->operands[j], op_const[1 - i]),
+                             mul(inner->operands[1 - j],
+                                 op_const[1 - i]->clone(mem_ctx, NULL)));
+               }
+            }
+         }
+      }
+
+      /* exp2(a) * exp2(b) */
+      if (op_expr[0] && op_expr[0]->operation == ir_unop_exp2 &&
+          op_expr[1] && op_expr[1]->operation == ir_unop_exp2) {
+         return expr(ir_unop_exp2, add(op_expr[0]->operands[0],
+                                       op_expr[1]->operands[0]));
+      }
+      break;
+
+   case ir_unop_log2:
+      if (op_expr[0] && op_expr[0]->operation == ir_binop_pow) {
+         return mul(expr(ir_unop_log2, op_expr[0]->operands[0]),
+                    op_expr[0]->operands[1]);
+      }
+      break;
+
+   default:
+      break;
+   }
+
+   return NULL;
+}
+
+
+ir_rvalue *
+ir_strength_reduction_visitor::fuse(ir_expression *ir)
+{
+   if (!is_float_value(ir->type))
+      return NULL;
+   if (ir->operation != ir_binop_add && ir->operation != ir_binop_sub)
+      return NULL;
+
+   for (int i = 0; i < 2; i++) {
+      ir_expression *product = ir->operands[i]->as_expression();
+      if (product == NULL || product->operation != ir_binop_mul ||
+          !is_float_value(product->operands[0]->type) ||
+          !is_float_value(product->operands[1]->type))
+         continue;
+
+      ir_rvalue *a = product->operands[0];
+      ir_rvalue *b = product->operands[1];
+      ir_rvalue *c = ir->operands[1 - i];
+
+      /* a * b - c is fma(a, b, -c), c - a * b is fma(-a, b, c) */
+      if (ir->operation == ir_binop_sub) {
+         if (i == 0)
+            c = neg(c);
+         else
+            a = neg(a);
+      }
+
+      return fma(broadcast(a, ir->type), broadcast(b, ir->type),
+                 broadcast(c, ir->type));
+   }
+
+   return NULL;
+}
+
+
+void
+ir_strength_reduction_visitor::handle_rvalue(ir_rvalue **rvalue)
+{
+   if (*rvalue == NULL)
+      return;
+
+   ir_expression *expr = (*rvalue)->as_expression();
+   if (expr == NULL)
+      return;
+
+   ir_rvalue *result = this->form_fma ? fuse(expr) : reduce(expr);
+   if (result == NULL)
+      return;
+
+   *rvalue = result;
+   this->progress = true;
+}
+
+
+bool
+do_strength_reduction(exec_list *instructions)
+{
+   ir_strength_reduction_visitor v(false);
+
+   visit_list_elements(&v, instructions);
+
+   return v.progress;
+}
+
+
+bool
+do_fma_formation(exec_list *instructions)
+{
+   ir_strength_reduction_visitor v(true);
+
+   visit_list_elements(&v, instructions);
+
+   return v.progress;
+}
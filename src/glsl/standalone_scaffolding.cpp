@@ -149,6 +149,9 @@ void initialize_context_to_defaults(struct gl_context *ctx, gl_api api)
    struct gl_shader_compiler_options options;
    memset(&options, 0, sizeof(options));
    options.MaxUnrollIterations = 8;
+   options.MaxUnrollFactor = 1;
+   options.MaxInlineInstructions = UINT_MAX;
+   options.MaxInlineCalls = 1;
    options.MaxIfDepth = UINT_MAX;
 
    /* Default pragma settings */
@@ -137,6 +137,24 @@
         'glsl/opt_vector_splitting.cpp',
         'glsl/opt_flip_matrices.cpp',
         'glsl/opt_dead_builtin_varyings.cpp',
+        'glsl/opt_strength_reduction.cpp',
+        'glsl/opt_slp_vectorize.cpp',
+        'glsl/ir_flatten_branches.cpp',
+        'glsl/ir_flatten_branches.h',
+        'glsl/ir_hoist_varyings.cpp',
+        'glsl/ir_hoist_varyings.h',
+        'glsl/ir_uniform_values.cpp',
+        'glsl/ir_uniform_values.h',
+        'glsl/ir_preshaders.h',
+        'glsl/ir_preshaders.cpp',
+        'glsl/loop_invariants.cpp',
+        'glsl/opt_constant_loops.cpp',
+        'glsl/glsl_source.h',
+        'glsl/glsl_source.c',
+        'glsl/glsl_atom_table.h',
+        'glsl/glsl_atom_table.cpp',
+        'glsl/ir_serialize.h',
+        'glsl/ir_serialize.cpp',
         'glsl/program.h',
         'glsl/ralloc.c',
         'glsl/ralloc.h',
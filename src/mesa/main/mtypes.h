@@ -1005,6 +1005,7 @@ struct gl_shader_compiler_options
    GLboolean EmitNoMainReturn;            /**< Emit CONT/RET opcodes? */
    GLboolean EmitNoNoise;                 /**< Emit NOISE opcodes? */
    GLboolean EmitNoPow;                   /**< Emit POW opcodes? */
+   GLboolean EmitFma;                     /**< Fuse a * b + c into FMA opcodes? */
    GLboolean LowerClipDistance; /**< Lower gl_ClipDistance from float[8] to vec4[2]? */
 
    /**
@@ -1020,6 +1021,25 @@ struct gl_shader_compiler_options
    GLuint MaxIfDepth;               /**< Maximum nested IF blocks */
    GLuint MaxUnrollIterations;
 
+   /**
+    * Loops too long to unroll completely have their bodies repeated up to
+    * this many times per iteration; 1 disables partial unrolling.
+    */
+   GLuint MaxUnrollFactor;
+
+   /**
+    * Functions larger than MaxInlineInstructions IR nodes are only inlined
+    * where they are called at most MaxInlineCalls times.
+    */
+   GLuint MaxInlineInstructions;
+   GLuint MaxInlineCalls;
+
+   /**
+    * Rewrite float math into cheaper forms that don't give bit identical
+    * results, e.g. division by a constant into multiplication.
+    */
+   GLboolean OptimizeStrength;
+
    /**
     * Optimize code for array of structures backends.
     *
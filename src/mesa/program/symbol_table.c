@@ -109,6 +109,12 @@ struct _mesa_symbol_table {
 
     /** Current scope depth. */
     unsigned depth;
+
+    /**
+     * Whether names are interned by the caller, and thus hashed and compared
+     * by pointer and used without copying.
+     */
+    bool interned_names;
 };
 
 
@@ -183,6 +189,13 @@ _mesa_symbol_table_push_scope(struct _mesa_symbol_table *table)
 }
 
 
+static char *
+copy_symbol_name(struct _mesa_symbol_table *table, const char *name)
+{
+    return table->interned_names ? (char *) name : strdup(name);
+}
+
+
 static struct symbol_header *
 find_symbol(struct _mesa_symbol_table *table, const char *name)
 {
@@ -264,7 +277,7 @@ _mesa_symbol_table_add_symbol(struct _mesa_symbol_table *table,
           return -1;
        }
 
-       hdr->name = strdup(name);
+       hdr->name = copy_symbol_name(table, name);
        if (hdr->name == NULL) {
           free(hdr);
           _mesa_error_no_memory(__func__);
@@ -336,7 +349,7 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
            return -1;
         }
 
-        hdr->name = strdup(name);
+        hdr->name = copy_symbol_name(table, name);
 
         hash_table_insert(table->ht, hdr, hdr->name);
         hdr->next = table->hdr;
@@ -398,14 +411,19 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
 
 
 
-struct _mesa_symbol_table *
-_mesa_symbol_table_ctor(void)
+static struct _mesa_symbol_table *
+symbol_table_create(bool interned_names)
 {
     struct _mesa_symbol_table *table = calloc(1, sizeof(*table));
 
     if (table != NULL) {
-       table->ht = hash_table_ctor(32, hash_table_string_hash,
-				   hash_table_string_compare);
+       if (interned_names)
+          table->ht = hash_table_ctor(32, hash_table_pointer_hash,
+                                      hash_table_pointer_compare);
+       else
+          table->ht = hash_table_ctor(32, hash_table_string_hash,
+                                      hash_table_string_compare);
+       table->interned_names = interned_names;
 
        _mesa_symbol_table_push_scope(table);
     }
@@ -414,6 +432,26 @@ _mesa_symbol_table_ctor(void)
 }
 
 
+struct _mesa_symbol_table *
+_mesa_symbol_table_ctor(void)
+{
+    return symbol_table_create(false);
+}
+
+
+/**
+ * Create a symbol table whose names are interned by the caller
+ *
+ * Names are hashed and compared by pointer and are not copied, so they must
+ * stay valid for as long as the table is.
+ */
+struct _mesa_symbol_table *
+_mesa_symbol_table_ctor_interned(void)
+{
+    return symbol_table_create(true);
+}
+
+
 void
 _mesa_symbol_table_dtor(struct _mesa_symbol_table *table)
 {
@@ -426,7 +464,8 @@ _mesa_symbol_table_dtor(struct _mesa_symbol_table *table)
 
    for (hdr = table->hdr; hdr != NULL; hdr = next) {
        next = hdr->next;
-       free(hdr->name);
+       if (!table->interned_names)
+          free(hdr->name);
        free(hdr);
    }
 
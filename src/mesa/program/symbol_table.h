@@ -44,6 +44,8 @@ extern void *_mesa_symbol_table_find_symbol(
 
 extern struct _mesa_symbol_table *_mesa_symbol_table_ctor(void);
 
+extern struct _mesa_symbol_table *_mesa_symbol_table_ctor_interned(void);
+
 extern void _mesa_symbol_table_dtor(struct _mesa_symbol_table *);
 
 #endif /* MESA_SYMBOL_TABLE_H */
@@ -41,6 +41,28 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 
 #include "ralloc.h"
 
+/* Usage tracking needs the size of blocks when they are freed; ask the C
+ * library where it can tell, otherwise keep it in the header.
+ */
+#if defined(__GLIBC__) || defined(ANDROID) || defined(__EMSCRIPTEN__)
+#include <malloc.h>
+#define usable_size(block) malloc_usable_size(block)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define usable_size(block) malloc_size(block)
+#elif defined(_WIN32)
+#include <malloc.h>
+#define usable_size(block) _msize(block)
+#else
+#define RALLOC_HEADER_SIZE
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 #ifndef va_copy
 #ifdef __va_copy
 #define va_copy(dest, src) __va_copy((dest), (src))
@@ -68,10 +90,43 @@ struct ralloc_header
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+#ifdef RALLOC_HEADER_SIZE
+   size_t size;
+#endif
 };
 
 typedef struct ralloc_header ralloc_header;
 
+static THREAD_LOCAL struct ralloc_usage *usage_tracker;
+
+struct ralloc_usage *
+ralloc_track_usage(struct ralloc_usage *usage)
+{
+   struct ralloc_usage *previous = usage_tracker;
+   usage_tracker = usage;
+   return previous;
+}
+
+static size_t
+block_size(ralloc_header *info)
+{
+#ifdef RALLOC_HEADER_SIZE
+   return info->size + sizeof(ralloc_header);
+#else
+   return usable_size(info);
+#endif
+}
+
+static void
+track_usage(ptrdiff_t bytes)
+{
+   struct ralloc_usage *usage = usage_tracker;
+   usage->bytes += bytes;
+   if (usage->bytes > usage->peak_bytes)
+      usage->peak_bytes = usage->bytes;
+}
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
@@ -125,6 +180,12 @@ ralloc_size(const void *ctx, size_t size)
    info->canary = CANARY;
 #endif
 
+#ifdef RALLOC_HEADER_SIZE
+   info->size = size;
+#endif
+   if (unlikely(usage_tracker != NULL))
+      track_usage(block_size(info));
+
    return PTR_FROM_HEADER(info);
 }
 
@@ -142,13 +203,21 @@ static void *
 resize(void *ptr, size_t size)
 {
    ralloc_header *child, *old, *info;
+   size_t old_size;
 
    old = get_header(ptr);
+   old_size = usage_tracker != NULL ? block_size(old) : 0;
    info = realloc(old, size + sizeof(ralloc_header));
 
    if (info == NULL)
       return NULL;
 
+#ifdef RALLOC_HEADER_SIZE
+   info->size = size;
+#endif
+   if (unlikely(usage_tracker != NULL))
+      track_usage((ptrdiff_t) block_size(info) - (ptrdiff_t) old_size);
+
    /* Update parent and sibling's links to the reallocated node. */
    if (info != old && info->parent != NULL) {
       if (info->parent->child == old)
@@ -252,6 +321,9 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
+   if (unlikely(usage_tracker != NULL))
+      track_usage(-(ptrdiff_t) block_size(info));
+
    free(info);
 }
 
@@ -271,6 +343,38 @@ ralloc_steal(const void *new_ctx, void *ptr)
    add_child(parent, info);
 }
 
+void
+ralloc_adopt(const void *new_ctx, void *old_ctx)
+{
+   ralloc_header *new_info, *old_info, *child;
+
+   if (unlikely(old_ctx == NULL))
+      return;
+
+   old_info = get_header(old_ctx);
+   new_info = get_header(new_ctx);
+
+   /* If there are no children, bail. */
+   if (unlikely(old_info->child == NULL))
+      return;
+
+   /* Set all the children's parent to new_ctx; get a pointer to the last
+    * child.
+    */
+   for (child = old_info->child; child->next != NULL; child = child->next)
+      child->parent = new_info;
+   child->parent = new_info;
+
+   /* Connect the two lists together; parent them to new_ctx; make old_ctx
+    * empty.
+    */
+   child->next = new_info->child;
+   if (child->next)
+      child->next->prev = child;
+   new_info->child = old_info->child;
+   old_info->child = NULL;
+}
+
 void *
 ralloc_parent(const void *ptr)
 {
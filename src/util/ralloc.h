@@ -234,6 +234,15 @@ void ralloc_free(void *ptr);
  */
 void ralloc_steal(const void *new_ctx, void *ptr);
 
+/**
+ * Reparent all children from one context to another.
+ *
+ * This effectively calls ralloc_steal(new_ctx, child) for all children of
+ * \p old_ctx.  Together with ralloc_free it lets code that allocates
+ * everything off one context release what it allocated in one phase.
+ */
+void ralloc_adopt(const void *new_ctx, void *old_ctx);
+
 /**
  * Return the given pointer's ralloc context.
  */
@@ -253,6 +262,30 @@ void *ralloc_autofree_context(void);
  */
 void ralloc_set_destructor(const void *ptr, void(*destructor)(void *));
 
+/**
+ * Memory allocated through ralloc by one thread, see ralloc_track_usage.
+ */
+struct ralloc_usage
+{
+   /** Bytes allocated minus bytes freed since tracking started. */
+   ptrdiff_t bytes;
+
+   /** Highest value \c bytes has had. */
+   ptrdiff_t peak_bytes;
+};
+
+/**
+ * Count the memory the calling thread allocates and frees through ralloc in
+ * \p usage; a \c NULL \p usage stops counting.
+ *
+ * Sizes include the ralloc header, and the allocator's rounding where the C
+ * library can report it.  Freeing memory that was allocated before tracking
+ * started makes \c bytes go down (or negative) as well.
+ *
+ * Returns the tracker the thread had before, for restoring it.
+ */
+struct ralloc_usage *ralloc_track_usage(struct ralloc_usage *usage);
+
 /// \defgroup array String Functions @{
 /**
  * Duplicate a string, allocating the memory from the given context.
@@ -1,6 +1,8 @@
 #include <string>
 #include <vector>
+#include <map>
 #include <time.h>
+#include <limits.h>
 #include "../src/glsl/glsl_optimizer.h"
 
 #define GL_GLEXT_PROTOTYPES 1
@@ -349,6 +351,27 @@ static bool ReadStringFromFile (const char* pathName, std::string& output)
 	return true;
 }
 
+struct IncludeFolder
+{
+	std::string path;
+	std::map<std::string, std::string> files;
+};
+
+// Serves #include directives of the tests from the include folder
+static const char* ResolveInclude (const char* name, void* userData)
+{
+	IncludeFolder* folder = (IncludeFolder*)userData;
+	std::map<std::string, std::string>::iterator it = folder->files.find (name);
+	if (it == folder->files.end())
+	{
+		std::string text;
+		if (!ReadStringFromFile ((folder->path + "/" + name).c_str(), text))
+			return NULL;
+		it = folder->files.insert (std::make_pair (std::string(name), text)).first;
+	}
+	return it->second.c_str();
+}
+
 bool EndsWith (const std::string& str, const std::string& sub)
 {
 	return (str.size() >= sub.size()) && (strncmp (str.c_str()+str.size()-sub.size(), sub.c_str(), sub.size())==0);
@@ -456,6 +479,72 @@ static const char* kGlslPrecNames[kGlslPrecCount] = {
 };
 
 
+// Baked into uniform-bake* tests
+static void SetBakedUniforms (glslopt_ctx* ctx)
+{
+	glslopt_uniform_value values[5];
+	memset (values, 0, sizeof(values));
+	values[0].name = "_UseFog";
+	values[0].intValues[0] = 0;
+	values[1].name = "_LightCount";
+	values[1].intValues[0] = 2;
+	values[2].name = "_Mode";
+	values[2].intValues[0] = 1;
+	values[3].name = "_Tint";
+	values[3].values[0] = 1.0f;
+	values[3].values[1] = 0.5f;
+	values[3].values[2] = 0.25f;
+	values[3].values[3] = 1.0f;
+	values[4].name = "_Seed";
+	values[4].intValues[0] = 16777217;
+	glslopt_set_uniform_values (ctx, values, sizeof(values) / sizeof(values[0]));
+}
+
+static void SetInlineTestThresholds (glslopt_ctx* ctx, const std::string&) { glslopt_set_inline_thresholds (ctx, 40, 1); }
+static void ResetInlineThresholds (glslopt_ctx* ctx) { glslopt_set_inline_thresholds (ctx, UINT_MAX, 1); }
+static void SetFlattenTestCost (glslopt_ctx* ctx, const std::string&) { glslopt_set_max_flatten_cost (ctx, 8.0f); }
+static void ResetFlattenCost (glslopt_ctx* ctx) { glslopt_set_max_flatten_cost (ctx, 0.0f); }
+static void SetUnrollTestFactor (glslopt_ctx* ctx, const std::string& testName)
+{
+	glslopt_set_max_unroll_factor (ctx, testName.compare (0, 23, "loop-partial-unroll-low") == 0 ? 2 : 8);
+}
+static void ResetUnrollFactor (glslopt_ctx* ctx) { glslopt_set_max_unroll_factor (ctx, 1); }
+static void SetBakedTestUniforms (glslopt_ctx* ctx, const std::string&) { SetBakedUniforms (ctx); }
+static void ResetUniformValues (glslopt_ctx* ctx) { glslopt_set_uniform_values (ctx, NULL, 0); }
+static void EnableStrengthReduction (glslopt_ctx* ctx, const std::string&) { glslopt_set_strength_reduction (ctx, true); }
+static void DisableStrengthReduction (glslopt_ctx* ctx) { glslopt_set_strength_reduction (ctx, false); }
+
+// Context settings for tests whose name starts with a prefix; each is set for
+// the whole test, and reset to the default afterwards.
+struct TestSetting
+{
+	const char* prefix;
+	void (*apply) (glslopt_ctx* ctx, const std::string& testName);
+	void (*reset) (glslopt_ctx* ctx);
+};
+
+static const TestSetting kTestSettings[] = {
+	{ "uniform-bake", SetBakedTestUniforms, ResetUniformValues },
+	{ "inline-policy", SetInlineTestThresholds, ResetInlineThresholds },
+	{ "flatten-branches", SetFlattenTestCost, ResetFlattenCost },
+	{ "loop-partial-unroll", SetUnrollTestFactor, ResetUnrollFactor },
+	{ "opt-strength-", EnableStrengthReduction, DisableStrengthReduction },
+};
+
+static void ApplyTestSettings (glslopt_ctx* ctx, const std::string& testName)
+{
+	for (size_t i = 0; i < sizeof(kTestSettings) / sizeof(kTestSettings[0]); ++i)
+		if (testName.compare (0, strlen (kTestSettings[i].prefix), kTestSettings[i].prefix) == 0)
+			kTestSettings[i].apply (ctx, testName);
+}
+
+static void ResetTestSettings (glslopt_ctx* ctx, const std::string& testName)
+{
+	for (size_t i = 0; i < sizeof(kTestSettings) / sizeof(kTestSettings[0]); ++i)
+		if (testName.compare (0, strlen (kTestSettings[i].prefix), kTestSettings[i].prefix) == 0)
+			kTestSettings[i].reset (ctx);
+}
+
 static bool TestFile (glslopt_ctx* ctx, bool vertex,
 	const std::string& testName,
 	const std::string& inputPath,
@@ -487,7 +576,11 @@ static bool TestFile (glslopt_ctx* ctx, bool vertex,
 	bool res = true;
 
 	glslopt_shader_type type = vertex ? kGlslOptShaderVertex : kGlslOptShaderFragment;
-	glslopt_shader* shader = glslopt_optimize (ctx, type, input.c_str(), 0);
+	unsigned options = kGlslOptionSerializeIR;
+	if (testName.compare (0, 9, "preshader") == 0)
+		options |= kGlslOptionExtractPreshaders;
+	ApplyTestSettings (ctx, testName);
+	glslopt_shader* shader = glslopt_optimize (ctx, type, input.c_str(), options);
 
 	bool optimizeOk = glslopt_get_status(shader);
 	if (optimizeOk)
@@ -495,12 +588,36 @@ static bool TestFile (glslopt_ctx* ctx, bool vertex,
 		std::string textHir = glslopt_get_raw_output (shader);
 		std::string textOpt = glslopt_get_output (shader);
 
+		// serialized IR should print back to the same optimized output
+		size_t serializedSize = 0;
+		const void* serialized = glslopt_shader_serialize (shader, &serializedSize);
+		glslopt_shader* loaded = glslopt_shader_deserialize (ctx, serialized, serializedSize);
+		if (!glslopt_get_status (loaded) || textOpt != glslopt_get_output (loaded))
+		{
+			printf ("\n  %s: serialized IR does not match optimized output\n", testName.c_str());
+			res = false;
+		}
+		glslopt_shader_delete (loaded);
+
+		// corrupt data must be rejected (or at least not crash)
+		std::vector<unsigned char> corrupt ((const unsigned char*)serialized, (const unsigned char*)serialized + serializedSize);
+		for (size_t pos = 0; pos < corrupt.size(); pos += 1 + corrupt.size() / 16)
+		{
+			corrupt[pos] ^= 0x5A;
+			glslopt_shader_delete (glslopt_shader_deserialize (ctx, &corrupt[0], corrupt.size()));
+			corrupt[pos] ^= 0x5A;
+		}
+
 		// append stats
 		char buffer[1000];
 		int statsAlu, statsTex, statsFlow;
 		glslopt_shader_get_stats (shader, &statsAlu, &statsTex, &statsFlow);
 		sprintf(buffer, "\n// stats: %i alu %i tex %i flow\n", statsAlu, statsTex, statsFlow);
 		textOpt += buffer;
+		glslopt_shader_cost cost;
+		glslopt_shader_get_cost (shader, &cost);
+		sprintf(buffer, "// cost: %g alu %g tex %g flow, %i regs\n", cost.alu, cost.tex, cost.flow, cost.registers);
+		textOpt += buffer;
 		
 		// append inputs
 		const int inputCount = glslopt_shader_get_input_count (shader);
@@ -543,6 +660,24 @@ static bool TestFile (glslopt_ctx* ctx, bool vertex,
 				sprintf(buffer, "//  #%i: %s (%s %s) %ix%i [%i]\n", i, parName, kGlslPrecNames[parPrec], kGlslTypeNames[parType], parVecSize, parMatSize, parArrSize);
 			textOpt += buffer;
 		}
+		if (testName.compare (0, 12, "uniform-bake") == 0)
+		{
+			textOpt += "// branch uniforms:";
+			for (int i = 0; i < uniformCount; ++i)
+			{
+				const char* parName;
+				glslopt_basic_type parType;
+				glslopt_precision parPrec;
+				int parVecSize, parMatSize, parArrSize, location;
+				glslopt_shader_get_uniform_desc(shader, i, &parName, &parType, &parPrec, &parVecSize, &parMatSize, &parArrSize, &location);
+				if (glslopt_shader_get_uniform_controls_branches (shader, i))
+				{
+					textOpt += " ";
+					textOpt += parName;
+				}
+			}
+			textOpt += "\n";
+		}
 		// append textures
 		const int textureCount = glslopt_shader_get_texture_count (shader);
 		if (textureCount > 0)
@@ -563,6 +698,23 @@ static bool TestFile (glslopt_ctx* ctx, bool vertex,
 				sprintf(buffer, "//  #%i: %s (%s %s) %ix%i [%i]\n", i, parName, kGlslPrecNames[parPrec], kGlslTypeNames[parType], parVecSize, parMatSize, parArrSize);
 			textOpt += buffer;
 		}
+		// append preshaders
+		const int preshaderCount = glslopt_shader_get_preshader_count (shader);
+		if (preshaderCount > 0)
+		{
+			sprintf(buffer, "// preshaders: %i\n", preshaderCount);
+			textOpt += buffer;
+		}
+		for (int i = 0; i < preshaderCount; ++i)
+		{
+			const char* preName;
+			const char* preExpression;
+			glslopt_shader_get_preshader_desc(shader, i, &preName, &preExpression);
+			sprintf(buffer, "//  #%i: %s = ", i, preName);
+			textOpt += buffer;
+			textOpt += preExpression;
+			textOpt += "\n";
+		}
 
 		std::string outputOpt;
 		ReadStringFromFile (outputPath.c_str(), outputOpt);
@@ -597,12 +749,209 @@ static bool TestFile (glslopt_ctx* ctx, bool vertex,
 		res = false;
 	}
 
+	// deserialization lowers the IR again, with the same settings
+	ResetTestSettings (ctx, testName);
 	glslopt_shader_delete (shader);
 
 	return res;
 }
 
 
+// Optimizing for several targets at once should produce the same output as
+// optimizing for each of them separately.
+static bool TestFileMultiTarget (glslopt_ctx* ctx, glslopt_ctx* ctxMetal, bool vertex,
+	const std::string& testName,
+	const std::string& inputPath)
+{
+	std::string input;
+	if (!ReadStringFromFile (inputPath.c_str(), input))
+	{
+		printf ("\n  %s: failed to read input file\n", testName.c_str());
+		return false;
+	}
+
+	glslopt_shader_type type = vertex ? kGlslOptShaderVertex : kGlslOptShaderFragment;
+	const glslopt_target targets[2] = { kGlslTargetOpenGLES30, kGlslTargetMetal };
+	glslopt_ctx* targetCtx[2] = { ctx, ctxMetal };
+	for (int i = 0; i < 2; ++i)
+		ApplyTestSettings (targetCtx[i], testName);
+	glslopt_shader* shaders[2];
+	glslopt_optimize_targets (ctx, type, input.c_str(), 0, targets, 2, shaders);
+
+	bool res = true;
+	for (int i = 0; i < 2; ++i)
+	{
+		glslopt_shader* single = glslopt_optimize (targetCtx[i], type, input.c_str(), 0);
+		bool same = glslopt_get_status (shaders[i]) == glslopt_get_status (single);
+		if (same && glslopt_get_status (single))
+		{
+			int stats[2][3];
+			glslopt_shader_get_stats (shaders[i], &stats[0][0], &stats[0][1], &stats[0][2]);
+			glslopt_shader_get_stats (single, &stats[1][0], &stats[1][1], &stats[1][2]);
+			glslopt_shader_cost costs[2];
+			glslopt_shader_get_cost (shaders[i], &costs[0]);
+			glslopt_shader_get_cost (single, &costs[1]);
+			same = strcmp (glslopt_get_output (shaders[i]), glslopt_get_output (single)) == 0 &&
+				memcmp (stats[0], stats[1], sizeof(stats[0])) == 0 &&
+				memcmp (&costs[0], &costs[1], sizeof(costs[0])) == 0 &&
+				glslopt_shader_get_input_count (shaders[i]) == glslopt_shader_get_input_count (single) &&
+				glslopt_shader_get_uniform_total_size (shaders[i]) == glslopt_shader_get_uniform_total_size (single) &&
+				glslopt_shader_get_texture_count (shaders[i]) == glslopt_shader_get_texture_count (single);
+		}
+		if (!same)
+		{
+			printf ("\n  %s: multi-target output #%i does not match single target output\n", testName.c_str(), i);
+			res = false;
+		}
+		glslopt_shader_delete (single);
+		glslopt_shader_delete (shaders[i]);
+	}
+	for (int i = 0; i < 2; ++i)
+		ResetTestSettings (targetCtx[i], testName);
+	return res;
+}
+
+// Optimizes a vertex and fragment shader pair together; the output file has both
+// shaders, vertex shader first.
+static bool TestPair (glslopt_ctx* ctx,
+	const std::string& testName,
+	const std::string& vertexPath,
+	const std::string& fragmentPath,
+	const std::string& outputPath,
+	bool gles,
+	bool doCheckGLSL)
+{
+	std::string input[2];
+	if (!ReadStringFromFile (vertexPath.c_str(), input[0]) || !ReadStringFromFile (fragmentPath.c_str(), input[1]))
+	{
+		printf ("\n  %s: failed to read input files\n", testName.c_str());
+		return false;
+	}
+
+	unsigned options = 0;
+	if (testName.compare (0, 9, "preshader") == 0)
+		options |= kGlslOptionExtractPreshaders;
+
+	glslopt_shader* shaders[2];
+	glslopt_optimize_pair (ctx, input[0].c_str(), input[1].c_str(), options, 8, &shaders[0], &shaders[1]);
+
+	bool res = true;
+	std::string textOpt;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!glslopt_get_status (shaders[i]))
+		{
+			printf ("\n  %s: optimize error: %s\n", testName.c_str(), glslopt_get_log (shaders[i]));
+			res = false;
+			continue;
+		}
+		const char* output = glslopt_get_output (shaders[i]);
+		if (doCheckGLSL && !CheckGLSL (i == 0, gles, testName, "optimized", output))
+			res = false;
+
+		char buffer[1000];
+		int statsAlu, statsTex, statsFlow;
+		glslopt_shader_get_stats (shaders[i], &statsAlu, &statsTex, &statsFlow);
+		sprintf(buffer, "\n// stats: %i alu %i tex %i flow\n", statsAlu, statsTex, statsFlow);
+		textOpt += output;
+		textOpt += buffer;
+		if (i == 0)
+			textOpt += "\n";
+	}
+	glslopt_shader_delete (shaders[0]);
+	glslopt_shader_delete (shaders[1]);
+	if (!res)
+		return false;
+
+	std::string outputOpt;
+	ReadStringFromFile (outputPath.c_str(), outputOpt);
+	if (textOpt != outputOpt)
+	{
+		FILE* f = fopen (outputPath.c_str(), "wb");
+		if (f)
+		{
+			fwrite (textOpt.c_str(), 1, textOpt.size(), f);
+			fclose (f);
+		}
+		printf ("\n  %s: does not match optimized output\n", testName.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Checks that passing the source in pieces (one per line, with explicit lengths and
+// no terminating NULs, like glShaderSource does) gives the same result as passing it
+// whole.
+static bool TestFileSegments (glslopt_ctx* ctx, bool vertex,
+	const std::string& testName,
+	const std::string& inputPath)
+{
+	std::string input;
+	if (!ReadStringFromFile (inputPath.c_str(), input))
+	{
+		printf ("\n  %s: failed to read input file\n", testName.c_str());
+		return false;
+	}
+
+	std::vector<const char*> strings;
+	std::vector<int> lengths;
+	size_t pos = 0;
+	while (pos < input.size())
+	{
+		size_t end = input.find ('\n', pos);
+		end = (end == std::string::npos) ? input.size() : end + 1;
+		strings.push_back (input.c_str() + pos);
+		lengths.push_back (int(end - pos));
+		pos = end;
+	}
+
+	glslopt_shader_type type = vertex ? kGlslOptShaderVertex : kGlslOptShaderFragment;
+	glslopt_shader* whole = glslopt_optimize (ctx, type, input.c_str(), 0);
+	glslopt_shader* pieces = glslopt_optimize_sources (ctx, type, (int)strings.size(), strings.empty() ? NULL : &strings[0], lengths.empty() ? NULL : &lengths[0], 0);
+	bool res = glslopt_get_status (whole) == glslopt_get_status (pieces);
+	if (res && glslopt_get_status (whole))
+		res = strcmp (glslopt_get_output (whole), glslopt_get_output (pieces)) == 0;
+	if (!res)
+		printf ("\n  %s: output from source pieces does not match whole source output\n", testName.c_str());
+	glslopt_shader_delete (pieces);
+	glslopt_shader_delete (whole);
+	return res;
+}
+
+static void AppendOutput (glslopt_shader* shader, const char* data, size_t size, void* userData)
+{
+	((std::string*)userData)->append (data, size);
+}
+
+// Checks that output streamed through an output writer is the same as output
+// kept in the shader.
+static bool TestFileOutputWriter (glslopt_ctx* ctx, bool vertex,
+	const std::string& testName,
+	const std::string& inputPath)
+{
+	std::string input;
+	if (!ReadStringFromFile (inputPath.c_str(), input))
+	{
+		printf ("\n  %s: failed to read input file\n", testName.c_str());
+		return false;
+	}
+
+	glslopt_shader_type type = vertex ? kGlslOptShaderVertex : kGlslOptShaderFragment;
+	glslopt_shader* kept = glslopt_optimize (ctx, type, input.c_str(), 0);
+	std::string written;
+	glslopt_set_output_writer (ctx, AppendOutput, &written);
+	glslopt_shader* streamed = glslopt_optimize (ctx, type, input.c_str(), 0);
+	glslopt_set_output_writer (ctx, NULL, NULL);
+	bool res = glslopt_get_status (kept) == glslopt_get_status (streamed);
+	if (res && glslopt_get_status (kept))
+		res = written == glslopt_get_output (kept) && *glslopt_get_output (streamed) == 0;
+	if (!res)
+		printf ("\n  %s: output from output writer does not match kept output\n", testName.c_str());
+	glslopt_shader_delete (streamed);
+	glslopt_shader_delete (kept);
+	return res;
+}
+
 int main (int argc, const char** argv)
 {
 	if (argc < 2)
@@ -622,6 +971,12 @@ int main (int argc, const char** argv)
 
 	std::string baseFolder = argv[1];
 
+	IncludeFolder includeFolder;
+	includeFolder.path = baseFolder + "/include";
+	for (int i = 0; i < 3; ++i)
+		glslopt_set_include_resolver (ctx[i], ResolveInclude, &includeFolder);
+	glslopt_set_include_resolver (ctxMetal, ResolveInclude, &includeFolder);
+
 	clock_t time0 = clock();
 
 	// 2.39s
@@ -664,11 +1019,40 @@ int main (int argc, const char** argv)
 					{
 						++errors;
 					}
+					// vertex shader inputs are massaged differently for GLES & Metal, so
+					// only fragment shaders have identical input for both
+					if (type == 1 && !TestFileMultiTarget (ctx[api], ctxMetal, false, inname, testFolder + "/" + inname))
+					{
+						++errors;
+					}
+					if (type == 1 && !TestFileSegments (ctx[api], false, inname, testFolder + "/" + inname))
+					{
+						++errors;
+					}
+					if (type == 1 && !TestFileOutputWriter (ctxMetal, false, inname, testFolder + "/" + inname))
+					{
+						++errors;
+					}
 				}
 				++tests;
 			}
 		}
 	}
+
+	// vertex & fragment shader pairs
+	{
+		std::string testFolder = baseFolder + "/pair";
+		printf ("\n** running shader pair tests for OpenGL ES 2.0...\n");
+		StringVector inputFiles = GetFiles (testFolder, "-vs-inES.txt");
+		for (size_t i = 0; i < inputFiles.size(); ++i)
+		{
+			const std::string& inname = inputFiles[i];
+			const std::string name = inname.substr (0, inname.size()-strlen("-vs-inES.txt"));
+			if (!TestPair (ctx[0], name, testFolder + "/" + inname, testFolder + "/" + name + "-fs-inES.txt", testFolder + "/" + name + "-outES.txt", true, hasOpenGL))
+				++errors;
+			++tests;
+		}
+	}
 	clock_t time1 = clock();
 	float timeDelta = float(time1-time0)/CLOCKS_PER_SEC;
 
@@ -0,0 +1,8 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include "saturate.h"
+
+#define SCALE(x) ((x) * SCALE_FACTOR)
+
+#endif
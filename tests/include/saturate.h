@@ -0,0 +1,5 @@
+#define SCALE_FACTOR 2.0
+
+mediump float saturate (mediump float x) {
+    return clamp (x, 0.0, 1.0);
+}
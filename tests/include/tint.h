@@ -0,0 +1,5 @@
+#if USE_TINT
+#define TINT vec4(1.0, 0.5, 0.25, 1.0)
+#else
+#define TINT vec4(1.0)
+#endif